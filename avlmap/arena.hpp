@@ -0,0 +1,315 @@
+// Copyright (c) 2024 PlatinumSamurai. All rights reserved.
+
+#ifndef AVLMAP_AVLMAP_ARENA_HPP_
+#define AVLMAP_AVLMAP_ARENA_HPP_
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+#include "memory.hpp"
+
+#ifdef __linux__
+#include <linux/mempolicy.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+
+// Where an arena takes its chunks from. Everything here is best effort:
+// without reserved huge pages chunks fall back to transparent huge pages,
+// and a kernel without NUMA support leaves placement to first touch.
+struct ArenaPlacement {
+    bool huge_pages = false;    // 2 MiB pages, MAP_HUGETLB first, then THP
+    int numa_node = -1;         // bind chunks to this node
+    bool interleave = false;    // spread pages over all nodes instead
+};
+
+
+// Bump allocator handing out memory from large chunks. Individual blocks are
+// never returned; everything goes away with the arena. Allocation is a
+// single atomic add on the current chunk, so threads cloning parts of one
+// tree can share an arena. With a placement other than the default, chunks
+// are mapped straight from the kernel instead of taken from the heap.
+class Arena {
+ public:
+    static constexpr size_t kAlign = alignof(std::max_align_t);
+    static constexpr size_t kHugePage = size_t(2) << 20;
+
+    explicit Arena(size_t = 0, const ArenaPlacement & = ArenaPlacement());
+    Arena(const Arena &) = delete;
+    Arena& operator=(const Arena &) = delete;
+    ~Arena();
+
+    static constexpr size_t footprint(size_t bytes) {
+        return (bytes + kAlign - 1) / kAlign * kAlign;
+    }
+
+    void* allocate(size_t);
+    void reserve(size_t);
+    size_t capacity() const;
+    size_t used() const;
+    const ArenaPlacement& placement() const;
+
+ private:
+    struct Chunk {
+        char *data;
+        size_t size;
+        std::atomic<size_t> used;
+        bool mapped;
+    };
+
+    std::vector<std::unique_ptr<Chunk>> chunks;
+    std::atomic<Chunk *> current;
+    mutable std::mutex lock;
+    ArenaPlacement where;
+
+    void Grow(size_t);
+    bool Map(Chunk *);
+};
+
+
+inline Arena::Arena(size_t bytes, const ArenaPlacement &p) : current(nullptr),
+                                                                    where(p) {
+    if (bytes) {
+        Grow(footprint(bytes));
+    }
+}
+
+
+inline Arena::~Arena() {
+    for (auto &chunk : chunks) {
+#ifdef __linux__
+        if (chunk->mapped) {
+            munmap(chunk->data, chunk->size);
+            continue;
+        }
+#endif
+        ::operator delete(chunk->data, std::align_val_t(kAlign));
+    }
+}
+
+
+// Maps a chunk for a non-default placement, rounding it to whole huge
+// pages. Returns false to leave the chunk to the heap.
+inline bool Arena::Map(Chunk *chunk) {
+#ifdef __linux__
+    bool bind = (where.numa_node >= 0 || where.interleave);
+    if (!where.huge_pages && !bind) {
+        return false;
+    }
+
+    size_t size = (chunk->size + kHugePage - 1) / kHugePage * kHugePage;
+    void *data = MAP_FAILED;
+    if (where.huge_pages) {
+        data = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    }
+    if (data == MAP_FAILED) {
+        data = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (data == MAP_FAILED) {
+            throw std::bad_alloc();
+        }
+        if (where.huge_pages) {
+            madvise(data, size, MADV_HUGEPAGE);
+        }
+    }
+
+    if (bind) {
+        unsigned long nodes[16] = {};
+        int mode = MPOL_BIND;
+        if (where.interleave) {
+            std::fill(std::begin(nodes), std::end(nodes), ~0ul);
+            mode = MPOL_INTERLEAVE;
+        } else if (where.numa_node < int(sizeof(nodes) * 8)) {
+            nodes[where.numa_node / 64] = 1ul << (where.numa_node % 64);
+        }
+        syscall(SYS_mbind, data, size, mode, nodes, sizeof(nodes) * 8, 0);
+    }
+
+    chunk->data = static_cast<char *>(data);
+    chunk->size = size;
+    chunk->mapped = true;
+
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+// Adds a chunk of at least bytes and makes it current. Called with the
+// lock held or before the arena is shared.
+inline void Arena::Grow(size_t bytes) {
+    size_t size = std::max(bytes, chunks.empty() ? bytes :
+                                                    2 * chunks.back()->size);
+    auto chunk = std::make_unique<Chunk>();
+
+    chunk->size = size;
+    chunk->used = 0;
+    chunk->mapped = false;
+    if (!Map(chunk.get())) {
+        chunk->data = static_cast<char *>(::operator new(size,
+                                                std::align_val_t(kAlign)));
+    }
+    current = chunk.get();
+    chunks.push_back(std::move(chunk));
+}
+
+
+inline void* Arena::allocate(size_t bytes) {
+    bytes = footprint(bytes);
+
+    while (true) {
+        Chunk *chunk = current.load(std::memory_order_acquire);
+        if (chunk) {
+            size_t offset = chunk->used.fetch_add(bytes,
+                                                std::memory_order_relaxed);
+            if (offset + bytes <= chunk->size) {
+                return chunk->data + offset;
+            }
+        }
+
+        std::lock_guard<std::mutex> guard(lock);
+        if (current.load() == chunk) {
+            Grow(std::max<size_t>(bytes, 1 << 16));
+        }
+    }
+}
+
+
+// Makes sure the next bytes of allocations fit in one chunk.
+inline void Arena::reserve(size_t bytes) {
+    std::lock_guard<std::mutex> guard(lock);
+    Chunk *chunk = current.load();
+
+    if (!chunk || chunk->used.load() + bytes > chunk->size) {
+        Grow(bytes);
+    }
+}
+
+
+inline size_t Arena::capacity() const {
+    std::lock_guard<std::mutex> guard(lock);
+    size_t total = 0;
+
+    for (const auto &chunk : chunks) {
+        total += chunk->size;
+    }
+
+    return total;
+}
+
+
+inline size_t Arena::used() const {
+    std::lock_guard<std::mutex> guard(lock);
+    size_t total = 0;
+
+    for (const auto &chunk : chunks) {
+        total += std::min(chunk->used.load(), chunk->size);
+    }
+
+    return total;
+}
+
+
+inline const ArenaPlacement& Arena::placement() const {
+    return where;
+}
+
+
+// Allocator drawing from a shared Arena; deallocate() does nothing. A
+// container copied with it gets an arena of its own, preallocated to what
+// the source arena holds, so a cloned tree sits in one chunk in copy order
+// and is freed in one go. Meant for large maps that are copied, read and
+// dropped as a whole rather than churned.
+template <typename T>
+class ArenaAllocator {
+ public:
+    typedef T value_type;
+
+    static_assert(alignof(T) <= Arena::kAlign, "over-aligned type");
+
+    ArenaAllocator();
+    explicit ArenaAllocator(std::shared_ptr<Arena>);
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U> &);
+
+    T* allocate(size_t);
+    void deallocate(T *, size_t);
+    ArenaAllocator select_on_container_copy_construction() const;
+    std::shared_ptr<Arena> arena() const;
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U> &) const;
+
+ private:
+    std::shared_ptr<Arena> pool;
+};
+
+
+template <typename T>
+ArenaAllocator<T>::ArenaAllocator() : pool(std::make_shared<Arena>()) {}
+
+
+template <typename T>
+ArenaAllocator<T>::ArenaAllocator(std::shared_ptr<Arena> a) :
+                                                        pool(std::move(a)) {}
+
+
+template <typename T>
+template <typename U>
+ArenaAllocator<T>::ArenaAllocator(const ArenaAllocator<U> &other) :
+                                                        pool(other.arena()) {}
+
+
+template <typename T>
+T* ArenaAllocator<T>::allocate(size_t n) {
+    return static_cast<T *>(pool->allocate(n * sizeof(T)));
+}
+
+
+template <typename T>
+void ArenaAllocator<T>::deallocate(T *, size_t) {}
+
+
+template <typename T>
+ArenaAllocator<T> ArenaAllocator<T>::select_on_container_copy_construction()
+                                                                        const {
+    return ArenaAllocator<T>(std::make_shared<Arena>(pool->used(),
+                                                        pool->placement()));
+}
+
+
+template <typename T>
+std::shared_ptr<Arena> ArenaAllocator<T>::arena() const {
+    return pool;
+}
+
+
+template <typename T>
+template <typename U>
+bool ArenaAllocator<T>::operator==(const ArenaAllocator<U> &other) const {
+    return pool == other.arena();
+}
+
+
+template <typename T>
+struct AllocationSize<ArenaAllocator<T>> {
+    static constexpr size_t of(size_t bytes) {
+        return Arena::footprint(bytes);
+    }
+};
+
+
+// Allocation is an atomic add and deallocation does nothing.
+template <typename T>
+struct ConcurrentAllocator<ArenaAllocator<T>> : std::true_type {};
+
+#endif  // AVLMAP_AVLMAP_ARENA_HPP_
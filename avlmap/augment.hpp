@@ -0,0 +1,89 @@
+// Copyright (c) 2024 PlatinumSamurai. All rights reserved.
+
+#ifndef AVLMAP_AVLMAP_AUGMENT_HPP_
+#define AVLMAP_AVLMAP_AUGMENT_HPP_
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+
+
+// Augmentation policies for Avl. A policy is a monoid over value_type:
+// identity() is its neutral element, combine() must be associative and
+// lift() maps one element to value_type. combine() is always called with
+// its arguments in key order, so it need not be commutative.
+template <typename T>
+struct SumAugment {
+    typedef T value_type;
+
+    static T identity() {
+        return T();
+    }
+
+    template <typename Key>
+    static T lift(const Key &, const T &value) {
+        return value;
+    }
+
+    static T combine(const T &lhs, const T &rhs) {
+        return lhs + rhs;
+    }
+};
+
+
+template <typename T>
+struct MinAugment {
+    typedef T value_type;
+
+    static T identity() {
+        return std::numeric_limits<T>::max();
+    }
+
+    template <typename Key>
+    static T lift(const Key &, const T &value) {
+        return value;
+    }
+
+    static T combine(const T &lhs, const T &rhs) {
+        return std::min(lhs, rhs);
+    }
+};
+
+
+template <typename T>
+struct MaxAugment {
+    typedef T value_type;
+
+    static T identity() {
+        return std::numeric_limits<T>::lowest();
+    }
+
+    template <typename Key>
+    static T lift(const Key &, const T &value) {
+        return value;
+    }
+
+    static T combine(const T &lhs, const T &rhs) {
+        return std::max(lhs, rhs);
+    }
+};
+
+
+struct CountAugment {
+    typedef size_t value_type;
+
+    static size_t identity() {
+        return 0;
+    }
+
+    template <typename Key, typename T>
+    static size_t lift(const Key &, const T &) {
+        return 1;
+    }
+
+    static size_t combine(size_t lhs, size_t rhs) {
+        return lhs + rhs;
+    }
+};
+
+#endif  // AVLMAP_AVLMAP_AUGMENT_HPP_
@@ -3,35 +3,196 @@
 #ifndef AVLMAP_AVLMAP_AVL_HPP_
 #define AVLMAP_AVLMAP_AVL_HPP_
 
+#include <algorithm>
+#include <compare>
+#include <concepts>
+#include <future>
+#include <limits>
+#include <map>
 #include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <type_traits>
 #include <utility>
+#include <vector>
 #include "node.hpp"
+#include "links.hpp"
+#include "augment.hpp"
+#include "filter.hpp"
+#include "key_cache.hpp"
+#include "memory.hpp"
 #include "avl_iterator.hpp"
+#include "avl_cursor.hpp"
+#include "node_handle.hpp"
+#include "reclaimer.hpp"
 #include "../format/format.hpp"
 
 
-template <typename Key, typename T, typename Compare, typename Allocator>
+// A comparator returning an ordering instead of bool is called once per
+// level; std::less over a type with <=> is treated the same way. Any other
+// bool comparator is called once per level on the way down and once more at
+// the bottom to confirm equivalence. Key never needs operator==.
+template <typename Compare, typename Key>
+concept ThreeWayComparator = requires(const Compare &cmp, const Key &k) {
+    { cmp(k, k) } -> std::convertible_to<std::partial_ordering>;
+};
+
+
+// Whether lhs orders before rhs under either kind of comparator.
+template <typename Compare, typename Key>
+constexpr bool avl_less(const Compare &cmp, const Key &lhs, const Key &rhs) {
+    if constexpr (ThreeWayComparator<Compare, Key>) {
+        return cmp(lhs, rhs) < 0;
+    } else {
+        return cmp(lhs, rhs);
+    }
+}
+
+
+enum class ChangeKind { inserted, erased, modified };
+
+
+// When range erasures free what they cut out: on the calling thread, or in
+// the background on the Reclaimer thread.
+enum class Teardown { now, deferred };
+
+
+// One entry of a diff or change log. before is empty for an insertion and
+// after for an erasure.
+template <typename Key, typename T>
+struct AvlChange {
+    ChangeKind kind;
+    Key key;
+    std::optional<T> before;
+    std::optional<T> after;
+};
+
+
+template <typename Compare, typename Key>
+concept ThreeWayOrdered = ThreeWayComparator<Compare, Key> ||
+        ((std::same_as<Compare, std::less<Key>> ||
+                std::same_as<Compare, std::less<>>) &&
+                                            std::three_way_comparable<Key>);
+
+
+// Orderings a lookup filter can stand in front of. The filter hashes with
+// std::hash, so keys the comparator finds equivalent must also be equal;
+// that holds for the standard orderings but not, say, for a case-insensitive
+// one, where the filter would turn hits into misses.
+template <typename Compare, typename Key>
+concept HashFilterable = Hashable<Key> &&
+        (std::same_as<Compare, std::less<Key>> ||
+                std::same_as<Compare, std::less<>> ||
+                std::same_as<Compare, std::greater<Key>> ||
+                std::same_as<Compare, std::greater<>> ||
+                std::same_as<Compare, std::compare_three_way>);
+
+
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
 class Avl {
  private:
+    template <typename, typename>
+    friend class IntervalAvl;
+    template <typename, typename, typename, typename, typename, typename,
+                                                                       typename>
+    friend class AvlCursor;
+    friend Balance;
+    friend TreeLinks;
+
+    static constexpr bool kAugmented = !std::is_same_v<Augment, NoAugment>;
+    static constexpr bool kCached = !std::is_same_v<KeyCache, NoKeyCache>;
+    typedef std::conditional_t<kAugmented, AugmentedNode<Key, T, Augment>,
+                                                    Node<Key, T>> BaseNode;
+    static constexpr bool kDeep =
+                        !std::is_base_of_v<NoDeepSize, DeepSize<Key>> ||
+                        !std::is_base_of_v<NoDeepSize, DeepSize<T>>;
+    typedef std::conditional_t<kCached, CachedKeyNode<BaseNode, KeyCache>,
+                                                        BaseNode> CachedNode;
+    typedef std::conditional_t<kDeep, SizedNode<CachedNode>,
+                                                        CachedNode> NodeType;
+    typedef typename std::allocator_traits<Allocator>::template
+                                    rebind_alloc<NodeType> NodeAllocator;
+
+    static_assert(!kCached || ThreeWayOrdered<Compare, Key>,
+                "a key cache needs a three-way comparison to fall back on");
+
+    // Trees at least this big are copied by several threads.
+    static constexpr size_t kParallelCloneSize = size_t(1) << 14;
+
     Node<Key, T> *root;
+    Node<Key, T> *leftmost;
+    Node<Key, T> *rightmost;
     Compare cmp;
     Allocator alloc;
+    size_t total = 0;
+    size_t heap = 0;
+    size_t turns = 0;
+    bool tracked = false;
+
+    // Entries taken out by clear_step() and not freed yet.
+    Node<Key, T> *graveyard = nullptr;
+    size_t buried = 0;
+
+    // State at the last checkpoint of every key touched since.
+    struct Logged {
+        bool existed = false;
+        std::optional<T> before;
+    };
+    struct LogOrder {
+        Compare cmp;
+
+        bool operator()(const Key &lhs, const Key &rhs) const {
+            return avl_less(cmp, lhs, rhs);
+        }
+    };
+    std::unique_ptr<std::map<Key, Logged, LogOrder>> log;
+    std::unique_ptr<CountingBloomFilter<Key>> filter;
 
     void UpdateHeight(Node<Key, T> *);
-    int GetHeight(const Node<Key, T> *) const;
-    int HeightDiff(const Node<Key, T> *) const;
-    size_t Count(const Node<Key, T> *) const;
+    static auto Aggregate(const Node<Key, T> *);
+    static double Weight(const Node<Key, T> *);
 
     Node<Key, T>* LeftRot(Node<Key, T> *);
     Node<Key, T>* RightRot(Node<Key, T> *);
-    Node<Key, T>* Rebalance(Node<Key, T> *);
+    void Rebalance(Node<Key, T> *);
+    void Replace(Node<Key, T> *, Node<Key, T> *, Node<Key, T> *);
     Node<Key, T>* MinElem(Node<Key, T> *) const;
     Node<Key, T>* MaxElem(Node<Key, T> *) const;
     Node<Key, T>* RemoveElem(Node<Key, T> *);
-    Node<Key, T>* Erase(Node<Key, T> *, const Key &);
+    Node<Key, T>* CreateNode(const Key &, const T &);
+    void Prepare(Node<Key, T> *);
+    void DestroyNode(Node<Key, T> *);
+    static void Free(Node<Key, T> *, Allocator &);
+    static size_t Reclaim(Node<Key, T> *&, Allocator &, size_t);
+    Node<Key, T>* Detach();
+    void Account(Node<Key, T> *, bool);
+    void Record(const Key &, bool, const T *);
+    void Record(const Node<Key, T> *);
+    void Refilter(const FilterOptions &);
+    bool Excluded(const Key &) const;
+    Node<Key, T>* CloneNode(const Node<Key, T> *);
+    Node<Key, T>* Clone(const Node<Key, T> *);
+    Node<Key, T>* Clone(const Node<Key, T> *, unsigned);
+    void Link(Node<Key, T> *, Node<Key, T> *, bool);
+    void Unlink(Node<Key, T> *);
+    void Erase(Node<Key, T> *);
     void Clear(Node<Key, T> *);
-    bool Contains(Node<Key, T> *, const Key &) const;
-    AvlIterator<Key, T, Compare> Find(Node<Key, T> *, const Key &);
+    void Discard(Node<Key, T> *, Teardown);
+    bool Less(const Key &, const Key &) const;
+    Node<Key, T>* Join(Node<Key, T> *, Node<Key, T> *, Node<Key, T> *);
+    Node<Key, T>* Join(Node<Key, T> *, Node<Key, T> *);
+    std::pair<Node<Key, T> *, Node<Key, T> *> Split(Node<Key, T> *,
+                                                                const Key &);
+    Node<Key, T>* Cut(const Key *, const Key *);
+    auto Order(const Key &, const Key &) const;
+    Node<Key, T>* Descend(const Key &, Node<Key, T> **, bool *,
+                                            Node<Key, T> * = nullptr) const;
+    std::pair<AvlIterator<Key, T, Compare>, bool>
+            Insert(const std::pair<const Key, T> &, Node<Key, T> *);
     void UpdateParents(Node <Key, T> *);
 
 
@@ -41,29 +202,80 @@ class Avl {
     typedef const AvlIterator<Key, T, Compare> c_iterator;
     typedef const std::reverse_iterator<AvlIterator<Key, T, Compare>>
                                                                 cr_iterator;
+    typedef AvlNodeHandle<Key, T, Allocator, NodeType> node_type;
+    typedef AvlCursor<Key, T, Compare, Allocator, Augment, KeyCache, Balance>
+                                                                cursor_type;
+
+    struct insert_return_type {
+        iterator position;
+        bool inserted;
+        node_type node;
+    };
+
     Avl();
+    explicit Avl(const Allocator &);
     Avl(const Key &, T &&);
     Avl(std::initializer_list<std::pair<const Key, T>>);
     Avl(const Avl &);
+    Avl(Avl &&) noexcept;
     ~Avl();
 
     std::pair<AvlIterator<Key, T, Compare>, bool>
                                     insert(const std::pair<const Key, T> &);
+    std::pair<AvlIterator<Key, T, Compare>, bool>
+                        insert_or_assign(const std::pair<const Key, T> &);
+    insert_return_type insert(node_type &&);
+    node_type extract(const Key &);
+    node_type extract(iterator);
     size_t erase(const Key &k);
     auto erase(auto pos) -> decltype(pos);
+    iterator erase(iterator, iterator, Teardown = Teardown::now);
+    size_t erase_range(const Key &, const Key &, Teardown = Teardown::now);
+    Avl extract_range(const Key &, const Key &);
+    Avl clone(unsigned) const;
     bool empty() const;
     size_t size() const;
     void clear();
+    void clear_async();
+    size_t clear_step(size_t);
     bool contains(const Key &k) const;
     AvlIterator<Key, T, Compare> find(const Key &k);
+    c_iterator find(const Key &k) const;
     T& at(const Key &);
     T& operator[](const Key &);
     T& operator[](const Key &&);
-    T& operator=(const Avl &);
-
-    template <typename K, typename Value, typename Comp, typename Alloc>
+    Avl& operator=(const Avl &);
+    Avl& operator=(Avl &&) noexcept;
+    std::pair<const Key, T>& front();
+    std::pair<const Key, T>& back();
+    std::pair<Key, T> pop_min();
+    std::pair<Key, T> pop_max();
+    auto reduce() const;
+    auto reduce(const Key &, const Key &) const;
+    void refresh(iterator);
+    MemoryUsage memory_usage() const;
+    void track(const std::string &);
+    void enable_change_log();
+    void disable_change_log();
+    void checkpoint();
+    std::vector<AvlChange<Key, T>> changes() const;
+    void enable_filter(const FilterOptions & = FilterOptions())
+                                        requires HashFilterable<Compare, Key>;
+    void disable_filter();
+    cursor_type cursor();
+    size_t rotations() const;
+    std::vector<std::pair<iterator, iterator>> partition(size_t);
+
+    template <typename K, typename Value, typename Comp, typename Alloc,
+                            typename Aug, typename Cache, typename Bal>
+    friend std::vector<AvlChange<K, Value>> diff(
+                        const Avl<K, Value, Comp, Alloc, Aug, Cache, Bal> &,
+                        const Avl<K, Value, Comp, Alloc, Aug, Cache, Bal> &);
+
+    template <typename K, typename Value, typename Comp, typename Alloc,
+                            typename Aug, typename Cache, typename Bal>
     friend std::ostream& operator<<(std::ostream &out,
-                                        const Avl<K, Value, Comp, Alloc> &avl);
+                        const Avl<K, Value, Comp, Alloc, Aug, Cache, Bal> &avl);
     void printNode(std::ostream &out,
                                 const Node<Key, T> *node, int offset) const;
 
@@ -78,315 +290,869 @@ class Avl {
 };
 
 
-template <typename Key, typename T, typename Compare, typename Allocator>
-AvlIterator<Key, T, Compare> Avl<Key, T, Compare, Allocator>::begin() {
-    return AvlIterator<Key, T, Compare>(MinElem(root), true, false);
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+AvlIterator<Key, T, Compare>
+          Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::begin() {
+    return AvlIterator<Key, T, Compare>(leftmost, true, !leftmost);
 }
 
 
-template <typename Key, typename T, typename Compare, typename Allocator>
-AvlIterator<Key, T, Compare> Avl<Key, T, Compare, Allocator>::end() {
-    return AvlIterator<Key, T, Compare>(MaxElem(root), false, true);
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+AvlIterator<Key, T, Compare>
+            Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::end() {
+    return AvlIterator<Key, T, Compare>(rightmost, false, true);
 }
 
 
-template <typename Key, typename T, typename Compare, typename Allocator>
-std::reverse_iterator<AvlIterator<Key, T,
-                        Compare>> Avl<Key, T, Compare, Allocator>::rbegin() {
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+std::reverse_iterator<AvlIterator<Key, T, Compare>>
+         Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::rbegin() {
     return std::reverse_iterator<AvlIterator<Key, T, Compare>>
-                (AvlIterator<Key, T, Compare>(MaxElem(root), false, true));
+                (AvlIterator<Key, T, Compare>(rightmost, false, true));
 }
 
 
-template <typename Key, typename T, typename Compare, typename Allocator>
-std::reverse_iterator<AvlIterator<Key, T,
-                            Compare>> Avl<Key, T, Compare, Allocator>::rend() {
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+std::reverse_iterator<AvlIterator<Key, T, Compare>>
+           Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::rend() {
     return std::reverse_iterator<AvlIterator<Key, T, Compare>>
-                (AvlIterator<Key, T, Compare>(MinElem(root), true, false));
+                (AvlIterator<Key, T, Compare>(leftmost, true, !leftmost));
 }
 
 
-template <typename Key, typename T, typename Compare, typename Allocator>
-Avl<Key, T, Compare, Allocator>::c_iterator
-                            Avl<Key, T, Compare, Allocator>::begin() const {
-    return c_iterator(MinElem(root), true, false);
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::c_iterator
+    Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::begin() const {
+    return c_iterator(leftmost, true, !leftmost);
 }
 
 
-template <typename Key, typename T, typename Compare, typename Allocator>
-Avl<Key, T, Compare, Allocator>::c_iterator
-                            Avl<Key, T, Compare, Allocator>::end() const {
-    return c_iterator(MaxElem(root), false, true);
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::c_iterator
+      Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::end() const {
+    return c_iterator(rightmost, false, true);
 }
 
 
-template <typename Key, typename T, typename Compare, typename Allocator>
-Avl<Key, T, Compare, Allocator>::cr_iterator
-                            Avl<Key, T, Compare, Allocator>::rbegin() const {
-    return cr_iterator(AvlIterator<const Key, const T, Compare>
-                                            (MaxElem(root), false, true));
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::cr_iterator
+   Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::rbegin() const {
+    return cr_iterator(AvlIterator<Key, T, Compare>(rightmost, false, true));
 }
 
 
-template <typename Key, typename T, typename Compare, typename Allocator>
-Avl<Key, T, Compare, Allocator>::cr_iterator
-                            Avl<Key, T, Compare, Allocator>::rend() const {
-    return cr_iterator(AvlIterator<const Key, const T, Compare>
-                                            (MinElem(root), true, false));
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::cr_iterator
+     Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::rend() const {
+    return cr_iterator(AvlIterator<Key, T, Compare>(leftmost, true,
+                                                                !leftmost));
 }
 
 
-template <typename Key, typename T, typename Compare, typename Allocator>
-Node<Key, T>* Avl<Key, T, Compare, Allocator>::LeftRot(Node<Key, T> *node) {
-    Node<Key, T> *temp = node->right;
-    node->right = temp->left;
-    if (node->right) {
-        node->right->prev = node;
-    }
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+Node<Key, T>*
+           Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::LeftRot(
+                                                        Node<Key, T> *node) {
+    ++turns;
 
-    temp->left = node;
-    temp->prev = node->prev;
-    node->prev = temp;
+    return TreeLinks::rotate_left(*this, node);
+}
 
-    UpdateHeight(node);
-    UpdateHeight(temp);
 
-    return temp;
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+Node<Key, T>*
+          Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::RightRot(
+                                                        Node<Key, T> *node) {
+    ++turns;
+
+    return TreeLinks::rotate_right(*this, node);
 }
 
 
-template <typename Key, typename T, typename Compare, typename Allocator>
-Node<Key, T>* Avl<Key, T, Compare, Allocator>::RightRot(Node<Key, T> *node) {
-    Node<Key, T> *temp = node->left;
-    node->left = temp->right;
-    if (node->left) {
-        node->left->prev = node;
-    }
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+void
+        Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::Replace(
+                  Node<Key, T> *parent, Node<Key, T> *old, Node<Key, T> *node) {
+    TreeLinks::replace(*this, parent, old, node);
+}
+
+
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+void
+        Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::Rebalance(
+                                                           Node<Key, T> *node) {
+    Balance::rebalance(*this, node);
+}
+
 
-    temp->right = node;
-    temp->prev = node->prev;
-    node->prev = temp;
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+Node<Key, T>*
+           Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::MinElem(
+                                                Node<Key, T> *node) const {
+    return TreeLinks::min(node);
+}
+
+
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+Node<Key, T>*
+           Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::MaxElem(
+                                                Node<Key, T> *node) const {
+    return TreeLinks::max(node);
+}
+
+
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+Node<Key, T>*
+        Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::RemoveElem(
+                                                        Node<Key, T> *node) {
+    return TreeLinks::splice_out(*this, node);
+}
 
+
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+Node<Key, T>*
+        Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::CreateNode(
+                                                const Key &k, const T &val) {
+    NodeAllocator nodes(alloc);
+    Node<Key, T> *node = new(nodes.allocate(1)) NodeType();
+    node->pair = alloc.allocate(1);
+    new(node->pair)std::pair<const Key, T>(k, val);
+    Prepare(node);
+    Account(node, true);
+
+    return node;
+}
+
+
+// Recomputes everything a detached node caches about its own key and value.
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+void Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::Prepare(
+                                                        Node<Key, T> *node) {
+    if constexpr (kCached) {
+        static_cast<NodeType *>(node)->cached =
+                                            KeyCache::make(node->pair->first);
+    }
+    Balance::hang(node);
     UpdateHeight(node);
-    UpdateHeight(temp);
+}
+
 
-    return temp;
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+void Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::DestroyNode(
+                                                        Node<Key, T> *node) {
+    Account(node, false);
+    Free(node, alloc);
 }
 
 
-template <typename Key, typename T, typename Compare, typename Allocator>
-Node<Key, T>* Avl<Key, T, Compare, Allocator>::Rebalance(Node<Key, T> *node) {
-    bool side;
+// Destroys and deallocates a node the tree no longer counts. Static, so
+// that detached nodes can be freed after the tree is gone.
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+void Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::Free(
+                                    Node<Key, T> *node, Allocator &pairs) {
+    std::destroy_n(node->pair, 1);
+    pairs.deallocate(node->pair, 1);
 
-    if (!node) {
-        return node;
+    NodeAllocator nodes(pairs);
+    std::destroy_at(static_cast<NodeType *>(node));
+    nodes.deallocate(static_cast<NodeType *>(node), 1);
+}
+
+
+// Adds a node entering the tree to the counters behind size() and
+// memory_usage() and to the filter, or takes out one leaving it. A node
+// entering must not be linked yet, as growing the filter rebuilds it from
+// the tree.
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+void Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::Account(
+                                              Node<Key, T> *node, bool add) {
+    total += (add ? 1 : -1);
+
+    if constexpr (HashFilterable<Compare, Key>) {
+        if (filter && add) {
+            if (total > filter->capacity()) {
+                FilterOptions options = filter->options();
+                options.capacity = 2 * total;
+                Refilter(options);
+            }
+            filter->add(node->pair->first);
+        } else if (filter) {
+            filter->remove(node->pair->first);
+        }
     }
 
-    if (node->prev) {
-        if (node->prev->left &&
-                    node->prev->left->pair->first == node->pair->first) {
-            side = true;
+    if constexpr (kDeep) {
+        auto sized = static_cast<NodeType *>(node);
+        if (add) {
+            sized->deep = DeepSize<Key>::of(node->pair->first) +
+                                        DeepSize<T>::of(node->pair->second);
+            heap += sized->deep;
         } else {
-            side = false;
+            heap -= sized->deep;
         }
     }
+}
 
-    UpdateHeight(node);
-    if (HeightDiff(node) == 2) {
-        if (HeightDiff(node->right) < 0) {
-            node->right = RightRot(node->right);
+
+// Notes what k was at the checkpoint the first time it is touched after it.
+// before is null when the old value is already gone or unknown.
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+void
+        Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::Record(
+                            const Key &k, bool existed, const T *before) {
+    if (!log) {
+        return;
+    }
+
+    auto [it, added] = log->try_emplace(k);
+    if (added) {
+        it->second.existed = existed;
+        if constexpr (std::is_copy_constructible_v<T>) {
+            if (before) {
+                it->second.before.emplace(*before);
+            }
         }
+    }
+}
 
-        node = LeftRot(node);
-        if (node->prev) {
-            (side ? node->prev->left : node->prev->right) = node;
-        } else {
-            root = node;
+
+// Records every entry of a subtree about to leave the tree.
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+void Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::Record(
+                                                const Node<Key, T> *subtree) {
+    if (!log) {
+        return;
+    }
+
+    std::vector<const Node<Key, T> *> path;
+    if (subtree) {
+        path.push_back(subtree);
+    }
+    while (!path.empty()) {
+        const Node<Key, T> *node = path.back();
+        path.pop_back();
+        Record(node->pair->first, true, &node->pair->second);
+        if (node->left) {
+            path.push_back(node->left);
         }
-    } else if (HeightDiff(node) == -2) {
-        if (HeightDiff(node->left) > 0) {
-            node->left = LeftRot(node->left);
+        if (node->right) {
+            path.push_back(node->right);
         }
+    }
+}
 
-        node = RightRot(node);
 
-        if (node->prev) {
-            (side ? node->prev->left : node->prev->right) = node;
-        } else {
-            root = node;
-        }
+// Replaces the filter by a new one holding the keys of the tree.
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+void Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::Refilter(
+                                            const FilterOptions &options) {
+    filter = std::make_unique<CountingBloomFilter<Key>>(options);
+
+    for (auto it = begin(); it != end(); ++it) {
+        filter->add((*it).first);
+    }
+}
+
+
+// True when the filter proves k absent, so the descent can be skipped.
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+bool Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::Excluded(
+                                                        const Key &k) const {
+    if constexpr (HashFilterable<Compare, Key>) {
+        return filter && !filter->may_contain(k);
     } else {
-        Rebalance(node->prev);
+        return false;
+    }
+}
+
+
+// Copies a node with everything it caches: height, aggregate and key
+// summary stay valid because the copy gets the same subtree shape.
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+Node<Key, T>*
+         Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::CloneNode(
+                                                    const Node<Key, T> *src) {
+    NodeAllocator nodes(alloc);
+    auto copy = nodes.allocate(1);
+    Node<Key, T> *node = nullptr;
+
+    try {
+        node = new(copy) NodeType(*static_cast<const NodeType *>(src));
+        node->prev = nullptr;
+        node->left = nullptr;
+        node->right = nullptr;
+        node->pair = alloc.allocate(1);
+    } catch (...) {
+        if (node) {
+            std::destroy_at(copy);
+        }
+        nodes.deallocate(copy, 1);
+        throw;
+    }
+
+    try {
+        new(node->pair)std::pair<const Key, T>(*src->pair);
+    } catch (...) {
+        alloc.deallocate(node->pair, 1);
+        std::destroy_at(copy);
+        nodes.deallocate(copy, 1);
+        throw;
     }
 
     return node;
 }
 
 
-template <typename Key, typename T, typename Compare, typename Allocator>
-Node<Key, T>* Avl<Key, T, Compare, Allocator>::MinElem(Node<Key, T> *node)
-                                                                        const {
-    return node && node->left ? MinElem(node->left) : node;
-}
+// Copies the subtree under src in preorder, following prev links back up
+// on both sides in step. No key is compared and nothing is rebalanced. If
+// a copy throws, the part already built is freed.
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+Node<Key, T>*
+             Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::Clone(
+                                                    const Node<Key, T> *src) {
+    if (!src) {
+        return nullptr;
+    }
 
+    Node<Key, T> *top = CloneNode(src);
+    Node<Key, T> *node = top;
+
+    try {
+        while (true) {
+            if (src->left && !node->left) {
+                node->left = CloneNode(src->left);
+                node->left->prev = node;
+                src = src->left;
+                node = node->left;
+            } else if (src->right && !node->right) {
+                node->right = CloneNode(src->right);
+                node->right->prev = node;
+                src = src->right;
+                node = node->right;
+            } else if (node == top) {
+                break;
+            } else {
+                src = src->prev;
+                node = node->prev;
+            }
+        }
+    } catch (...) {
+        Reclaim(top, alloc, std::numeric_limits<size_t>::max());
+        throw;
+    }
 
-template <typename Key, typename T, typename Compare, typename Allocator>
-Node<Key, T>* Avl<Key, T, Compare, Allocator>::MaxElem(Node<Key, T> *node)
-                                                                        const {
-    return node && node->right ? MaxElem(node->right) : node;
+    return top;
 }
 
 
-template <typename Key, typename T, typename Compare, typename Allocator>
-Node<Key, T>* Avl<Key, T, Compare, Allocator>::RemoveElem(Node<Key, T> *node) {
-    if (!node->left) {
-        return node->right;
+// Hands the left subtree to another thread for the first depth levels, so
+// 2^depth workers copy disjoint subtrees at the bottom. A worker that
+// throws is waited for and everything copied is freed before rethrowing.
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+Node<Key, T>*
+             Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::Clone(
+                                    const Node<Key, T> *src, unsigned depth) {
+    if (!src || !depth) {
+        return Clone(src);
+    }
+
+    Node<Key, T> *node = CloneNode(src);
+    std::future<Node<Key, T> *> left;
+
+    try {
+        left = std::async(std::launch::async, [this, src, depth] {
+            return Clone(src->left, depth - 1);
+        });
+        node->right = Clone(src->right, depth - 1);
+    } catch (...) {
+        if (left.valid()) {
+            try {
+                Node<Key, T> *lsubtree = left.get();
+                Reclaim(lsubtree, alloc, std::numeric_limits<size_t>::max());
+            } catch (...) {}
+        }
+        Reclaim(node, alloc, std::numeric_limits<size_t>::max());
+        throw;
+    }
+
+    try {
+        node->left = left.get();
+    } catch (...) {
+        Reclaim(node, alloc, std::numeric_limits<size_t>::max());
+        throw;
     }
-    node->left = RemoveElem(node->left);
     if (node->left) {
         node->left->prev = node;
     }
+    if (node->right) {
+        node->right->prev = node;
+    }
 
-    return Rebalance(node);
+    return node;
 }
 
 
-template <typename Key, typename T, typename Compare, typename Allocator>
-Node<Key, T>* Avl<Key, T, Compare, Allocator>::Erase(Node<Key, T> *node,
-                                                                const Key &k) {
-    if (!node) {
-        return nullptr;
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+void
+        Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::Link(
+                          Node<Key, T> *node, Node<Key, T> *parent, bool left) {
+    node->prev = parent;
+    Prepare(node);
+
+    if (!parent) {
+        root = node;
+        leftmost = node;
+        rightmost = node;
+    } else if (left) {
+        parent->left = node;
+        if (parent == leftmost) {
+            leftmost = node;
+        }
+        Rebalance(parent);
+    } else {
+        parent->right = node;
+        if (parent == rightmost) {
+            rightmost = node;
+        }
+        Rebalance(parent);
     }
+}
 
-    if (k == node->pair->first) {
-        Node<Key, T> *rsubtree = node->right;
-        Node<Key, T> *lsubtree = node->left;
-        Node<Key, T> *prev = node->prev;
-        bool side;
 
-        if (prev && prev->left &&
-                                prev->left->pair->first == node->pair->first) {
-            side = true;
-        } else {
-            side = false;
-        }
-        std::destroy_n(node->pair, 1);
-        alloc.deallocate(node->pair, 1);
-        delete node;
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+void
+        Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::Unlink(
+                                                           Node<Key, T> *node) {
+    TreeLinks::unlink(*this, node);
+}
+
+
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+void
+        Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::Erase(
+                                                           Node<Key, T> *node) {
+    Record(node->pair->first, true, &node->pair->second);
+    Unlink(node);
+    DestroyNode(node);
+}
+
+
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+void
+        Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::Clear(
+                                                           Node<Key, T> *node) {
+    TreeLinks::clear(node, [this](Node<Key, T> *doomed) {
+        DestroyNode(doomed);
+    });
+}
 
-        if (!rsubtree) {
-            if (lsubtree && lsubtree->prev) {
-                lsubtree->prev = prev;
-                (side ? lsubtree->prev->left :
-                                        lsubtree->prev->right) = lsubtree;
-            }
-            return lsubtree;
-        }
 
-        Node<Key, T> *rmin = MinElem(rsubtree);
-        rsubtree->prev = nullptr;
-        rmin->right = RemoveElem(rsubtree);
-        rmin->left = lsubtree;
-        if (rmin->left) {
-            rmin->left->prev = rmin;
+// Takes a subtree cut out of the tree off the counters and frees it, or
+// with Teardown::deferred leaves the freeing to the Reclaimer thread under
+// the same conditions as clear_async(). The counters are still settled
+// here, one visit per entry, but no destructor or deallocation runs.
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+void Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::Discard(
+                                Node<Key, T> *subtree, Teardown teardown) {
+    if (teardown == Teardown::now || !subtree) {
+        Clear(subtree);
+        return;
+    }
+
+    Node<Key, T> *node = MinElem(subtree);
+    while (node) {
+        Account(node, false);
+        if (node->right) {
+            node = MinElem(node->right);
+            continue;
         }
-        if (rmin->right) {
-            rmin->right->prev = rmin;
+        while (node != subtree && node->prev->right == node) {
+            node = node->prev;
         }
-        rmin->prev = prev;
+        node = (node == subtree ? nullptr : node->prev);
+    }
 
-        if (prev) {
-            (side ? rmin->prev->left : rmin->prev->right) = rmin;
-        }
+    Reclaimer::instance().post([subtree, pairs = alloc]() mutable {
+        Reclaim(subtree, pairs, std::numeric_limits<size_t>::max());
+    });
+}
+
+
+// Frees up to budget nodes of a detached tree the same way as Clear, and
+// leaves node at what is left of it. Returns the number freed.
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+size_t Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::Reclaim(
+                Node<Key, T> *&node, Allocator &pairs, size_t budget) {
+    return TreeLinks::clear(node, [&pairs](Node<Key, T> *doomed) {
+        Free(doomed, pairs);
+    }, budget);
+}
+
+
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+bool
+        Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::Less(
+                                                                 const Key &lhs,
+                                                    const Key &rhs) const {
+    return avl_less(cmp, lhs, rhs);
+}
 
-        return Rebalance(rmin);
-    } else if (cmp(k, node->pair->first)) {
-        node->left = Erase(node->left, k);
+
+// Joins two detached trees and a detached node whose key lies between them.
+// The taller tree's spine is walked down to the height of the shorter one,
+// node is hung there and Rebalance fixes the path back up. root is used as
+// scratch for the result, so callers have to restore it.
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+Node<Key, T>* Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::Join(
+        Node<Key, T> *lsubtree, Node<Key, T> *node, Node<Key, T> *rsubtree) {
+    Node<Key, T> *parent = nullptr;
+    Node<Key, T> *spine;
+
+    node->prev = nullptr;
+    if (Balance::taller(lsubtree, rsubtree)) {
+        spine = lsubtree;
+        while (Balance::taller(spine, rsubtree)) {
+            parent = spine;
+            spine = spine->right;
+        }
+        node->left = spine;
+        node->right = rsubtree;
+        parent->right = node;
+        root = lsubtree;
+    } else if (Balance::taller(rsubtree, lsubtree)) {
+        spine = rsubtree;
+        while (Balance::taller(spine, lsubtree)) {
+            parent = spine;
+            spine = spine->left;
+        }
+        node->left = lsubtree;
+        node->right = spine;
+        parent->left = node;
+        root = rsubtree;
     } else {
-        node->right = Erase(node->right, k);
+        node->left = lsubtree;
+        node->right = rsubtree;
+        root = node;
     }
 
+    node->prev = parent;
+    if (node->left) {
+        node->left->prev = node;
+    }
+    if (node->right) {
+        node->right->prev = node;
+    }
+    Balance::hang(node);
+    UpdateHeight(node);
+    Rebalance(parent);
 
-    return Rebalance(node);
+    return root;
 }
 
 
-template <typename Key, typename T, typename Compare, typename Allocator>
-void Avl<Key, T, Compare, Allocator>::Clear(Node<Key, T> *node) {
-    if (!node) {
-        return;
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+Node<Key, T>* Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::Join(
+                            Node<Key, T> *lsubtree, Node<Key, T> *rsubtree) {
+    if (!lsubtree || !rsubtree) {
+        return (lsubtree ? lsubtree : rsubtree);
     }
 
-    Clear(node->left);
-    Clear(node->right);
+    Node<Key, T> *rmin = MinElem(rsubtree);
+    root = rsubtree;
+    Rebalance(RemoveElem(rmin));
+    rmin->right = nullptr;
 
-    std::destroy_n(node->pair, 1);
-    alloc.deallocate(node->pair, 1);
-    delete node;
+    return Join(lsubtree, rmin, root);
 }
 
 
-template <typename Key, typename T, typename Compare, typename Allocator>
-bool Avl<Key, T, Compare, Allocator>::Contains(Node<Key, T> *node,
-                                                        const Key &k) const {
-     if (!node) {
-        return false;
-     }
+// Splits a detached tree into the keys less than k and the rest.
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+std::pair<Node<Key, T> *, Node<Key, T> *>
+        Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::Split(
+                                             Node<Key, T> *node, const Key &k) {
+    std::vector<std::pair<Node<Key, T> *, bool>> path;
+    Node<Key, T> *lsubtree = nullptr;
+    Node<Key, T> *rsubtree = nullptr;
+
+    path.reserve(64);
+    while (node) {
+        bool less = Less(node->pair->first, k);
+        path.emplace_back(node, less);
+        node = (less ? node->right : node->left);
+    }
+
+    for (auto it = path.rbegin(); it != path.rend(); ++it) {
+        node = it->first;
+        Node<Key, T> *left = node->left;
+        Node<Key, T> *right = node->right;
+        node->left = nullptr;
+        node->right = nullptr;
 
-     if (k == node->pair->first) {
-         return true;
-     } else if (cmp(k, node->pair->first)) {
-         return Contains(node->left, k);
-     } else {
-         return Contains(node->right, k);
-     }
+        if (it->second) {
+            if (left) {
+                left->prev = nullptr;
+            }
+            lsubtree = Join(left, node, lsubtree);
+        } else {
+            if (right) {
+                right->prev = nullptr;
+            }
+            rsubtree = Join(rsubtree, node, right);
+        }
+    }
 
-     return false;
+    return std::make_pair(lsubtree, rsubtree);
 }
 
 
-template <typename Key, typename T, typename Compare, typename Allocator>
-AvlIterator<Key, T, Compare>
-        Avl<Key, T, Compare, Allocator>::Find(Node<Key, T> *node,
-                                                                const Key &k) {
-    if (!node) {
-        return end();
+// Detaches the keys in [lo, hi) and returns them as a tree of their own;
+// a null bound is open. Only O(log n) nodes are touched.
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+Node<Key, T>*
+ Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::Cut(const Key *lo,
+                                                            const Key *hi) {
+    Node<Key, T> *before = nullptr;
+    Node<Key, T> *middle = root;
+    Node<Key, T> *after = nullptr;
+
+    if (lo) {
+        std::tie(before, middle) = Split(middle, *lo);
     }
+    if (hi) {
+        std::tie(middle, after) = Split(middle, *hi);
+    }
+
+    root = Join(before, after);
+    leftmost = MinElem(root);
+    rightmost = MaxElem(root);
+
+    return middle;
+}
+
 
-    if (k == node->pair->first) {
-        return AvlIterator<Key, T, Compare>(node, false, false);
-    } else if (cmp(k, node->pair->first)) {
-        return Find(node->left, k);
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+auto
+        Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::Order(
+                                    const Key &lhs, const Key &rhs) const {
+    if constexpr (ThreeWayComparator<Compare, Key>) {
+        return cmp(lhs, rhs);
     } else {
-        return Find(node->right, k);
+        return lhs <=> rhs;
     }
+}
 
-    return end();
+
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+Node<Key, T>*
+        Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::Descend(
+                        const Key &k, Node<Key, T> **parent, bool *left,
+                                                Node<Key, T> *from) const {
+    Node<Key, T> *node = (from ? from : root);
+    Node<Key, T> *last = nullptr;
+    bool side = false;
+
+    if constexpr (kCached) {
+        auto prefix = KeyCache::make(k);
+
+        while (node) {
+            auto cached = static_cast<const NodeType *>(node)->cached;
+            if (prefix != cached) {
+                side = (prefix < cached);
+            } else {
+                auto order = Order(k, node->pair->first);
+                if (order == 0) {
+                    break;
+                }
+                side = (order < 0);
+            }
+            last = node;
+            node = (side ? node->left : node->right);
+        }
+    } else if constexpr (ThreeWayOrdered<Compare, Key>) {
+        while (node) {
+            auto order = Order(k, node->pair->first);
+            if (order == 0) {
+                break;
+            }
+            last = node;
+            side = (order < 0);
+            node = (side ? node->left : node->right);
+        }
+    } else {
+        Node<Key, T> *candidate = nullptr;
+
+        while (node) {
+            last = node;
+            side = cmp(k, node->pair->first);
+            candidate = (side ? candidate : node);
+            node = (side ? node->left : node->right);
+        }
+
+        if (candidate && !cmp(candidate->pair->first, k)) {
+            node = candidate;
+        }
+    }
+
+    *parent = last;
+    *left = side;
+
+    return node;
 }
 
 
-template <typename Key, typename T, typename Compare, typename Allocator>
-Avl<Key, T, Compare, Allocator>::Avl() {
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::Avl() {
     root = nullptr;
+    leftmost = nullptr;
+    rightmost = nullptr;
+}
+
+
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+        Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::Avl(
+                                                           const Allocator &a) :
+                                                                    alloc(a) {
+    root = nullptr;
+    leftmost = nullptr;
+    rightmost = nullptr;
+}
+
+
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+        Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::Avl(
+                                                         Avl &&other) noexcept :
+                root(other.root), leftmost(other.leftmost),
+                rightmost(other.rightmost), cmp(std::move(other.cmp)),
+                alloc(std::move(other.alloc)), total(other.total),
+                heap(other.heap), turns(other.turns),
+                graveyard(other.graveyard), buried(other.buried),
+                log(std::move(other.log)), filter(std::move(other.filter)) {
+    other.root = nullptr;
+    other.leftmost = nullptr;
+    other.rightmost = nullptr;
+    other.total = 0;
+    other.heap = 0;
+    other.turns = 0;
+    other.graveyard = nullptr;
+    other.buried = 0;
+    if (other.tracked) {
+        MemoryRegistry::instance().transfer(&other, this);
+        tracked = true;
+        other.tracked = false;
+    }
 }
 
 
-template <typename Key, typename T, typename Compare, typename Allocator>
-Avl<Key, T, Compare, Allocator>::Avl(const Key &k, T &&val) {
-    root = new Node<Key, T>();
-    root->pair = alloc.allocate(1);
-    new(root->pair)std::pair<const Key, T>(k, val);
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>&
+        Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::operator=(
+                                                        Avl &&other) noexcept {
+    if (this != &other) {
+        // Old and pending nodes go back to the allocator about to be
+        // swapped out, without the logging and accounting of clear(), which
+        // could allocate.
+        Reclaim(root, alloc, std::numeric_limits<size_t>::max());
+        Reclaim(graveyard, alloc, std::numeric_limits<size_t>::max());
+        root = std::exchange(other.root, nullptr);
+        leftmost = std::exchange(other.leftmost, nullptr);
+        rightmost = std::exchange(other.rightmost, nullptr);
+        std::swap(cmp, other.cmp);
+        std::swap(alloc, other.alloc);
+        total = std::exchange(other.total, 0);
+        heap = std::exchange(other.heap, 0);
+        turns = std::exchange(other.turns, 0);
+        graveyard = std::exchange(other.graveyard, nullptr);
+        buried = std::exchange(other.buried, 0);
+        log = std::move(other.log);
+        filter = std::move(other.filter);
+        if (other.tracked) {
+            MemoryRegistry::instance().transfer(&other, this);
+            tracked = true;
+            other.tracked = false;
+        }
+    }
+
+    return *this;
 }
 
 
-template <typename Key, typename T, typename Compare, typename Allocator>
-Avl<Key, T, Compare, Allocator>::Avl(
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>&
+        Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::operator=(
+                                                        const Avl &other) {
+    if (this != &other) {
+        *this = Avl(other);
+    }
+
+    return *this;
+}
+
+
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+        Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::Avl(
+                                                        const Key &k, T &&val) {
+    root = CreateNode(k, val);
+    leftmost = root;
+    rightmost = root;
+}
+
+
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::Avl(
                         std::initializer_list<std::pair<const Key, T>> init) {
     auto it = init.begin();
 
-    root = new Node<Key, T>();
-    root->pair = alloc.allocate(1);
-    new(root->pair)std::pair<const Key, T>((*it).first, (*it).second);
+    root = CreateNode((*it).first, (*it).second);
+    leftmost = root;
+    rightmost = root;
     it++;
 
     while (it != init.end()) {
@@ -396,65 +1162,129 @@ Avl<Key, T, Compare, Allocator>::Avl(
 }
 
 
-template <typename Key, typename T, typename Compare, typename Allocator>
-std::pair<AvlIterator<Key, T, Compare>, bool> Avl<Key, T, Compare,
-                    Allocator>::insert(const std::pair<const Key, T> &pair) {
-    Node<Key, T> *temp = new Node<Key, T>();
-    Node<Key, T> *subtree = root;
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+std::pair<AvlIterator<Key, T, Compare>, bool>
+        Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::insert(
+                                        const std::pair<const Key, T> &pair) {
+    return Insert(pair, nullptr);
+}
 
-    temp->pair = alloc.allocate(1);
-    new(temp->pair)std::pair<const Key, T>(pair.first, pair.second);
 
-    if (!subtree) {
-        root = temp;
-        return std::make_pair(AvlIterator<Key, T, Compare>(root, true, true),
-                                                                         true);
+// Inserts pair searching from the subtree at from, or from the root when it
+// is null.
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+std::pair<AvlIterator<Key, T, Compare>, bool>
+        Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::Insert(
+                const std::pair<const Key, T> &pair, Node<Key, T> *from) {
+    Node<Key, T> *parent;
+    bool left;
+    Node<Key, T> *found = Descend(pair.first, &parent, &left, from);
+
+    if (found) {
+        return std::make_pair(AvlIterator<Key, T, Compare>(found), false);
     }
-    while (true) {
-        if (subtree->pair->first == temp->pair->first) {
-            std::destroy_n(temp->pair, 1);
-            alloc.deallocate(temp->pair, 1);
-            delete temp;
-            return std::make_pair(AvlIterator<Key, T, Compare>(subtree),
-                                                                        false);
-        } else if (cmp(subtree->pair->first, temp->pair->first)) {
-            if (subtree->right) {
-                subtree = subtree->right;
-            } else {
-                subtree->right = temp;
-                subtree->right->prev = subtree;
-                Rebalance(subtree);
-                return std::make_pair(AvlIterator<Key, T, Compare>(temp),
-                                                                         true);
-            }
-        } else {
-            if (subtree->left) {
-                subtree = subtree->left;
-            } else {
-                subtree->left = temp;
-                subtree->left->prev = subtree;
-                Rebalance(subtree);
-                return std::make_pair(AvlIterator<Key, T, Compare>(temp),
-                                                                         true);
-            }
-        }
+
+    Record(pair.first, false, nullptr);
+    Node<Key, T> *temp = CreateNode(pair.first, pair.second);
+    Link(temp, parent, left);
+
+    return std::make_pair(AvlIterator<Key, T, Compare>(temp), true);
+}
+
+
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+std::pair<AvlIterator<Key, T, Compare>, bool>
+  Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::insert_or_assign(
+                                        const std::pair<const Key, T> &pair) {
+    auto result = insert(pair);
+
+    if (!result.second) {
+        Record(pair.first, true, &(*result.first).second);
+        (*result.first).second = pair.second;
+        refresh(result.first);
+    }
+
+    return result;
+}
+
+
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::insert_return_type
+        Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::insert(
+                                                           node_type &&handle) {
+    if (handle.empty()) {
+        return insert_return_type{end(), false, node_type()};
+    }
+
+    Node<Key, T> *parent;
+    bool left;
+    Node<Key, T> *found = Descend(handle.key(), &parent, &left);
+
+    if (found) {
+        return insert_return_type{AvlIterator<Key, T, Compare>(found), false,
+                                                        std::move(handle)};
+    }
+
+    Record(handle.key(), false, nullptr);
+    Node<Key, T> *node = handle.release();
+    Account(node, true);
+    Link(node, parent, left);
+
+    return insert_return_type{AvlIterator<Key, T, Compare>(node), true,
+                                                                node_type()};
+}
+
+
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::node_type
+        Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::extract(
+                                                                 const Key &k) {
+    return extract(find(k));
+}
+
+
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::node_type
+        Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::extract(
+                                                                 iterator pos) {
+    if (pos == end() || !pos.p) {
+        return node_type();
     }
+
+    Record(pos.p->pair->first, true, &pos.p->pair->second);
+    Unlink(pos.p);
+    Account(pos.p, false);
+
+    return node_type(pos.p, alloc);
 }
 
 
-template <typename Key, typename T, typename Compare, typename Allocator>
-size_t Avl<Key, T, Compare, Allocator>::erase(const Key &k) {
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+size_t
+        Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::erase(
+                                                                 const Key &k) {
     auto it = find(k);
-    if (it != this->end()) {
-        root = Erase(root, k);
+    if (it == this->end()) {
+        return 0;
     }
+    Erase(it.p);
 
     return 1;
 }
 
 
-template <typename Key, typename T, typename Compare, typename Allocator>
-auto Avl<Key, T, Compare, Allocator>::erase(auto pos) -> decltype(pos) {
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+auto
+    Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::erase(auto pos)
+                                                        -> decltype(pos) {
     if (find((*pos).first) != this->end()) {
         auto it = pos + 1;
         erase((*pos).first);
@@ -466,142 +1296,743 @@ auto Avl<Key, T, Compare, Allocator>::erase(auto pos) -> decltype(pos) {
 }
 
 
-template <typename Key, typename T, typename Compare, typename Allocator>
-void Avl<Key, T, Compare, Allocator>::UpdateHeight(Node<Key, T> *node) {
-    if (node->left) {
-        UpdateHeight(node->left);
-    }
-    if (node->right) {
-        UpdateHeight(node->right);
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+AvlIterator<Key, T, Compare>
+             Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::erase(
+                        iterator first, iterator last, Teardown teardown) {
+    if (first == last || first == end()) {
+        return last;
     }
 
-    int leftHeight = GetHeight(node->left);
-    int rightHeight = GetHeight(node->right);
+    bool tail = (last == end());
+    Node<Key, T> *middle = Cut(&first.p->pair->first,
+                                    tail ? nullptr : &last.p->pair->first);
+    Record(middle);
+    Discard(middle, teardown);
 
-    node->height = (leftHeight > rightHeight ? leftHeight : rightHeight) + 1;
+    return (tail ? end() : last);
 }
 
 
-template <typename Key, typename T, typename Compare, typename Allocator>
-int Avl<Key, T, Compare, Allocator>::GetHeight(const Node<Key, T> *node) const {
-    return (node ? node->height : 0);
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+size_t
+       Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::erase_range(
+                        const Key &lo, const Key &hi, Teardown teardown) {
+    Node<Key, T> *middle = Cut(&lo, &hi);
+    size_t before = total;
+
+    Record(middle);
+    Discard(middle, teardown);
+
+    return before - total;
 }
 
 
-template <typename Key, typename T, typename Compare, typename Allocator>
-Avl<Key, T, Compare, Allocator>::~Avl() {}
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>
+     Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::extract_range(
+                                            const Key &lo, const Key &hi) {
+    Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance> range;
+
+    range.cmp = cmp;
+    range.alloc = alloc;
+    range.root = Cut(&lo, &hi);
+    Record(range.root);
+    range.leftmost = MinElem(range.root);
+    range.rightmost = MaxElem(range.root);
+    for (auto it = range.begin(); it != range.end(); ++it) {
+        Account(it.p, false);
+        range.Account(it.p, true);
+    }
+
+    return range;
+}
 
 
-template <typename Key, typename T, typename Compare, typename Allocator>
-void Avl<Key, T, Compare, Allocator>::printNode(std::ostream &out,
-                                const Node<Key, T> *node, int offset) const {
-    if (!node) {
-        return;
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+void Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::UpdateHeight(
+                                                        Node<Key, T> *node) {
+    Balance::update(node);
+    if constexpr (kAugmented) {
+        static_cast<NodeType *>(node)->aggregate = Augment::combine(
+                Aggregate(node->left), Augment::combine(
+                Augment::lift(node->pair->first, node->pair->second),
+                Aggregate(node->right)));
     }
+}
+
+
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+auto Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::Aggregate(
+                                                    const Node<Key, T> *node) {
+    return (node ? static_cast<const NodeType *>(node)->aggregate :
+                                                        Augment::identity());
+}
+
 
-    for (int i = 0; i < offset; ++i) {
-        out << "\t";
+// Entries under node: exact when counted, else the policy's estimate.
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+double Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::Weight(
+                                                    const Node<Key, T> *node) {
+    if constexpr (std::is_same_v<Augment, CountAugment>) {
+        return double(Aggregate(node));
+    } else {
+        return Balance::weight(node);
     }
-    out << format("{0} : {1}\n", node->pair->first, node->pair->second);
-    if (node->right) {
-        printNode(out, node->right, offset + 1);
+}
+
+
+
+// Copies on the calling thread; clone() is the way to copy in parallel.
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+        Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::Avl(
+                                                             const Avl &other) :
+                                                    Avl(other.clone(1)) {}
+
+
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::~Avl() {
+    if (tracked) {
+        MemoryRegistry::instance().remove(this);
     }
-    if (node->left) {
-        printNode(out, node->left, offset + 1);
+    log.reset();
+    clear();
+    Reclaim(graveyard, alloc, std::numeric_limits<size_t>::max());
+}
+
+
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+void
+        Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::printNode(
+                std::ostream &out, const Node<Key, T> *node, int offset) const {
+    const Node<Key, T> *top = node;
+
+    while (node) {
+        for (int i = 0; i < offset; ++i) {
+            out << "\t";
+        }
+        out << format("{0} : {1}\n", node->pair->first, node->pair->second);
+
+        if (node->right || node->left) {
+            node = (node->right ? node->right : node->left);
+            ++offset;
+            continue;
+        }
+
+        while (node != top) {
+            const Node<Key, T> *parent = node->prev;
+            if (parent->right == node && parent->left) {
+                node = parent->left;
+                break;
+            }
+            node = parent;
+            --offset;
+        }
+        if (node == top) {
+            return;
+        }
     }
 }
 
 
-template <typename Key, typename T, typename Compare, typename Allocator>
-int Avl<Key, T, Compare, Allocator>::HeightDiff(const Node<Key, T> *node)
-                                                                    const {
-    return GetHeight(node->right) - GetHeight(node->left);
+
+// Copies the tree shape node for node in O(n). Trees of kParallelCloneSize
+// entries or more are split between up to threads workers, provided the
+// allocator is a ConcurrentAllocator; otherwise the copy is serial.
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>
+        Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::clone(
+                                                    unsigned threads) const {
+    Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance> copy;
+
+    copy.cmp = cmp;
+    copy.alloc = std::allocator_traits<Allocator>::
+                                select_on_container_copy_construction(alloc);
+    if (!root) {
+        return copy;
+    }
+
+    unsigned depth = 0;
+    if (ConcurrentAllocator<Allocator>::value && total >= kParallelCloneSize) {
+        while (depth < 8 && (2u << depth) <= threads) {
+            ++depth;
+        }
+    }
+
+    copy.root = copy.Clone(root, depth);
+    copy.leftmost = copy.MinElem(copy.root);
+    copy.rightmost = copy.MaxElem(copy.root);
+    copy.total = total;
+    copy.heap = heap;
+    if (filter) {
+        copy.filter = std::make_unique<CountingBloomFilter<Key>>(*filter);
+    }
+
+    return copy;
 }
 
 
-template <typename Key, typename T, typename Compare, typename Allocator>
-bool Avl<Key, T, Compare, Allocator>::empty() const {
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+bool
+    Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::empty() const {
     return (root ? false : true);
 }
 
 
-template <typename Key, typename T, typename Compare, typename Allocator>
-size_t Avl<Key, T, Compare, Allocator>::size() const {
-    return Count(root);
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+size_t
+     Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::size() const {
+    return total;
 }
 
 
-template <typename Key, typename T, typename Compare, typename Allocator>
-size_t Avl<Key, T, Compare, Allocator>::Count(const Node<Key, T> *node) const {
-    if (!node) {
-        return 0;
+// O(1): the counts behind it are kept up to date as nodes come and go. The
+// deep part is measured when an entry enters the tree and by refresh().
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+MemoryUsage
+     Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::memory_usage()
+                                                                        const {
+    typedef std::pair<const Key, T> Pair;
+    MemoryUsage usage;
+
+    usage.nodes = total * sizeof(NodeType);
+    usage.pairs = total * sizeof(Pair);
+    usage.slack = total * (AllocationSize<NodeAllocator>::of(sizeof(NodeType))
+                            - sizeof(NodeType) +
+                            AllocationSize<Allocator>::of(sizeof(Pair)) -
+                                                                sizeof(Pair));
+    usage.deep = heap;
+    if (filter) {
+        usage.filters = filter->memory_usage();
     }
 
-    return Count(node->left) + Count(node->right) + 1;
+    return usage;
+}
+
+
+// Lists the tree in MemoryRegistry under name until it is destroyed.
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+void Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::track(
+                                                    const std::string &name) {
+    MemoryRegistry::instance().add(this, name, [](const void *owner) {
+        return static_cast<const Avl *>(owner)->memory_usage();
+    });
+    tracked = true;
+}
+
+
+// Starts recording mutations, with a checkpoint at the current contents.
+// Values changed through iterators or front()/back() are only seen once
+// refresh() is called on them.
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+void
+        Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::
+                                                        enable_change_log() {
+    log = std::make_unique<std::map<Key, Logged, LogOrder>>(LogOrder{cmp});
 }
 
 
-template <typename Key, typename T, typename Compare, typename Allocator>
-void Avl<Key, T, Compare, Allocator>::clear() {
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+void
+        Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::
+                                                        disable_change_log() {
+    log.reset();
+}
+
+
+// Forgets everything recorded so far; changes() starts again from here.
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+void Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::checkpoint() {
+    if (log) {
+        log->clear();
+    }
+}
+
+
+// Puts a counting Bloom filter in front of find() and contains(), so most
+// lookups of absent keys end after one cache line instead of a descent. The
+// filter follows every insertion and erasure and is rebuilt twice as large
+// when the tree outgrows options.capacity.
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+void Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::enable_filter(
+                                            const FilterOptions &options)
+                                    requires HashFilterable<Compare, Key> {
+    FilterOptions sized = options;
+    sized.capacity = std::max(options.capacity, total);
+    Refilter(sized);
+}
+
+
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+void
+ Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::disable_filter() {
+    filter.reset();
+}
+
+
+// Returns a cursor standing on the first entry.
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::cursor_type
+        Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::cursor() {
+    return cursor_type(this, leftmost);
+}
+
+
+// Rotations done by this tree so far, to compare balancing policies.
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+size_t Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::rotations()
+                                                                        const {
+    return turns;
+}
+
+
+// Splits the entries into at most k consecutive ranges of about equal size,
+// in key order, for separate threads to walk. Subtrees heavier than a
+// quarter of a range are cut into left, node and right, level by level,
+// which visits O(k log n) nodes; the pieces are then dealt out by weight.
+// Weights are exact under WeightBalance or CountAugment and estimated from
+// the ranks otherwise, so ranges can be off by a small factor.
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+std::vector<std::pair<AvlIterator<Key, T, Compare>,
+                                            AvlIterator<Key, T, Compare>>>
+        Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::partition(
+                                                                    size_t k) {
+    struct Piece {
+        Node<Key, T> *node;
+        bool whole;
+        double weight;
+    };
+    std::vector<std::pair<iterator, iterator>> ranges;
+
+    if (!root) {
+        return ranges;
+    }
+
+    k = std::max<size_t>(k, 1);
+    double limit = Weight(root) / (4 * k);
+    std::vector<Piece> pieces{{root, true, Weight(root)}};
+    bool cut = true;
+
+    while (cut) {
+        std::vector<Piece> next;
+        cut = false;
+        for (const Piece &piece : pieces) {
+            if (!piece.whole || piece.weight <= limit) {
+                next.push_back(piece);
+                continue;
+            }
+            if (piece.node->left) {
+                next.push_back({piece.node->left, true,
+                                                Weight(piece.node->left)});
+            }
+            next.push_back({piece.node, false, 1});
+            if (piece.node->right) {
+                next.push_back({piece.node->right, true,
+                                                Weight(piece.node->right)});
+            }
+            cut = true;
+        }
+        pieces.swap(next);
+    }
+
+    double sum = 0;
+    for (const Piece &piece : pieces) {
+        sum += piece.weight;
+    }
+
+    double done = 0;
+    Node<Key, T> *first = leftmost;
+    for (const Piece &piece : pieces) {
+        Node<Key, T> *start = (piece.whole ? MinElem(piece.node) :
+                                                                piece.node);
+        if (start != first && done >= sum * (ranges.size() + 1) / k) {
+            ranges.emplace_back(iterator(first), iterator(start));
+            first = start;
+        }
+        done += piece.weight;
+    }
+    ranges.emplace_back(iterator(first), end());
+
+    return ranges;
+}
+
+
+// Returns the net effect of the mutations since the last checkpoint, in
+// key order: a key inserted and erased again is left out, and a modified
+// entry whose old value was not known has no before.
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+std::vector<AvlChange<Key, T>>
+        Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::changes()
+                                                                        const {
+    std::vector<AvlChange<Key, T>> result;
+
+    if (!log) {
+        return result;
+    }
+
+    for (const auto &[k, logged] : *log) {
+        auto it = find(k);
+        if (it == end()) {
+            if (logged.existed) {
+                result.push_back({ChangeKind::erased, k, logged.before,
+                                                            std::nullopt});
+            }
+        } else if (!logged.existed) {
+            result.push_back({ChangeKind::inserted, k, std::nullopt,
+                                                            (*it).second});
+        } else if (!logged.before || !(*logged.before == (*it).second)) {
+            result.push_back({ChangeKind::modified, k, logged.before,
+                                                            (*it).second});
+        }
+    }
+
+    return result;
+}
+
+
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+void Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::clear() {
+    auto kept = std::move(filter);
+    Record(root);
     Clear(root);
+    filter = std::move(kept);
+    if (filter) {
+        filter->reset();
+    }
+    root = nullptr;
+    leftmost = nullptr;
+    rightmost = nullptr;
+}
+
+
+// Empties the tree like clear() but keeps the nodes, and returns them.
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+Node<Key, T>*
+         Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::Detach() {
+    Node<Key, T> *node = root;
+
+    Record(root);
+    if (filter) {
+        filter->reset();
+    }
     root = nullptr;
+    leftmost = nullptr;
+    rightmost = nullptr;
+    total = 0;
+    heap = 0;
+
+    return node;
 }
 
 
-template <typename Key, typename T, typename Compare, typename Allocator>
-bool Avl<Key, T, Compare, Allocator>::contains(const Key &k) const {
-    return Contains(root, k);
+// Empties the tree in O(1) and leaves freeing the entries to the
+// Reclaimer thread. The job carries a copy of the allocator, which must
+// allow deallocation from another thread, and it may run after the tree is
+// gone. An allocator or comparator whose state lives outside it, and is
+// reached by the deallocation or by the entries' destructors, must keep
+// that state alive until the job has run. ArenaAllocator shares ownership
+// of its Arena and never frees, so it needs nothing more.
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+void
+    Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::clear_async() {
+    Node<Key, T> *node = Detach();
+
+    if (node) {
+        Reclaimer::instance().post([node, pairs = alloc]() mutable {
+            Reclaim(node, pairs, std::numeric_limits<size_t>::max());
+        });
+    }
 }
 
 
-template <typename Key, typename T, typename Compare, typename Allocator>
-AvlIterator<Key, T, Compare> Avl<Key, T, Compare, Allocator>::find(
+// Frees at most budget entries of an earlier clear_step() and returns how
+// many are left. When none are, the tree is emptied first in O(1), so a
+// caller loops until 0 comes back, serving requests in between; entries
+// inserted meanwhile are kept. Whatever is left goes with the destructor.
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+size_t
+      Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::clear_step(
+                                                              size_t budget) {
+    if (!graveyard) {
+        buried = total;
+        graveyard = Detach();
+    }
+    buried -= Reclaim(graveyard, alloc, budget);
+
+    return buried;
+}
+
+
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+bool
+        Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::contains(
+                                                           const Key &k) const {
+    Node<Key, T> *parent;
+    bool left;
+
+    return !Excluded(k) && Descend(k, &parent, &left) != nullptr;
+}
+
+
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+AvlIterator<Key, T, Compare>
+              Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::find(
                                                                 const Key &k) {
-    return Find(root, k);
+    if (Excluded(k)) {
+        return end();
+    }
+
+    Node<Key, T> *parent;
+    bool left;
+    Node<Key, T> *node = Descend(k, &parent, &left);
+
+    return (node ? AvlIterator<Key, T, Compare>(node) : end());
 }
 
 
-template <typename Key, typename T, typename Compare, typename Allocator>
-T& Avl<Key, T, Compare, Allocator>::at(const Key &k) {
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::c_iterator
+        Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::find(
+                                                           const Key &k) const {
+    if (Excluded(k)) {
+        return end();
+    }
+
+    Node<Key, T> *parent;
+    bool left;
+    Node<Key, T> *node = Descend(k, &parent, &left);
+
+    return (node ? c_iterator(node) : end());
+}
+
+
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+T&
+ Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::at(const Key &k) {
     auto it = find(k);
 
     if (it == end()) {
         throw std::out_of_range("Avl::at");
     }
+    Record(k, true, &(*it).second);
 
     return ((*it).second);
 }
 
 
-template <typename Key, typename T, typename Compare, typename Allocator>
-T& Avl<Key, T, Compare, Allocator>::operator[](const Key &k) {
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+T&
+        Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::operator[](
+                                                                 const Key &k) {
     auto it = find(k);
 
     if (it == end()) {
         auto pair = insert(std::make_pair(k, T()));
         return (*pair.first).second;
     }
+    Record(k, true, &(*it).second);
 
     return (*it).second;
 }
 
 
-template <typename Key, typename T, typename Compare, typename Allocator>
-T& Avl<Key, T, Compare, Allocator>::operator[](const Key &&k) {
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+T&
+        Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::operator[](
+                                                                const Key &&k) {
     auto it = find(k);
 
     if (it == end()) {
         auto pair = insert(std::make_pair(k, T()));
         return (*pair.first).second;
     }
+    Record(k, true, &(*it).second);
 
     return (*it).second;
 }
 
 
-template <typename Key, typename T, typename Compare, typename Allocator>
-bool operator==(const Avl<Key, T, Compare, Allocator> &lhs,
-                const Avl<Key, T, Compare, Allocator> &rhs) {
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+std::pair<const Key, T>&
+          Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::front() {
+    if (!leftmost) {
+        throw std::out_of_range("Avl::front");
+    }
+
+    return *(leftmost->pair);
+}
+
+
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+std::pair<const Key, T>&
+           Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::back() {
+    if (!rightmost) {
+        throw std::out_of_range("Avl::back");
+    }
+
+    return *(rightmost->pair);
+}
+
+
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+std::pair<Key, T>
+        Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::pop_min() {
+    if (!leftmost) {
+        throw std::out_of_range("Avl::pop_min");
+    }
+
+    Record(leftmost->pair->first, true, &leftmost->pair->second);
+    std::pair<Key, T> pair(leftmost->pair->first,
+                                        std::move(leftmost->pair->second));
+    Erase(leftmost);
+
+    return pair;
+}
+
+
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+std::pair<Key, T>
+        Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::pop_max() {
+    if (!rightmost) {
+        throw std::out_of_range("Avl::pop_max");
+    }
+
+    Record(rightmost->pair->first, true, &rightmost->pair->second);
+    std::pair<Key, T> pair(rightmost->pair->first,
+                                        std::move(rightmost->pair->second));
+    Erase(rightmost);
+
+    return pair;
+}
+
+
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+auto
+   Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::reduce() const {
+    return Aggregate(root);
+}
+
+
+// Folds the elements with keys in [lo, hi) in O(log n): below the node where
+// the paths to lo and hi part, every subtree hanging inside the range
+// contributes its stored aggregate as a whole.
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+auto
+        Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::reduce(
+                                    const Key &lo, const Key &hi) const {
+    Node<Key, T> *split = root;
+
+    while (split) {
+        if (Less(split->pair->first, lo)) {
+            split = split->right;
+        } else if (!Less(split->pair->first, hi)) {
+            split = split->left;
+        } else {
+            break;
+        }
+    }
+    if (!split) {
+        return Augment::identity();
+    }
+
+    auto left = Augment::identity();
+    for (Node<Key, T> *node = split->left; node;) {
+        if (Less(node->pair->first, lo)) {
+            node = node->right;
+        } else {
+            left = Augment::combine(Augment::combine(
+                    Augment::lift(node->pair->first, node->pair->second),
+                    Aggregate(node->right)), left);
+            node = node->left;
+        }
+    }
+
+    auto right = Augment::identity();
+    for (Node<Key, T> *node = split->right; node;) {
+        if (Less(node->pair->first, hi)) {
+            right = Augment::combine(right, Augment::combine(
+                    Aggregate(node->left),
+                    Augment::lift(node->pair->first, node->pair->second)));
+            node = node->right;
+        } else {
+            node = node->left;
+        }
+    }
+
+    return Augment::combine(left, Augment::combine(
+            Augment::lift(split->pair->first, split->pair->second), right));
+}
+
+
+// Recomputes the aggregates above pos and its measured deep size after its
+// mapped value was changed through a reference, and logs the change.
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+void
+        Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::refresh(
+                                                                 iterator pos) {
+    if (pos == end() || !pos.p) {
+        return;
+    }
+
+    for (Node<Key, T> *node = pos.p; node; node = node->prev) {
+        UpdateHeight(node);
+    }
+    if constexpr (kDeep) {
+        auto sized = static_cast<NodeType *>(pos.p);
+        heap -= sized->deep;
+        sized->deep = DeepSize<Key>::of(pos.p->pair->first) +
+                                        DeepSize<T>::of(pos.p->pair->second);
+        heap += sized->deep;
+    }
+    Record(pos.p->pair->first, true, nullptr);
+}
+
+
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+bool operator==(
+       const Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance> &lhs,
+       const Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance> &rhs) {
     if (lhs.size() == rhs.size()) {
             auto it1 = lhs.begin();
             auto it2 = rhs.begin();
@@ -621,9 +2052,74 @@ bool operator==(const Avl<Key, T, Compare, Allocator> &lhs,
 }
 
 
-template <typename Key, typename T, typename Compare, typename Allocator>
+// Lists what turns before into after, in key order, with one merge walk
+// over both trees: O(n + m) comparisons.
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+std::vector<AvlChange<Key, T>> diff(
+    const Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance> &before,
+     const Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance> &after) {
+    std::vector<AvlChange<Key, T>> result;
+    auto it = before.begin();
+    auto jt = after.begin();
+
+    while (it != before.end() || jt != after.end()) {
+        if (jt == after.end() || (it != before.end() &&
+                                    before.Less((*it).first, (*jt).first))) {
+            result.push_back({ChangeKind::erased, (*it).first, (*it).second,
+                                                            std::nullopt});
+            ++it;
+        } else if (it == before.end() ||
+                                    before.Less((*jt).first, (*it).first)) {
+            result.push_back({ChangeKind::inserted, (*jt).first, std::nullopt,
+                                                            (*jt).second});
+            ++jt;
+        } else {
+            if (!((*it).second == (*jt).second)) {
+                result.push_back({ChangeKind::modified, (*it).first,
+                                                (*it).second, (*jt).second});
+            }
+            ++it;
+            ++jt;
+        }
+    }
+
+    return result;
+}
+
+
+// Calls f on every pair of the tree from up to threads threads, one range of
+// partition() each, and waits for all of them. f must be safe to run
+// concurrently and must not add or remove entries.
+template <typename Key, typename T, typename Compare, typename Allocator,
+          typename Augment, typename KeyCache, typename Balance, typename F>
+void parallel_for_each(
+            Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance> &tree,
+            F &&f, unsigned threads = std::thread::hardware_concurrency()) {
+    auto ranges = tree.partition(std::max(threads, 1u));
+    std::vector<std::future<void>> workers;
+
+    auto walk = [&f](auto range) {
+        for (auto it = range.first; it != range.second; ++it) {
+            f(*it);
+        }
+    };
+    for (size_t i = 1; i < ranges.size(); ++i) {
+        workers.push_back(std::async(std::launch::async, walk, ranges[i]));
+    }
+    if (!ranges.empty()) {
+        walk(ranges[0]);
+    }
+    for (auto &worker : workers) {
+        worker.get();
+    }
+}
+
+
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
 std::ostream& operator<<(std::ostream &out,
-                                const Avl<Key, T, Compare, Allocator> &avl) {
+       const Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance> &avl) {
     avl.printNode(out, avl.root, 0);
 
     return out;
@@ -0,0 +1,180 @@
+// Copyright (c) 2024 PlatinumSamurai. All rights reserved.
+
+#ifndef AVLMAP_AVLMAP_AVL_CURSOR_HPP_
+#define AVLMAP_AVLMAP_AVL_CURSOR_HPP_
+
+#include <utility>
+#include "node.hpp"
+#include "avl_iterator.hpp"
+
+
+// Remembered position in an Avl for finger search. Moving it to a key
+// climbs the prev links only until the subtree around the position spans
+// the key, then descends from there, so a run of nearby keys costs about the
+// log of their distance instead of a full descent each. A sweep over sorted
+// keys touches each node a constant number of times on average, which keeps
+// merge joins and sorted batches near linear. A key just across a high
+// ancestor can still climb that far, and since each seek starts where the
+// last one ended, seeks cannot overlap their cache misses the way separate
+// find() calls do: with cheap keys and sparse batches find() can win. The
+// cursor is invalidated like an iterator, by erasing the entry it stands on
+// other than through its own erase().
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+class AvlCursor {
+ private:
+    template <typename, typename, typename, typename, typename, typename,
+                                                                       typename>
+    friend class Avl;
+
+    typedef Avl<Key, T, Compare, Allocator, Augment, KeyCache, Balance> Tree;
+
+    Tree *tree;
+    Node<Key, T> *node;     // null once past the last entry
+
+    AvlCursor(Tree *, Node<Key, T> *);
+
+    Node<Key, T>* Climb(const Key &) const;
+
+ public:
+    bool seek(const Key &);
+    std::pair<AvlIterator<Key, T, Compare>, bool>
+                                    insert(const std::pair<const Key, T> &);
+    std::pair<AvlIterator<Key, T, Compare>, bool>
+                        insert_or_assign(const std::pair<const Key, T> &);
+    void erase();
+    AvlIterator<Key, T, Compare> position() const;
+};
+
+
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+   AvlCursor<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::AvlCursor(
+                Tree *t, Node<Key, T> *n) : tree(t), node(n) {}
+
+
+// Returns the lowest ancestor of the position whose subtree spans k. Going
+// right, only a left child bounds k from above; going left, only a right
+// child bounds it from below.
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+Node<Key, T>*
+       AvlCursor<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::Climb(
+                                                        const Key &k) const {
+    Node<Key, T> *from = (node ? node : tree->rightmost);
+
+    if (!from) {
+        return nullptr;
+    }
+
+    bool right = tree->Less(from->pair->first, k);
+    if (!right && !tree->Less(k, from->pair->first)) {
+        return from;
+    }
+
+    while (from->prev) {
+        Node<Key, T> *parent = from->prev;
+        if (right ? (parent->left == from &&
+                                    tree->Less(k, parent->pair->first)) :
+                    (parent->right == from &&
+                                    tree->Less(parent->pair->first, k))) {
+            break;
+        }
+        from = parent;
+    }
+
+    return from;
+}
+
+
+// Moves to the first entry not less than k. Returns whether its key is k.
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+bool AvlCursor<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::seek(
+                                                                const Key &k) {
+    Node<Key, T> *parent;
+    bool left;
+    Node<Key, T> *found = tree->Descend(k, &parent, &left, Climb(k));
+
+    if (found) {
+        node = found;
+        return true;
+    }
+
+    if (parent && !left) {
+        while (parent->prev && parent->prev->right == parent) {
+            parent = parent->prev;
+        }
+        parent = parent->prev;
+    }
+    node = parent;
+
+    return false;
+}
+
+
+// Inserts like Avl::insert, searching from the position, and moves to the
+// entry with the pair's key.
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+std::pair<AvlIterator<Key, T, Compare>, bool>
+      AvlCursor<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::insert(
+                                        const std::pair<const Key, T> &pair) {
+    auto result = tree->Insert(pair, Climb(pair.first));
+    node = result.first.p;
+
+    return result;
+}
+
+
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+std::pair<AvlIterator<Key, T, Compare>, bool>
+        AvlCursor<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::
+                insert_or_assign(const std::pair<const Key, T> &pair) {
+    auto result = insert(pair);
+
+    if (!result.second) {
+        tree->Record(pair.first, true, &node->pair->second);
+        node->pair->second = pair.second;
+        tree->refresh(result.first);
+    }
+
+    return result;
+}
+
+
+// Erases the entry the cursor stands on and moves to the next one.
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+void
+   AvlCursor<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::erase() {
+    if (!node) {
+        return;
+    }
+
+    Node<Key, T> *next = node->right;
+    if (next) {
+        next = tree->MinElem(next);
+    } else {
+        next = node;
+        while (next->prev && next->prev->right == next) {
+            next = next->prev;
+        }
+        next = next->prev;
+    }
+
+    tree->Erase(node);
+    node = next;
+}
+
+
+template <typename Key, typename T, typename Compare, typename Allocator,
+                      typename Augment, typename KeyCache, typename Balance>
+AvlIterator<Key, T, Compare>
+   AvlCursor<Key, T, Compare, Allocator, Augment, KeyCache, Balance>::position()
+                                                                        const {
+    return (node ? AvlIterator<Key, T, Compare>(node) : tree->end());
+}
+
+#endif  // AVLMAP_AVLMAP_AVL_CURSOR_HPP_
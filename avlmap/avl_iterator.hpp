@@ -6,12 +6,17 @@
 #include <memory>
 #include <functional>
 #include <utility>
+#include "node.hpp"
+#include "balance.hpp"
 
 
 template <typename Key,
           typename T,
           typename Compare = std::less<Key>,
-          typename Allocator = std::allocator<std::pair<const Key, T>>
+          typename Allocator = std::allocator<std::pair<const Key, T>>,
+          typename Augment = NoAugment,
+          typename KeyCache = NoKeyCache,
+          typename Balance = AvlBalance
           >
 class Avl;
 
@@ -20,9 +25,15 @@ template <typename Key, typename T, typename Compare = std::less<Key>>
 class AvlIterator : public std::iterator<std::bidirectional_iterator_tag,
                                                             Node<Key, T>> {
  private:
-     friend class Avl<Key, T, Compare>;
+     template <typename, typename, typename, typename, typename, typename,
+                                                                       typename>
+     friend class Avl;
+     template <typename, typename>
+     friend class IntervalAvl;
+     template <typename, typename, typename, typename, typename, typename,
+                                                                       typename>
+     friend class AvlCursor;
      Node<Key, T> *p;
-     Compare cmp;
      bool start;
      bool end;
      int dist = 0;
@@ -141,28 +152,30 @@ Node<Key, T>* AvlIterator<Key, T, Compare>::NextElem(Node<Key, T> *node) {
     if (start) {
         start = false;
     }
-    if (p->pair->first == node->pair->first) {
-       if (node->right) {
-           return NextElem(node->right);
-       } else if (node->prev) {
-           return NextElem(node->prev);
-       }
-    } else if (cmp(p->pair->first, node->pair->first)) {
-        if (node->left && cmp(p->pair->first, node->left->pair->first)) {
-            return NextElem(node->left);
-        } else {
-            return node;
-        }
-    } else {
-        if (node->prev) {
-            return NextElem(node->prev);
-        } else {
-            end = true;
-            return p;
+    if (end) {
+        return node;
+    }
+
+    if (node->right) {
+        node = node->right;
+        while (node->left) {
+            node = node->left;
         }
+
+        return node;
     }
 
-    return nullptr;
+    Node<Key, T> *parent = node->prev;
+    while (parent && parent->right == node) {
+        node = parent;
+        parent = parent->prev;
+    }
+    if (!parent) {
+        end = true;
+        return p;
+    }
+
+    return parent;
 }
 
 
@@ -175,28 +188,30 @@ Node<Key, T>* AvlIterator<Key, T, Compare>::PrevElem(Node<Key, T> *node) {
         end = false;
         return p;
     }
-    if (p->pair->first == node->pair->first) {
-        if (node->left) {
-            return PrevElem(node->left);
-        } else if (node->prev) {
-            return PrevElem(node->prev);
-        }
-    } else if (cmp(node->pair->first, p->pair->first)) {
-        if (node->right && cmp(node->right->pair->first, p->pair->first)) {
-            return PrevElem(node->right);
-        } else {
-            return node;
-        }
-    } else {
-        if (node->prev) {
-            return PrevElem(node->prev);
-        } else {
-            start = true;
-            return p;
+    if (!node) {
+        return nullptr;
+    }
+
+    if (node->left) {
+        node = node->left;
+        while (node->right) {
+            node = node->right;
         }
+
+        return node;
+    }
+
+    Node<Key, T> *parent = node->prev;
+    while (parent && parent->left == node) {
+        node = parent;
+        parent = parent->prev;
+    }
+    if (!parent) {
+        start = true;
+        return p;
     }
 
-    return nullptr;
+    return parent;
 }
 
 #endif  // AVLMAP_AVLMAP_AVL_ITERATOR_HPP_
@@ -0,0 +1,349 @@
+// Copyright (c) 2024 PlatinumSamurai. All rights reserved.
+
+#ifndef AVLMAP_AVLMAP_AVL_MULTIMAP_HPP_
+#define AVLMAP_AVLMAP_AVL_MULTIMAP_HPP_
+
+#include <cstddef>
+#include <functional>
+#include <initializer_list>
+#include <utility>
+#include "avl.hpp"
+#include "avl_multimap_iterator.hpp"
+
+
+// Ordered map allowing duplicate keys. Each distinct key is one Avl node
+// whose mapped value is a DuplicateRun: the first ChunkSize values sit
+// inline in the node's pair and further ones in chunks of the same size, so
+// hot keys neither multiply nodes nor scatter their values across the heap.
+// Values with equal keys are kept in insertion order.
+template <typename Key, typename T, typename Compare = std::less<Key>,
+                                                        size_t ChunkSize = 4>
+class AvlMultimap {
+ private:
+    typedef DuplicateRun<T, ChunkSize> Run;
+
+    Avl<Key, Run, Compare> tree;
+    size_t total = 0;
+
+ public:
+    typedef AvlMultimapIterator<Key, T, Compare, ChunkSize> iterator;
+
+    AvlMultimap() = default;
+    AvlMultimap(std::initializer_list<std::pair<const Key, T>>);
+    AvlMultimap(const AvlMultimap &) = delete;
+    AvlMultimap& operator=(const AvlMultimap &) = delete;
+
+    iterator insert(const std::pair<const Key, T> &);
+    size_t erase(const Key &);
+    iterator erase(iterator);
+    size_t count(const Key &) const;
+    std::pair<iterator, iterator> equal_range(const Key &);
+    iterator find(const Key &);
+    bool contains(const Key &) const;
+    bool empty() const;
+    size_t size() const;
+    void clear();
+
+    iterator begin();
+    iterator end();
+};
+
+
+// Ordered set allowing duplicate keys. Equal keys are indistinguishable,
+// so each distinct key is one Avl node holding how many times it occurs,
+// and iteration yields it that many times.
+template <typename Key, typename Compare = std::less<Key>>
+class AvlMultiset {
+ private:
+    Avl<Key, size_t, Compare> tree;
+    size_t total = 0;
+
+ public:
+    typedef AvlMultisetIterator<Key, Compare> iterator;
+
+    AvlMultiset() = default;
+    AvlMultiset(std::initializer_list<Key>);
+    AvlMultiset(const AvlMultiset &) = delete;
+    AvlMultiset& operator=(const AvlMultiset &) = delete;
+
+    iterator insert(const Key &);
+    size_t erase(const Key &);
+    iterator erase(iterator);
+    size_t count(const Key &) const;
+    std::pair<iterator, iterator> equal_range(const Key &);
+    iterator find(const Key &);
+    bool contains(const Key &) const;
+    bool empty() const;
+    size_t size() const;
+    void clear();
+
+    iterator begin();
+    iterator end();
+};
+
+
+template <typename Key, typename T, typename Compare, size_t ChunkSize>
+AvlMultimap<Key, T, Compare, ChunkSize>::AvlMultimap(
+                        std::initializer_list<std::pair<const Key, T>> init) {
+    for (const auto &pair : init) {
+        insert(pair);
+    }
+}
+
+
+template <typename Key, typename T, typename Compare, size_t ChunkSize>
+AvlMultimap<Key, T, Compare, ChunkSize>::iterator
+        AvlMultimap<Key, T, Compare, ChunkSize>::insert(
+                                        const std::pair<const Key, T> &pair) {
+    auto node = tree.insert({pair.first, Run()}).first;
+    Run &run = (*node).second;
+    run.push_back(pair.second);
+    ++total;
+
+    auto chunk = run.back();
+
+    return iterator(&tree, node, chunk, chunk->count - 1);
+}
+
+
+template <typename Key, typename T, typename Compare, size_t ChunkSize>
+size_t AvlMultimap<Key, T, Compare, ChunkSize>::erase(const Key &k) {
+    auto node = tree.find(k);
+
+    if (node == tree.end()) {
+        return 0;
+    }
+
+    size_t count = (*node).second.size();
+    tree.extract(node);
+    total -= count;
+
+    return count;
+}
+
+
+template <typename Key, typename T, typename Compare, size_t ChunkSize>
+AvlMultimap<Key, T, Compare, ChunkSize>::iterator
+            AvlMultimap<Key, T, Compare, ChunkSize>::erase(iterator pos) {
+    Run &run = (*pos.node).second;
+    --total;
+
+    if (run.size() == 1) {
+        auto next = pos.node;
+        ++next;
+        if (next == tree.end()) {
+            tree.extract(pos.node);
+            return end();
+        }
+        tree.extract(pos.node);
+
+        return iterator(&tree, next);
+    }
+
+    bool last = (pos.index + 1 == pos.chunk->count && !pos.chunk->next);
+    run.erase(pos.chunk, pos.index);
+    if (last) {
+        return iterator(&tree, ++pos.node);
+    }
+
+    return pos;
+}
+
+
+template <typename Key, typename T, typename Compare, size_t ChunkSize>
+size_t AvlMultimap<Key, T, Compare, ChunkSize>::count(const Key &k) const {
+    auto node = tree.find(k);
+
+    return (node == tree.end() ? 0 : (*node).second.size());
+}
+
+
+template <typename Key, typename T, typename Compare, size_t ChunkSize>
+std::pair<typename AvlMultimap<Key, T, Compare, ChunkSize>::iterator,
+            typename AvlMultimap<Key, T, Compare, ChunkSize>::iterator>
+        AvlMultimap<Key, T, Compare, ChunkSize>::equal_range(const Key &k) {
+    auto node = tree.find(k);
+
+    if (node == tree.end()) {
+        return std::make_pair(end(), end());
+    }
+
+    auto next = node;
+    ++next;
+
+    return std::make_pair(iterator(&tree, node), iterator(&tree, next));
+}
+
+
+template <typename Key, typename T, typename Compare, size_t ChunkSize>
+AvlMultimap<Key, T, Compare, ChunkSize>::iterator
+            AvlMultimap<Key, T, Compare, ChunkSize>::find(const Key &k) {
+    return iterator(&tree, tree.find(k));
+}
+
+
+template <typename Key, typename T, typename Compare, size_t ChunkSize>
+bool AvlMultimap<Key, T, Compare, ChunkSize>::contains(const Key &k) const {
+    return tree.contains(k);
+}
+
+
+template <typename Key, typename T, typename Compare, size_t ChunkSize>
+bool AvlMultimap<Key, T, Compare, ChunkSize>::empty() const {
+    return total == 0;
+}
+
+
+template <typename Key, typename T, typename Compare, size_t ChunkSize>
+size_t AvlMultimap<Key, T, Compare, ChunkSize>::size() const {
+    return total;
+}
+
+
+template <typename Key, typename T, typename Compare, size_t ChunkSize>
+void AvlMultimap<Key, T, Compare, ChunkSize>::clear() {
+    tree.clear();
+    total = 0;
+}
+
+
+template <typename Key, typename T, typename Compare, size_t ChunkSize>
+AvlMultimap<Key, T, Compare, ChunkSize>::iterator
+                        AvlMultimap<Key, T, Compare, ChunkSize>::begin() {
+    return iterator(&tree, tree.begin());
+}
+
+
+template <typename Key, typename T, typename Compare, size_t ChunkSize>
+AvlMultimap<Key, T, Compare, ChunkSize>::iterator
+                        AvlMultimap<Key, T, Compare, ChunkSize>::end() {
+    return iterator(&tree, tree.end());
+}
+
+
+template <typename Key, typename Compare>
+AvlMultiset<Key, Compare>::AvlMultiset(std::initializer_list<Key> init) {
+    for (const auto &k : init) {
+        insert(k);
+    }
+}
+
+
+template <typename Key, typename Compare>
+AvlMultiset<Key, Compare>::iterator
+                        AvlMultiset<Key, Compare>::insert(const Key &k) {
+    auto node = tree.insert({k, 0}).first;
+    size_t &count = (*node).second;
+    ++count;
+    ++total;
+
+    return iterator(&tree, node, count - 1);
+}
+
+
+template <typename Key, typename Compare>
+size_t AvlMultiset<Key, Compare>::erase(const Key &k) {
+    auto node = tree.find(k);
+
+    if (node == tree.end()) {
+        return 0;
+    }
+
+    size_t count = (*node).second;
+    tree.extract(node);
+    total -= count;
+
+    return count;
+}
+
+
+// Drops one occurrence; the ones after pos move down into its place.
+template <typename Key, typename Compare>
+AvlMultiset<Key, Compare>::iterator
+                    AvlMultiset<Key, Compare>::erase(iterator pos) {
+    size_t &count = (*pos.node).second;
+    --total;
+
+    if (--count > pos.index) {
+        return pos;
+    }
+
+    auto next = pos.node;
+    ++next;
+    if (count == 0) {
+        tree.extract(pos.node);
+    }
+
+    return iterator(&tree, next, 0);
+}
+
+
+template <typename Key, typename Compare>
+size_t AvlMultiset<Key, Compare>::count(const Key &k) const {
+    auto node = tree.find(k);
+
+    return (node == tree.end() ? 0 : (*node).second);
+}
+
+
+template <typename Key, typename Compare>
+std::pair<typename AvlMultiset<Key, Compare>::iterator,
+                            typename AvlMultiset<Key, Compare>::iterator>
+                    AvlMultiset<Key, Compare>::equal_range(const Key &k) {
+    auto node = tree.find(k);
+
+    if (node == tree.end()) {
+        return std::make_pair(end(), end());
+    }
+
+    auto next = node;
+    ++next;
+
+    return std::make_pair(iterator(&tree, node, 0), iterator(&tree, next, 0));
+}
+
+
+template <typename Key, typename Compare>
+AvlMultiset<Key, Compare>::iterator
+                        AvlMultiset<Key, Compare>::find(const Key &k) {
+    return iterator(&tree, tree.find(k), 0);
+}
+
+
+template <typename Key, typename Compare>
+bool AvlMultiset<Key, Compare>::contains(const Key &k) const {
+    return tree.contains(k);
+}
+
+
+template <typename Key, typename Compare>
+bool AvlMultiset<Key, Compare>::empty() const {
+    return total == 0;
+}
+
+
+template <typename Key, typename Compare>
+size_t AvlMultiset<Key, Compare>::size() const {
+    return total;
+}
+
+
+template <typename Key, typename Compare>
+void AvlMultiset<Key, Compare>::clear() {
+    tree.clear();
+    total = 0;
+}
+
+
+template <typename Key, typename Compare>
+AvlMultiset<Key, Compare>::iterator AvlMultiset<Key, Compare>::begin() {
+    return iterator(&tree, tree.begin(), 0);
+}
+
+
+template <typename Key, typename Compare>
+AvlMultiset<Key, Compare>::iterator AvlMultiset<Key, Compare>::end() {
+    return iterator(&tree, tree.end(), 0);
+}
+
+#endif  // AVLMAP_AVLMAP_AVL_MULTIMAP_HPP_
@@ -0,0 +1,199 @@
+// Copyright (c) 2024 PlatinumSamurai. All rights reserved.
+
+#ifndef AVLMAP_AVLMAP_AVL_MULTIMAP_ITERATOR_HPP_
+#define AVLMAP_AVLMAP_AVL_MULTIMAP_ITERATOR_HPP_
+
+#include <cstddef>
+#include <iterator>
+#include <utility>
+#include "node.hpp"
+#include "avl_iterator.hpp"
+
+
+template <typename Key, typename T, typename Compare, size_t N>
+class AvlMultimap;
+
+
+template <typename Key, typename Compare>
+class AvlMultiset;
+
+
+// Walks the values of every run in key order, and each run in insertion
+// order. The end iterator has no chunk.
+template <typename Key, typename T, typename Compare, size_t N>
+class AvlMultimapIterator {
+ private:
+    template <typename, typename, typename, size_t>
+    friend class AvlMultimap;
+
+    typedef DuplicateRun<T, N> Run;
+    typedef typename Run::Chunk Chunk;
+
+    const Avl<Key, Run, Compare> *tree;
+    AvlIterator<Key, Run, Compare> node;
+    Chunk *chunk = nullptr;
+    size_t index = 0;
+
+    AvlMultimapIterator(const Avl<Key, Run, Compare> *,
+                                    AvlIterator<Key, Run, Compare>);
+    AvlMultimapIterator(const Avl<Key, Run, Compare> *,
+                    AvlIterator<Key, Run, Compare>, Chunk *, size_t);
+
+ public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef std::pair<const Key, T> value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef void pointer;
+    typedef std::pair<const Key &, T &> reference;
+
+    AvlMultimapIterator& operator++();
+    AvlMultimapIterator operator++(int);
+    std::pair<const Key &, T &> operator*() const;
+    bool operator==(const AvlMultimapIterator &other) const;
+    bool operator!=(const AvlMultimapIterator &other) const;
+};
+
+
+// Yields each key of an AvlMultiset as many times as it occurs; index counts
+// the occurrences already passed. The end iterator is the tree's end.
+template <typename Key, typename Compare>
+class AvlMultisetIterator {
+ private:
+    template <typename, typename>
+    friend class AvlMultiset;
+
+    const Avl<Key, size_t, Compare> *tree;
+    AvlIterator<Key, size_t, Compare> node;
+    size_t index = 0;
+
+    AvlMultisetIterator(const Avl<Key, size_t, Compare> *,
+                                    AvlIterator<Key, size_t, Compare>, size_t);
+
+ public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef Key value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef const Key* pointer;
+    typedef const Key& reference;
+
+    AvlMultisetIterator& operator++();
+    AvlMultisetIterator operator++(int);
+    const Key& operator*() const;
+    bool operator==(const AvlMultisetIterator &other) const;
+    bool operator!=(const AvlMultisetIterator &other) const;
+};
+
+
+template <typename Key, typename T, typename Compare, size_t N>
+AvlMultimapIterator<Key, T, Compare, N>::AvlMultimapIterator(
+        const Avl<Key, Run, Compare> *t, AvlIterator<Key, Run, Compare> n) :
+                                                            tree(t), node(n) {
+    if (node != tree->end()) {
+        chunk = (*node).second.front();
+    }
+}
+
+
+template <typename Key, typename T, typename Compare, size_t N>
+AvlMultimapIterator<Key, T, Compare, N>::AvlMultimapIterator(
+        const Avl<Key, Run, Compare> *t, AvlIterator<Key, Run, Compare> n,
+        Chunk *c, size_t i) : tree(t), node(n), chunk(c), index(i) {}
+
+
+template <typename Key, typename T, typename Compare, size_t N>
+AvlMultimapIterator<Key, T, Compare, N>&
+                        AvlMultimapIterator<Key, T, Compare, N>::operator++() {
+    if (++index < chunk->count) {
+        return *this;
+    }
+
+    chunk = chunk->next;
+    index = 0;
+    if (!chunk && ++node != tree->end()) {
+        chunk = (*node).second.front();
+    }
+
+    return *this;
+}
+
+
+template <typename Key, typename T, typename Compare, size_t N>
+AvlMultimapIterator<Key, T, Compare, N>
+                    AvlMultimapIterator<Key, T, Compare, N>::operator++(int) {
+    AvlMultimapIterator<Key, T, Compare, N> temp = *this;
+    ++(*this);
+
+    return temp;
+}
+
+
+template <typename Key, typename T, typename Compare, size_t N>
+std::pair<const Key &, T &>
+                AvlMultimapIterator<Key, T, Compare, N>::operator*() const {
+    return std::pair<const Key &, T &>((*node).first, chunk->at(index));
+}
+
+
+template <typename Key, typename T, typename Compare, size_t N>
+bool AvlMultimapIterator<Key, T, Compare, N>::operator==(
+                                    const AvlMultimapIterator &other) const {
+    return chunk == other.chunk && index == other.index;
+}
+
+
+template <typename Key, typename T, typename Compare, size_t N>
+bool AvlMultimapIterator<Key, T, Compare, N>::operator!=(
+                                    const AvlMultimapIterator &other) const {
+    return !(*this == other);
+}
+
+
+template <typename Key, typename Compare>
+AvlMultisetIterator<Key, Compare>::AvlMultisetIterator(
+                const Avl<Key, size_t, Compare> *t,
+                AvlIterator<Key, size_t, Compare> n, size_t i) :
+                                                tree(t), node(n), index(i) {}
+
+
+template <typename Key, typename Compare>
+AvlMultisetIterator<Key, Compare>&
+                        AvlMultisetIterator<Key, Compare>::operator++() {
+    if (++index == (*node).second) {
+        index = 0;
+        ++node;
+    }
+
+    return *this;
+}
+
+
+template <typename Key, typename Compare>
+AvlMultisetIterator<Key, Compare>
+                    AvlMultisetIterator<Key, Compare>::operator++(int) {
+    AvlMultisetIterator<Key, Compare> temp = *this;
+    ++(*this);
+
+    return temp;
+}
+
+
+template <typename Key, typename Compare>
+const Key& AvlMultisetIterator<Key, Compare>::operator*() const {
+    return (*node).first;
+}
+
+
+template <typename Key, typename Compare>
+bool AvlMultisetIterator<Key, Compare>::operator==(
+                                    const AvlMultisetIterator &other) const {
+    return node == other.node && index == other.index;
+}
+
+
+template <typename Key, typename Compare>
+bool AvlMultisetIterator<Key, Compare>::operator!=(
+                                    const AvlMultisetIterator &other) const {
+    return !(*this == other);
+}
+
+#endif  // AVLMAP_AVLMAP_AVL_MULTIMAP_ITERATOR_HPP_
@@ -0,0 +1,265 @@
+// Copyright (c) 2024 PlatinumSamurai. All rights reserved.
+
+#ifndef AVLMAP_AVLMAP_BALANCE_HPP_
+#define AVLMAP_AVLMAP_BALANCE_HPP_
+
+#include <algorithm>
+#include <cmath>
+#include "node.hpp"
+
+
+// Balancing policies for Avl and BlockedAvl. A policy keeps a rank in the
+// height field of any node with prev, left, right and height links, with
+// null subtrees at rank 0, and repairs it bottom-up:
+//   hang(node)             ranks a node just put above its children
+//   update(node)           re-ranks a node whose children were rotated
+//   taller(a, b)           whether Join walks down from a to meet b
+//   rebalance(tree, node)  restores the invariant from node up
+//   weight(node)           estimates the entries under node from its rank
+// Join hangs its node where taller() stops and calls rebalance(), so range
+// splits and cuts work the same under every policy.
+struct AvlBalance {
+    template <typename N>
+    static int rank(const N *node) {
+        return (node ? node->height : 0);
+    }
+
+    template <typename N>
+    static void hang(N *node) {
+        update(node);
+    }
+
+    template <typename N>
+    static void update(N *node) {
+        node->height = std::max(rank(node->left), rank(node->right)) + 1;
+    }
+
+    template <typename N>
+    static bool taller(const N *lhs, const N *rhs) {
+        return rank(lhs) > rank(rhs) + 1;
+    }
+
+    // A random AVL tree of height h holds about 2^(0.83 h) entries.
+    template <typename N>
+    static double weight(const N *node) {
+        return std::exp2(0.83 * rank(node));
+    }
+
+    template <typename Tree, typename N>
+    static void rebalance(Tree &, N *);
+
+ private:
+    template <typename N>
+    static int Diff(const N *node) {
+        return rank(node->right) - rank(node->left);
+    }
+};
+
+
+// Red-black tree with the black height as rank: a red node has the rank of
+// its parent, a black one is one lower. Fewer rotations than AVL on updates,
+// at most twice the optimal height instead of 1.44 times.
+struct RedBlackBalance {
+    template <typename N>
+    static int rank(const N *node) {
+        return (node ? node->height : 0);
+    }
+
+    template <typename N>
+    static void hang(N *node) {
+        node->height = std::max(rank(node->left), rank(node->right)) + 1;
+    }
+
+    // Ranks only change by promotion and demotion in rebalance().
+    template <typename N>
+    static void update(N *) {}
+
+    template <typename N>
+    static bool taller(const N *lhs, const N *rhs) {
+        return rank(lhs) > rank(rhs);
+    }
+
+    // And a random red-black tree of black height b about 2^(1.64 b - 0.7).
+    template <typename N>
+    static double weight(const N *node) {
+        return std::exp2(1.64 * rank(node) - 0.7);
+    }
+
+    template <typename Tree, typename N>
+    static void rebalance(Tree &, N *);
+
+ private:
+    template <typename Tree, typename N>
+    static N* Rotate(Tree &tree, N *node, bool left) {
+        return (left ? tree.LeftRot(node) : tree.RightRot(node));
+    }
+};
+
+
+// Weight-balanced tree with the subtree size as rank: neither side weighs
+// more than kDelta times the other, counting size + 1. Rotations depend on
+// sizes only, and the ranks double as an order statistic.
+struct WeightBalance {
+    static constexpr int kDelta = 3;
+    static constexpr int kGamma = 2;
+
+    template <typename N>
+    static int rank(const N *node) {
+        return (node ? node->height : 0);
+    }
+
+    template <typename N>
+    static void hang(N *node) {
+        update(node);
+    }
+
+    template <typename N>
+    static void update(N *node) {
+        node->height = rank(node->left) + rank(node->right) + 1;
+    }
+
+    template <typename N>
+    static bool taller(const N *lhs, const N *rhs) {
+        return Weight(lhs) > kDelta * Weight(rhs);
+    }
+
+    template <typename N>
+    static double weight(const N *node) {
+        return rank(node);
+    }
+
+    template <typename Tree, typename N>
+    static void rebalance(Tree &, N *);
+
+ private:
+    template <typename N>
+    static int Weight(const N *node) {
+        return rank(node) + 1;
+    }
+};
+
+
+template <typename Tree, typename N>
+void AvlBalance::rebalance(Tree &tree, N *node) {
+    while (node) {
+        N *parent = node->prev;
+        int oldHeight = node->height;
+
+        tree.UpdateHeight(node);
+        if (Diff(node) == 2) {
+            if (Diff(node->right) < 0) {
+                node->right = tree.RightRot(node->right);
+            }
+            tree.Replace(parent, node, tree.LeftRot(node));
+        } else if (Diff(node) == -2) {
+            if (Diff(node->left) > 0) {
+                node->left = tree.LeftRot(node->left);
+            }
+            tree.Replace(parent, node, tree.RightRot(node));
+        } else if (!Tree::kAugmented && node->height == oldHeight) {
+            return;
+        }
+
+        node = parent;
+    }
+}
+
+
+// A node is short when a child ranks two below it, after an erase, and a red
+// child with a red child of its own follows an insert or join. Each is fixed
+// at the node or pushed one level up; two quiet levels in a row mean the
+// rest of the path is fine.
+template <typename Tree, typename N>
+void RedBlackBalance::rebalance(Tree &tree, N *node) {
+    int quiet = 0;
+
+    while (node && (Tree::kAugmented || quiet < 2)) {
+        N *parent = node->prev;
+        int r = node->height;
+
+        tree.UpdateHeight(node);
+        if (r - rank(node->left) == 2 || r - rank(node->right) == 2) {
+            bool left = (r - rank(node->left) == 2);
+            N *sibling = (left ? node->right : node->left);
+            N *near = (left ? sibling->left : sibling->right);
+            N *far = (left ? sibling->right : sibling->left);
+
+            quiet = 0;
+            if (rank(sibling) == r) {
+                // Red sibling: lift it and fix the node again below it.
+                tree.Replace(parent, node, Rotate(tree, node, left));
+                continue;
+            }
+            if (rank(far) == rank(sibling)) {
+                sibling->height = r;
+                node->height = r - 1;
+                tree.Replace(parent, node, Rotate(tree, node, left));
+            } else if (rank(near) == rank(sibling)) {
+                near->height = r;
+                node->height = r - 1;
+                (left ? node->right : node->left) =
+                                            Rotate(tree, sibling, !left);
+                tree.Replace(parent, node, Rotate(tree, node, left));
+            } else {
+                node->height = r - 1;
+            }
+        } else {
+            N *child = nullptr;
+            for (N *c : {node->left, node->right}) {
+                if (rank(c) == r && (rank(c->left) == r ||
+                                                    rank(c->right) == r)) {
+                    child = c;
+                }
+            }
+
+            if (!child) {
+                ++quiet;
+            } else if (rank(child == node->left ? node->right :
+                                                        node->left) == r) {
+                node->height = r + 1;
+                quiet = 0;
+            } else {
+                bool right = (child == node->right);
+                if (rank(right ? child->left : child->right) == r) {
+                    (right ? node->right : node->left) =
+                                            Rotate(tree, child, !right);
+                }
+                tree.Replace(parent, node, Rotate(tree, node, right));
+                quiet = 0;
+            }
+        }
+
+        node = parent;
+    }
+}
+
+
+// Every size on the path changes, so the walk always reaches the root. One
+// single or double rotation per level is enough with <3, 2>.
+template <typename Tree, typename N>
+void WeightBalance::rebalance(Tree &tree, N *node) {
+    while (node) {
+        N *parent = node->prev;
+        int lweight = Weight(node->left);
+        int rweight = Weight(node->right);
+
+        tree.UpdateHeight(node);
+        if (rweight > kDelta * lweight) {
+            N *right = node->right;
+            if (Weight(right->left) >= kGamma * Weight(right->right)) {
+                node->right = tree.RightRot(right);
+            }
+            tree.Replace(parent, node, tree.LeftRot(node));
+        } else if (lweight > kDelta * rweight) {
+            N *left = node->left;
+            if (Weight(left->right) >= kGamma * Weight(left->left)) {
+                node->left = tree.LeftRot(left);
+            }
+            tree.Replace(parent, node, tree.RightRot(node));
+        }
+
+        node = parent;
+    }
+}
+
+#endif  // AVLMAP_AVLMAP_BALANCE_HPP_
@@ -0,0 +1,628 @@
+// Copyright (c) 2024 PlatinumSamurai. All rights reserved.
+
+#ifndef AVLMAP_AVLMAP_BLOCKED_AVL_HPP_
+#define AVLMAP_AVLMAP_BLOCKED_AVL_HPP_
+
+#include <cstddef>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
+#include "node.hpp"
+#include "balance.hpp"
+#include "links.hpp"
+#include "blocked_avl_iterator.hpp"
+#include "avl.hpp"
+
+
+// Avl whose nodes are blocks of up to Capacity sorted entries, by default
+// about two cache lines of them. Blocks are linked, rotated and rebalanced
+// by the same TreeLinks and Balance policy code as Avl's nodes; a full block
+// is split in half with the upper half becoming its successor, and a block
+// that drops below a quarter full absorbs its successor when both fit in
+// one. A lookup descends on the blocks' first keys and finishes with a
+// binary search inside one block.
+template <typename Key, typename T, typename Compare = std::less<Key>,
+          size_t Capacity = (128 / sizeof(std::pair<const Key, T>) > 4 ?
+                                128 / sizeof(std::pair<const Key, T>) : 4),
+                                            typename Balance = AvlBalance>
+class BlockedAvl {
+ private:
+    friend Balance;
+    friend TreeLinks;
+
+    typedef BlockNode<Key, T, Capacity> Block;
+
+    static_assert(Capacity >= 4, "blocks need room to split and merge");
+    static constexpr bool kAugmented = false;
+
+    Block *root = nullptr;
+    Block *leftmost = nullptr;
+    Block *rightmost = nullptr;
+    size_t total = 0;
+    Compare cmp;
+
+    void UpdateHeight(Block *);
+    Block* LeftRot(Block *);
+    Block* RightRot(Block *);
+    void Rebalance(Block *);
+    void Replace(Block *, Block *, Block *);
+    void Unlink(Block *);
+    void Clear(Block *);
+
+    bool Less(const Key &, const Key &) const;
+    const Key& KeyAt(Block *, size_t) const;
+    size_t LowerBound(Block *, const Key &) const;
+    Block* Locate(const Key &, size_t *) const;
+    void Place(Block *, size_t, const std::pair<const Key, T> &);
+    void Remove(Block *, size_t);
+    void Move(Block *, size_t, Block *);
+    Block* Split(Block *);
+
+ public:
+    typedef BlockedAvlIterator<Key, T, Capacity> iterator;
+    typedef std::reverse_iterator<iterator> r_iterator;
+    typedef const BlockedAvlIterator<Key, T, Capacity> c_iterator;
+    typedef const std::reverse_iterator<iterator> cr_iterator;
+
+    BlockedAvl() = default;
+    BlockedAvl(std::initializer_list<std::pair<const Key, T>>);
+    BlockedAvl(const BlockedAvl &) = delete;
+    BlockedAvl(BlockedAvl &&) noexcept;
+    ~BlockedAvl();
+
+    BlockedAvl& operator=(const BlockedAvl &) = delete;
+    BlockedAvl& operator=(BlockedAvl &&) noexcept;
+
+    std::pair<iterator, bool> insert(const std::pair<const Key, T> &);
+    size_t erase(const Key &);
+    iterator erase(iterator);
+    bool empty() const;
+    size_t size() const;
+    size_t block_count() const;
+    void clear();
+    bool contains(const Key &) const;
+    iterator find(const Key &);
+    T& at(const Key &);
+    T& operator[](const Key &);
+    std::pair<const Key, T>& front();
+    std::pair<const Key, T>& back();
+    std::pair<Key, T> pop_min();
+    std::pair<Key, T> pop_max();
+
+    iterator begin();
+    iterator end();
+    r_iterator rbegin();
+    r_iterator rend();
+    c_iterator begin() const;
+    c_iterator end() const;
+    cr_iterator rbegin() const;
+    cr_iterator rend() const;
+};
+
+
+
+template <typename Key, typename T, typename Compare, size_t Capacity,
+                                                        typename Balance>
+BlockedAvl<Key, T, Compare, Capacity, Balance>::BlockedAvl(
+                        std::initializer_list<std::pair<const Key, T>> init) {
+    for (const auto &pair : init) {
+        insert(pair);
+    }
+}
+
+
+template <typename Key, typename T, typename Compare, size_t Capacity,
+                                                        typename Balance>
+BlockedAvl<Key, T, Compare, Capacity, Balance>::BlockedAvl(
+                                                BlockedAvl &&other) noexcept
+                : root(other.root), leftmost(other.leftmost),
+                rightmost(other.rightmost), total(other.total),
+                cmp(std::move(other.cmp)) {
+    other.root = nullptr;
+    other.leftmost = nullptr;
+    other.rightmost = nullptr;
+    other.total = 0;
+}
+
+
+template <typename Key, typename T, typename Compare, size_t Capacity,
+                                                        typename Balance>
+BlockedAvl<Key, T, Compare, Capacity, Balance>::~BlockedAvl() {
+    Clear(root);
+}
+
+
+template <typename Key, typename T, typename Compare, size_t Capacity,
+                                                        typename Balance>
+BlockedAvl<Key, T, Compare, Capacity, Balance>&
+        BlockedAvl<Key, T, Compare, Capacity, Balance>::operator=(
+                                                BlockedAvl &&other) noexcept {
+    if (this != &other) {
+        clear();
+        std::swap(root, other.root);
+        std::swap(leftmost, other.leftmost);
+        std::swap(rightmost, other.rightmost);
+        std::swap(total, other.total);
+        std::swap(cmp, other.cmp);
+    }
+
+    return *this;
+}
+
+
+template <typename Key, typename T, typename Compare, size_t Capacity,
+                                                        typename Balance>
+void BlockedAvl<Key, T, Compare, Capacity, Balance>::UpdateHeight(
+                                                                Block *node) {
+    Balance::update(node);
+}
+
+
+template <typename Key, typename T, typename Compare, size_t Capacity,
+                                                        typename Balance>
+BlockedAvl<Key, T, Compare, Capacity, Balance>::Block*
+        BlockedAvl<Key, T, Compare, Capacity, Balance>::LeftRot(Block *node) {
+    return TreeLinks::rotate_left(*this, node);
+}
+
+
+template <typename Key, typename T, typename Compare, size_t Capacity,
+                                                        typename Balance>
+BlockedAvl<Key, T, Compare, Capacity, Balance>::Block*
+        BlockedAvl<Key, T, Compare, Capacity, Balance>::RightRot(Block *node) {
+    return TreeLinks::rotate_right(*this, node);
+}
+
+
+template <typename Key, typename T, typename Compare, size_t Capacity,
+                                                        typename Balance>
+void BlockedAvl<Key, T, Compare, Capacity, Balance>::Rebalance(Block *node) {
+    Balance::rebalance(*this, node);
+}
+
+
+template <typename Key, typename T, typename Compare, size_t Capacity,
+                                                        typename Balance>
+void BlockedAvl<Key, T, Compare, Capacity, Balance>::Replace(Block *parent,
+                                                    Block *old, Block *node) {
+    TreeLinks::replace(*this, parent, old, node);
+}
+
+
+template <typename Key, typename T, typename Compare, size_t Capacity,
+                                                        typename Balance>
+void BlockedAvl<Key, T, Compare, Capacity, Balance>::Unlink(Block *node) {
+    TreeLinks::unlink(*this, node);
+}
+
+
+template <typename Key, typename T, typename Compare, size_t Capacity,
+                                                        typename Balance>
+void BlockedAvl<Key, T, Compare, Capacity, Balance>::Clear(Block *node) {
+    TreeLinks::clear(node, [](Block *block) {
+        delete block;
+    });
+}
+
+
+template <typename Key, typename T, typename Compare, size_t Capacity,
+                                                        typename Balance>
+bool BlockedAvl<Key, T, Compare, Capacity, Balance>::Less(const Key &lhs,
+                                                    const Key &rhs) const {
+    return avl_less(cmp, lhs, rhs);
+}
+
+
+template <typename Key, typename T, typename Compare, size_t Capacity,
+                                                        typename Balance>
+const Key& BlockedAvl<Key, T, Compare, Capacity, Balance>::KeyAt(
+                                            Block *block, size_t i) const {
+    return block->entry(i)->first;
+}
+
+
+template <typename Key, typename T, typename Compare, size_t Capacity,
+                                                        typename Balance>
+size_t BlockedAvl<Key, T, Compare, Capacity, Balance>::LowerBound(
+                                        Block *block, const Key &k) const {
+    size_t base = 0;
+    size_t n = block->count;
+
+    while (n > 1) {
+        size_t half = n / 2;
+        base = (Less(KeyAt(block, base + half), k) ? base + half : base);
+        n -= half;
+    }
+
+    return base + Less(KeyAt(block, base), k);
+}
+
+
+// Returns the block with the greatest first key not above k, or the
+// leftmost block if k precedes them all: the block that holds k or would
+// receive it on insertion. Only first keys are read on the way down, one
+// comparison per level. *index is set to k's lower bound in that block.
+template <typename Key, typename T, typename Compare, size_t Capacity,
+                                                        typename Balance>
+BlockedAvl<Key, T, Compare, Capacity, Balance>::Block*
+        BlockedAvl<Key, T, Compare, Capacity, Balance>::Locate(const Key &k,
+                                                        size_t *index) const {
+    Block *candidate = nullptr;
+    Block *node = root;
+
+    while (node) {
+        bool right = !Less(k, KeyAt(node, 0));
+        candidate = (right ? node : candidate);
+        node = (right ? node->right : node->left);
+    }
+    if (!candidate) {
+        candidate = leftmost;
+    }
+
+    *index = (candidate ? LowerBound(candidate, k) : 0);
+
+    return candidate;
+}
+
+
+// The copy is made before anything moves, so a throwing copy leaves the
+// block as it was.
+template <typename Key, typename T, typename Compare, size_t Capacity,
+                                                        typename Balance>
+void BlockedAvl<Key, T, Compare, Capacity, Balance>::Place(Block *block,
+                            size_t i, const std::pair<const Key, T> &pair) {
+    std::pair<const Key, T> entry(pair);
+
+    for (size_t j = block->count; j > i; --j) {
+        new(block->slot(j))std::pair<const Key, T>(
+                                            std::move(*block->entry(j - 1)));
+        std::destroy_at(block->entry(j - 1));
+    }
+
+    new(block->slot(i))std::pair<const Key, T>(std::move(entry));
+    ++block->count;
+}
+
+
+template <typename Key, typename T, typename Compare, size_t Capacity,
+                                                        typename Balance>
+void BlockedAvl<Key, T, Compare, Capacity, Balance>::Remove(Block *block,
+                                                                size_t i) {
+    std::destroy_at(block->entry(i));
+
+    for (size_t j = i + 1; j < block->count; ++j) {
+        new(block->slot(j - 1))std::pair<const Key, T>(
+                                                std::move(*block->entry(j)));
+        std::destroy_at(block->entry(j));
+    }
+    --block->count;
+}
+
+
+// Appends the entries of source from index i on to target.
+template <typename Key, typename T, typename Compare, size_t Capacity,
+                                                        typename Balance>
+void BlockedAvl<Key, T, Compare, Capacity, Balance>::Move(Block *source,
+                                                    size_t i, Block *target) {
+    for (size_t j = i; j < source->count; ++j) {
+        new(target->slot(target->count))std::pair<const Key, T>(
+                                            std::move(*source->entry(j)));
+        std::destroy_at(source->entry(j));
+        ++target->count;
+    }
+    source->count = i;
+}
+
+
+// Moves the upper half of a full block into a new block linked in as its
+// in-order successor.
+template <typename Key, typename T, typename Compare, size_t Capacity,
+                                                        typename Balance>
+BlockedAvl<Key, T, Compare, Capacity, Balance>::Block*
+        BlockedAvl<Key, T, Compare, Capacity, Balance>::Split(Block *block) {
+    Block *sibling = new Block();
+    Move(block, block->count / 2, sibling);
+
+    if (!block->right) {
+        block->right = sibling;
+        sibling->prev = block;
+    } else {
+        Block *parent = TreeLinks::min(block->right);
+        parent->left = sibling;
+        sibling->prev = parent;
+    }
+    if (block == rightmost) {
+        rightmost = sibling;
+    }
+    Balance::hang(sibling);
+    Rebalance(sibling->prev);
+
+    return sibling;
+}
+
+
+template <typename Key, typename T, typename Compare, size_t Capacity,
+                                                        typename Balance>
+std::pair<typename BlockedAvl<Key, T, Compare, Capacity, Balance>::iterator,
+                                                                        bool>
+        BlockedAvl<Key, T, Compare, Capacity, Balance>::insert(
+                                        const std::pair<const Key, T> &pair) {
+    size_t i;
+    Block *block = Locate(pair.first, &i);
+
+    if (!block) {
+        root = new Block();
+        Balance::hang(root);
+        leftmost = root;
+        rightmost = root;
+        block = root;
+    } else if (i < block->count && !Less(pair.first, KeyAt(block, i))) {
+        return std::make_pair(iterator(block, i), false);
+    } else if (block->count == Capacity) {
+        Block *sibling = Split(block);
+        if (i > block->count) {
+            i -= block->count;
+            block = sibling;
+        }
+    }
+
+    Place(block, i, pair);
+    ++total;
+
+    return std::make_pair(iterator(block, i), true);
+}
+
+
+template <typename Key, typename T, typename Compare, size_t Capacity,
+                                                        typename Balance>
+size_t BlockedAvl<Key, T, Compare, Capacity, Balance>::erase(const Key &k) {
+    auto it = find(k);
+
+    if (it == end()) {
+        return 0;
+    }
+    erase(it);
+
+    return 1;
+}
+
+
+template <typename Key, typename T, typename Compare, size_t Capacity,
+                                                        typename Balance>
+BlockedAvl<Key, T, Compare, Capacity, Balance>::iterator
+        BlockedAvl<Key, T, Compare, Capacity, Balance>::erase(iterator pos) {
+    Block *block = pos.block;
+    size_t i = pos.index;
+
+    Remove(block, i);
+    --total;
+
+    if (block->count == 0) {
+        Block *next = iterator::NextBlock(block);
+        Unlink(block);
+        delete block;
+
+        return (next ? iterator(next, 0) : end());
+    }
+
+    Block *next = iterator::NextBlock(block);
+    if (next && block->count < Capacity / 4 &&
+                                    block->count + next->count <= Capacity) {
+        Move(next, 0, block);
+        Unlink(next);
+        delete next;
+        next = iterator::NextBlock(block);
+    }
+
+    if (i < block->count || !next) {
+        return iterator(block, i);
+    }
+
+    return iterator(next, 0);
+}
+
+
+template <typename Key, typename T, typename Compare, size_t Capacity,
+                                                        typename Balance>
+bool BlockedAvl<Key, T, Compare, Capacity, Balance>::empty() const {
+    return total == 0;
+}
+
+
+template <typename Key, typename T, typename Compare, size_t Capacity,
+                                                        typename Balance>
+size_t BlockedAvl<Key, T, Compare, Capacity, Balance>::size() const {
+    return total;
+}
+
+
+template <typename Key, typename T, typename Compare, size_t Capacity,
+                                                        typename Balance>
+size_t BlockedAvl<Key, T, Compare, Capacity, Balance>::block_count() const {
+    size_t count = 0;
+
+    for (Block *block = leftmost; block; block = iterator::NextBlock(block)) {
+        ++count;
+    }
+
+    return count;
+}
+
+
+template <typename Key, typename T, typename Compare, size_t Capacity,
+                                                        typename Balance>
+void BlockedAvl<Key, T, Compare, Capacity, Balance>::clear() {
+    Clear(root);
+    root = nullptr;
+    leftmost = nullptr;
+    rightmost = nullptr;
+    total = 0;
+}
+
+
+template <typename Key, typename T, typename Compare, size_t Capacity,
+                                                        typename Balance>
+bool BlockedAvl<Key, T, Compare, Capacity, Balance>::contains(
+                                                        const Key &k) const {
+    size_t i;
+    Block *block = Locate(k, &i);
+
+    return block && i < block->count && !Less(k, KeyAt(block, i));
+}
+
+
+template <typename Key, typename T, typename Compare, size_t Capacity,
+                                                        typename Balance>
+BlockedAvl<Key, T, Compare, Capacity, Balance>::iterator
+        BlockedAvl<Key, T, Compare, Capacity, Balance>::find(const Key &k) {
+    size_t i;
+    Block *block = Locate(k, &i);
+
+    if (block && i < block->count && !Less(k, KeyAt(block, i))) {
+        return iterator(block, i);
+    }
+
+    return end();
+}
+
+
+template <typename Key, typename T, typename Compare, size_t Capacity,
+                                                        typename Balance>
+T& BlockedAvl<Key, T, Compare, Capacity, Balance>::at(const Key &k) {
+    auto it = find(k);
+
+    if (it == end()) {
+        throw std::out_of_range("BlockedAvl::at");
+    }
+
+    return it->second;
+}
+
+
+template <typename Key, typename T, typename Compare, size_t Capacity,
+                                                        typename Balance>
+T& BlockedAvl<Key, T, Compare, Capacity, Balance>::operator[](const Key &k) {
+    return insert(std::make_pair(k, T())).first->second;
+}
+
+
+template <typename Key, typename T, typename Compare, size_t Capacity,
+                                                        typename Balance>
+std::pair<const Key, T>&
+            BlockedAvl<Key, T, Compare, Capacity, Balance>::front() {
+    if (!leftmost) {
+        throw std::out_of_range("BlockedAvl::front");
+    }
+
+    return *leftmost->entry(0);
+}
+
+
+template <typename Key, typename T, typename Compare, size_t Capacity,
+                                                        typename Balance>
+std::pair<const Key, T>&
+            BlockedAvl<Key, T, Compare, Capacity, Balance>::back() {
+    if (!rightmost) {
+        throw std::out_of_range("BlockedAvl::back");
+    }
+
+    return *rightmost->entry(rightmost->count - 1);
+}
+
+
+template <typename Key, typename T, typename Compare, size_t Capacity,
+                                                        typename Balance>
+std::pair<Key, T> BlockedAvl<Key, T, Compare, Capacity, Balance>::pop_min() {
+    if (!leftmost) {
+        throw std::out_of_range("BlockedAvl::pop_min");
+    }
+
+    std::pair<Key, T> pair(leftmost->entry(0)->first,
+                                        std::move(leftmost->entry(0)->second));
+    erase(begin());
+
+    return pair;
+}
+
+
+template <typename Key, typename T, typename Compare, size_t Capacity,
+                                                        typename Balance>
+std::pair<Key, T> BlockedAvl<Key, T, Compare, Capacity, Balance>::pop_max() {
+    if (!rightmost) {
+        throw std::out_of_range("BlockedAvl::pop_max");
+    }
+
+    auto last = --end();
+    std::pair<Key, T> pair(last->first, std::move(last->second));
+    erase(last);
+
+    return pair;
+}
+
+
+template <typename Key, typename T, typename Compare, size_t Capacity,
+                                                        typename Balance>
+BlockedAvl<Key, T, Compare, Capacity, Balance>::iterator
+                BlockedAvl<Key, T, Compare, Capacity, Balance>::begin() {
+    return iterator(leftmost, 0);
+}
+
+
+template <typename Key, typename T, typename Compare, size_t Capacity,
+                                                        typename Balance>
+BlockedAvl<Key, T, Compare, Capacity, Balance>::iterator
+                BlockedAvl<Key, T, Compare, Capacity, Balance>::end() {
+    return iterator(rightmost, rightmost ? rightmost->count : 0);
+}
+
+
+template <typename Key, typename T, typename Compare, size_t Capacity,
+                                                        typename Balance>
+BlockedAvl<Key, T, Compare, Capacity, Balance>::r_iterator
+                BlockedAvl<Key, T, Compare, Capacity, Balance>::rbegin() {
+    return r_iterator(end());
+}
+
+
+template <typename Key, typename T, typename Compare, size_t Capacity,
+                                                        typename Balance>
+BlockedAvl<Key, T, Compare, Capacity, Balance>::r_iterator
+                BlockedAvl<Key, T, Compare, Capacity, Balance>::rend() {
+    return r_iterator(begin());
+}
+
+
+template <typename Key, typename T, typename Compare, size_t Capacity,
+                                                        typename Balance>
+BlockedAvl<Key, T, Compare, Capacity, Balance>::c_iterator
+            BlockedAvl<Key, T, Compare, Capacity, Balance>::begin() const {
+    return c_iterator(leftmost, 0);
+}
+
+
+template <typename Key, typename T, typename Compare, size_t Capacity,
+                                                        typename Balance>
+BlockedAvl<Key, T, Compare, Capacity, Balance>::c_iterator
+            BlockedAvl<Key, T, Compare, Capacity, Balance>::end() const {
+    return c_iterator(rightmost, rightmost ? rightmost->count : 0);
+}
+
+
+template <typename Key, typename T, typename Compare, size_t Capacity,
+                                                        typename Balance>
+BlockedAvl<Key, T, Compare, Capacity, Balance>::cr_iterator
+            BlockedAvl<Key, T, Compare, Capacity, Balance>::rbegin() const {
+    return cr_iterator(end());
+}
+
+
+template <typename Key, typename T, typename Compare, size_t Capacity,
+                                                        typename Balance>
+BlockedAvl<Key, T, Compare, Capacity, Balance>::cr_iterator
+            BlockedAvl<Key, T, Compare, Capacity, Balance>::rend() const {
+    return cr_iterator(begin());
+}
+
+#endif  // AVLMAP_AVLMAP_BLOCKED_AVL_HPP_
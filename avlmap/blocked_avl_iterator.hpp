@@ -0,0 +1,179 @@
+// Copyright (c) 2024 PlatinumSamurai. All rights reserved.
+
+#ifndef AVLMAP_AVLMAP_BLOCKED_AVL_ITERATOR_HPP_
+#define AVLMAP_AVLMAP_BLOCKED_AVL_ITERATOR_HPP_
+
+#include <cstddef>
+#include <iterator>
+#include <utility>
+#include "node.hpp"
+
+
+template <typename Key, typename T, typename Compare, size_t Capacity,
+                                                        typename Balance>
+class BlockedAvl;
+
+
+// Position inside a block. Stepping past the last entry of the last block
+// leaves the iterator one past that entry, which is what end() returns.
+template <typename Key, typename T, size_t Capacity>
+class BlockedAvlIterator {
+ private:
+    template <typename, typename, typename, size_t, typename>
+    friend class BlockedAvl;
+
+    BlockNode<Key, T, Capacity> *block = nullptr;
+    size_t index = 0;
+
+    BlockedAvlIterator(BlockNode<Key, T, Capacity> *, size_t);
+
+    static BlockNode<Key, T, Capacity>* NextBlock(
+                                            BlockNode<Key, T, Capacity> *);
+    static BlockNode<Key, T, Capacity>* PrevBlock(
+                                            BlockNode<Key, T, Capacity> *);
+
+ public:
+    typedef std::bidirectional_iterator_tag iterator_category;
+    typedef std::pair<const Key, T> value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef std::pair<const Key, T>* pointer;
+    typedef std::pair<const Key, T>& reference;
+
+    BlockedAvlIterator() = default;
+
+    BlockedAvlIterator& operator++();
+    BlockedAvlIterator& operator--();
+    BlockedAvlIterator operator++(int);
+    BlockedAvlIterator operator--(int);
+    std::pair<const Key, T>& operator*() const;
+    std::pair<const Key, T>* operator->() const;
+    bool operator==(const BlockedAvlIterator &other) const;
+    bool operator!=(const BlockedAvlIterator &other) const;
+};
+
+
+template <typename Key, typename T, size_t Capacity>
+BlockedAvlIterator<Key, T, Capacity>::BlockedAvlIterator(
+        BlockNode<Key, T, Capacity> *b, size_t i) : block(b), index(i) {}
+
+
+template <typename Key, typename T, size_t Capacity>
+BlockedAvlIterator<Key, T, Capacity>&
+                        BlockedAvlIterator<Key, T, Capacity>::operator++() {
+    if (++index == block->count) {
+        BlockNode<Key, T, Capacity> *next = NextBlock(block);
+        if (next) {
+            block = next;
+            index = 0;
+        }
+    }
+
+    return *this;
+}
+
+
+template <typename Key, typename T, size_t Capacity>
+BlockedAvlIterator<Key, T, Capacity>&
+                        BlockedAvlIterator<Key, T, Capacity>::operator--() {
+    if (index == 0) {
+        block = PrevBlock(block);
+        index = block->count;
+    }
+    --index;
+
+    return *this;
+}
+
+
+template <typename Key, typename T, size_t Capacity>
+BlockedAvlIterator<Key, T, Capacity>
+                    BlockedAvlIterator<Key, T, Capacity>::operator++(int) {
+    BlockedAvlIterator<Key, T, Capacity> temp = *this;
+    ++(*this);
+
+    return temp;
+}
+
+
+template <typename Key, typename T, size_t Capacity>
+BlockedAvlIterator<Key, T, Capacity>
+                    BlockedAvlIterator<Key, T, Capacity>::operator--(int) {
+    BlockedAvlIterator<Key, T, Capacity> temp = *this;
+    --(*this);
+
+    return temp;
+}
+
+
+template <typename Key, typename T, size_t Capacity>
+std::pair<const Key, T>& BlockedAvlIterator<Key, T, Capacity>::operator*()
+                                                                        const {
+    return *block->entry(index);
+}
+
+
+template <typename Key, typename T, size_t Capacity>
+std::pair<const Key, T>* BlockedAvlIterator<Key, T, Capacity>::operator->()
+                                                                        const {
+    return block->entry(index);
+}
+
+
+template <typename Key, typename T, size_t Capacity>
+bool BlockedAvlIterator<Key, T, Capacity>::operator==(
+                                    const BlockedAvlIterator &other) const {
+    return block == other.block && index == other.index;
+}
+
+
+template <typename Key, typename T, size_t Capacity>
+bool BlockedAvlIterator<Key, T, Capacity>::operator!=(
+                                    const BlockedAvlIterator &other) const {
+    return !(*this == other);
+}
+
+
+template <typename Key, typename T, size_t Capacity>
+BlockNode<Key, T, Capacity>* BlockedAvlIterator<Key, T, Capacity>::NextBlock(
+                                        BlockNode<Key, T, Capacity> *node) {
+    if (node->right) {
+        node = node->right;
+        while (node->left) {
+            node = node->left;
+        }
+
+        return node;
+    }
+
+    BlockNode<Key, T, Capacity> *parent = node->prev;
+    while (parent && parent->right == node) {
+        node = parent;
+        parent = parent->prev;
+    }
+
+    return parent;
+}
+
+
+template <typename Key, typename T, size_t Capacity>
+BlockNode<Key, T, Capacity>* BlockedAvlIterator<Key, T, Capacity>::PrevBlock(
+                                        BlockNode<Key, T, Capacity> *node) {
+    if (node->left) {
+        node = node->left;
+        while (node->right) {
+            node = node->right;
+        }
+
+        return node;
+    }
+
+    BlockNode<Key, T, Capacity> *parent = node->prev;
+    while (parent && parent->left == node) {
+        node = parent;
+        parent = parent->prev;
+    }
+
+    return parent;
+}
+
+#endif  // AVLMAP_AVLMAP_BLOCKED_AVL_ITERATOR_HPP_
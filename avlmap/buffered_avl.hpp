@@ -0,0 +1,228 @@
+// Copyright (c) 2024 PlatinumSamurai. All rights reserved.
+
+#ifndef AVLMAP_AVLMAP_BUFFERED_AVL_HPP_
+#define AVLMAP_AVLMAP_BUFFERED_AVL_HPP_
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <optional>
+#include <utility>
+#include <vector>
+#include "avl.hpp"
+
+
+// Avl behind a write buffer for ingest bursts. Writes land in a flat array
+// kept sorted by key, placed by bisection instead of a descent through
+// scattered nodes; when it fills, or on flush(), it is merged in one cursor
+// sweep, so neighbouring writes share their path through warm nodes instead
+// of each starting from the root. Lookups check the tree, then bisect the
+// buffer and replay the writes to that key, so every write is visible right
+// away. A write shifts the entries after it, which the capacity bounds.
+template <typename Key, typename T, typename Compare = std::less<Key>>
+class BufferedAvl {
+ public:
+    typedef Avl<Key, T, Compare> Tree;
+
+    explicit BufferedAvl(size_t = 1024);
+    BufferedAvl(const BufferedAvl &) = delete;
+    BufferedAvl& operator=(const BufferedAvl &) = delete;
+
+    void insert(const std::pair<const Key, T> &);
+    void insert_or_assign(const std::pair<const Key, T> &);
+    void erase(const Key &);
+    std::optional<T> find(const Key &) const;
+    bool contains(const Key &) const;
+    void flush();
+    size_t pending() const;
+    size_t capacity() const;
+    size_t size();
+    Tree& merged();
+
+    template <typename F>
+    void for_each(F &&);
+
+ private:
+    enum class Op { insert, assign, erase };
+
+    struct Write {
+        Op op;
+        Key key;
+        std::optional<T> value;
+    };
+
+    Tree tree;
+    std::vector<Write> buffer;
+    size_t limit;
+    Compare cmp;
+
+    void Push(Op, const Key &, std::optional<T>);
+    std::vector<Write>::const_iterator Lower(const Key &) const;
+    const T* Resolve(const Key &) const;
+    bool Less(const Key &, const Key &) const;
+};
+
+
+template <typename Key, typename T, typename Compare>
+BufferedAvl<Key, T, Compare>::BufferedAvl(size_t capacity) :
+                                        limit(std::max<size_t>(capacity, 1)) {
+    buffer.reserve(limit);
+}
+
+
+// Goes after the writes already buffered for k, so they are replayed in the
+// order they were made.
+template <typename Key, typename T, typename Compare>
+void BufferedAvl<Key, T, Compare>::Push(Op op, const Key &k,
+                                                    std::optional<T> value) {
+    auto it = std::upper_bound(buffer.begin(), buffer.end(), k,
+                                [this](const Key &key, const Write &write) {
+        return Less(key, write.key);
+    });
+
+    buffer.insert(it, Write{op, k, std::move(value)});
+    if (buffer.size() >= limit) {
+        flush();
+    }
+}
+
+
+template <typename Key, typename T, typename Compare>
+bool BufferedAvl<Key, T, Compare>::Less(const Key &lhs,
+                                                    const Key &rhs) const {
+    return avl_less(cmp, lhs, rhs);
+}
+
+
+// First buffered write whose key does not order before k.
+template <typename Key, typename T, typename Compare>
+std::vector<typename BufferedAvl<Key, T, Compare>::Write>::const_iterator
+                BufferedAvl<Key, T, Compare>::Lower(const Key &k) const {
+    return std::lower_bound(buffer.begin(), buffer.end(), k,
+                                [this](const Write &write, const Key &key) {
+        return Less(write.key, key);
+    });
+}
+
+
+// The value k has once every buffered write is applied, or null. Points into
+// the tree or the buffer, so it is only good until the next write.
+template <typename Key, typename T, typename Compare>
+const T* BufferedAvl<Key, T, Compare>::Resolve(const Key &k) const {
+    auto it = tree.find(k);
+    const T *value = (it != tree.end() ? &(*it).second : nullptr);
+
+    for (auto write = Lower(k); write != buffer.end() &&
+                                    !Less(k, write->key); ++write) {
+        if (write->op == Op::erase) {
+            value = nullptr;
+        } else if (write->op == Op::assign || !value) {
+            value = &*write->value;
+        }
+    }
+
+    return value;
+}
+
+
+// Inserts the pair unless its key is present by the time it is merged,
+// like Avl::insert.
+template <typename Key, typename T, typename Compare>
+void BufferedAvl<Key, T, Compare>::insert(
+                                        const std::pair<const Key, T> &pair) {
+    Push(Op::insert, pair.first, pair.second);
+}
+
+
+template <typename Key, typename T, typename Compare>
+void BufferedAvl<Key, T, Compare>::insert_or_assign(
+                                        const std::pair<const Key, T> &pair) {
+    Push(Op::assign, pair.first, pair.second);
+}
+
+
+template <typename Key, typename T, typename Compare>
+void BufferedAvl<Key, T, Compare>::erase(const Key &k) {
+    Push(Op::erase, k, std::nullopt);
+}
+
+
+template <typename Key, typename T, typename Compare>
+std::optional<T> BufferedAvl<Key, T, Compare>::find(const Key &k) const {
+    const T *value = Resolve(k);
+
+    return (value ? std::optional<T>(*value) : std::nullopt);
+}
+
+
+template <typename Key, typename T, typename Compare>
+bool BufferedAvl<Key, T, Compare>::contains(const Key &k) const {
+    return Resolve(k);
+}
+
+
+// Merges the buffer into the tree, in key order and, for one key, in the
+// order the writes were made.
+template <typename Key, typename T, typename Compare>
+void BufferedAvl<Key, T, Compare>::flush() {
+    if (buffer.empty()) {
+        return;
+    }
+
+    auto cursor = tree.cursor();
+    for (Write &write : buffer) {
+        if (write.op == Op::erase) {
+            if (cursor.seek(write.key)) {
+                cursor.erase();
+            }
+        } else if (write.op == Op::assign) {
+            cursor.insert_or_assign({write.key, std::move(*write.value)});
+        } else {
+            cursor.insert({write.key, std::move(*write.value)});
+        }
+    }
+    buffer.clear();
+}
+
+
+template <typename Key, typename T, typename Compare>
+size_t BufferedAvl<Key, T, Compare>::pending() const {
+    return buffer.size();
+}
+
+
+template <typename Key, typename T, typename Compare>
+size_t BufferedAvl<Key, T, Compare>::capacity() const {
+    return limit;
+}
+
+
+// Flushes first: the buffer alone cannot tell how many keys are new.
+template <typename Key, typename T, typename Compare>
+size_t BufferedAvl<Key, T, Compare>::size() {
+    flush();
+
+    return tree.size();
+}
+
+
+// Flushes and hands out the tree for everything else Avl offers.
+template <typename Key, typename T, typename Compare>
+BufferedAvl<Key, T, Compare>::Tree& BufferedAvl<Key, T, Compare>::merged() {
+    flush();
+
+    return tree;
+}
+
+
+// Flushes and calls f with every pair in key order.
+template <typename Key, typename T, typename Compare>
+template <typename F>
+void BufferedAvl<Key, T, Compare>::for_each(F &&f) {
+    flush();
+    for (auto it = tree.begin(); it != tree.end(); ++it) {
+        f(*it);
+    }
+}
+
+#endif  // AVLMAP_AVLMAP_BUFFERED_AVL_HPP_
@@ -0,0 +1,209 @@
+// Copyright (c) 2024 PlatinumSamurai. All rights reserved.
+
+#ifndef AVLMAP_AVLMAP_FILTER_HPP_
+#define AVLMAP_AVLMAP_FILTER_HPP_
+
+#include <algorithm>
+#include <cmath>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+
+template <typename Key>
+concept Hashable = requires(const Key &k) {
+    { std::hash<Key>()(k) } -> std::convertible_to<size_t>;
+};
+
+
+// Sizing of a filter. The false-positive rate holds up to capacity keys;
+// max_bytes, when set, caps the memory and lets the rate rise instead.
+struct FilterOptions {
+    size_t capacity = 1024;
+    double fp_rate = 0.01;
+    size_t max_bytes = 0;
+};
+
+
+// Counting Bloom filter over 64-byte blocks of 4-bit counters. All probes of
+// a key land in one block, so a query touches a single cache line. Counters
+// make removal exact; one that reaches 15 sticks there and can only cost
+// false positives, never false negatives.
+template <typename Key, typename Hash = std::hash<Key>>
+class CountingBloomFilter {
+ public:
+    static constexpr size_t kBlockBytes = 64;
+    static constexpr unsigned kCounters = kBlockBytes * 2;
+
+    explicit CountingBloomFilter(const FilterOptions & = FilterOptions());
+
+    void add(const Key &);
+    void remove(const Key &);
+    bool may_contain(const Key &) const;
+    void reset();
+    size_t capacity() const;
+    size_t memory_usage() const;
+    unsigned probes() const;
+    const FilterOptions& options() const;
+
+ private:
+    struct alignas(kBlockBytes) Block {
+        uint64_t words[kBlockBytes / sizeof(uint64_t)];
+    };
+
+    std::vector<Block> blocks;
+    FilterOptions sizing;
+    unsigned count;
+
+    // Where the counters of one key are: a block, then 7-bit positions in
+    // it taken from bits, which is remixed when they run out.
+    struct Probes {
+        size_t block;
+        uint64_t bits;
+        unsigned left = 9;
+
+        unsigned next() {
+            if (!left) {
+                bits = Mix(bits);
+                left = 9;
+            }
+            unsigned counter = bits % kCounters;
+            bits >>= 7;
+            --left;
+
+            return counter;
+        }
+    };
+
+    static uint64_t Mix(uint64_t);
+    Probes Locate(const Key &) const;
+};
+
+
+template <typename Key, typename Hash>
+CountingBloomFilter<Key, Hash>::CountingBloomFilter(const FilterOptions &o) :
+                                                                sizing(o) {
+    // Keys spread unevenly over blocks, so a blocked filter needs more
+    // counters than a plain one for the same rate, and more so the lower
+    // the rate.
+    double ln2 = std::log(2.0);
+    double rate = std::clamp(sizing.fp_rate, 1e-9, 0.5);
+    double bits = -std::log(rate) / (ln2 * ln2) *
+                                            (1 - 0.15 * std::log10(rate));
+    size_t counters = size_t(std::ceil(std::max<size_t>(sizing.capacity, 1) *
+                                                                    bits));
+    size_t n = std::max<size_t>((counters + kCounters - 1) / kCounters, 1);
+
+    if (sizing.max_bytes) {
+        n = std::clamp<size_t>(sizing.max_bytes / kBlockBytes, 1, n);
+    }
+    blocks.assign(n, Block{});
+
+    double per_key = double(n * kCounters) /
+                                    std::max<size_t>(sizing.capacity, 1);
+    count = unsigned(std::clamp(std::lround(per_key * ln2) - 1, 1l, 16l));
+}
+
+
+// Spreads the bits of hashes like std::hash<int>, which is the identity.
+template <typename Key, typename Hash>
+uint64_t CountingBloomFilter<Key, Hash>::Mix(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+
+    return h;
+}
+
+
+template <typename Key, typename Hash>
+CountingBloomFilter<Key, Hash>::Probes CountingBloomFilter<Key, Hash>::Locate(
+                                                        const Key &k) const {
+    uint64_t h = Mix(Hash()(k));
+
+    return Probes{h % blocks.size(), Mix(h ^ 0x9e3779b97f4a7c15ull)};
+}
+
+
+template <typename Key, typename Hash>
+void CountingBloomFilter<Key, Hash>::add(const Key &k) {
+    Probes p = Locate(k);
+
+    for (unsigned i = 0; i < count; ++i) {
+        unsigned counter = p.next();
+        uint64_t &word = blocks[p.block].words[counter / 16];
+        unsigned shift = (counter % 16) * 4;
+        if (((word >> shift) & 0xf) != 0xf) {
+            word += uint64_t(1) << shift;
+        }
+    }
+}
+
+
+// k must have been added before.
+template <typename Key, typename Hash>
+void CountingBloomFilter<Key, Hash>::remove(const Key &k) {
+    Probes p = Locate(k);
+
+    for (unsigned i = 0; i < count; ++i) {
+        unsigned counter = p.next();
+        uint64_t &word = blocks[p.block].words[counter / 16];
+        unsigned shift = (counter % 16) * 4;
+        uint64_t value = (word >> shift) & 0xf;
+        if (value != 0 && value != 0xf) {
+            word -= uint64_t(1) << shift;
+        }
+    }
+}
+
+
+template <typename Key, typename Hash>
+bool CountingBloomFilter<Key, Hash>::may_contain(const Key &k) const {
+    Probes p = Locate(k);
+    const Block &block = blocks[p.block];
+
+    for (unsigned i = 0; i < count; ++i) {
+        unsigned counter = p.next();
+        if (!((block.words[counter / 16] >> (counter % 16) * 4) & 0xf)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+template <typename Key, typename Hash>
+void CountingBloomFilter<Key, Hash>::reset() {
+    std::fill(blocks.begin(), blocks.end(), Block{});
+}
+
+
+template <typename Key, typename Hash>
+size_t CountingBloomFilter<Key, Hash>::capacity() const {
+    return sizing.capacity;
+}
+
+
+template <typename Key, typename Hash>
+size_t CountingBloomFilter<Key, Hash>::memory_usage() const {
+    return blocks.size() * sizeof(Block);
+}
+
+
+template <typename Key, typename Hash>
+unsigned CountingBloomFilter<Key, Hash>::probes() const {
+    return count;
+}
+
+
+template <typename Key, typename Hash>
+const FilterOptions& CountingBloomFilter<Key, Hash>::options() const {
+    return sizing;
+}
+
+#endif  // AVLMAP_AVLMAP_FILTER_HPP_
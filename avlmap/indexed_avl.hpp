@@ -0,0 +1,617 @@
+// Copyright (c) 2024 PlatinumSamurai. All rights reserved.
+
+#ifndef AVLMAP_AVLMAP_INDEXED_AVL_HPP_
+#define AVLMAP_AVLMAP_INDEXED_AVL_HPP_
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include "node.hpp"
+#include "indexed_avl_iterator.hpp"
+#include "../format/format.hpp"
+
+
+// Same map interface as Avl, but every node lives in one contiguous vector
+// and links are 32-bit slot indices. Erased slots are recycled through a
+// free list, so growing the vector is the only thing that relocates nodes.
+// When Key and T are trivially copyable the node vector is copied with a
+// single memcpy.
+template <typename Key,
+          typename T,
+          typename Compare = std::less<Key>,
+          typename Allocator = std::allocator<std::pair<const Key, T>>
+          >
+class IndexedAvl {
+ private:
+    typedef std::vector<IndexedNode<Key, T>, typename std::allocator_traits<
+            Allocator>::template rebind_alloc<IndexedNode<Key, T>>> Storage;
+
+    static constexpr uint32_t npos = IndexedNode<Key, T>::npos;
+
+    Storage nodes;
+    uint32_t root;
+    uint32_t freeList;
+    size_t count;
+    Compare cmp;
+
+    void UpdateHeight(uint32_t);
+    int GetHeight(uint32_t) const;
+    int HeightDiff(uint32_t) const;
+
+    uint32_t LeftRot(uint32_t);
+    uint32_t RightRot(uint32_t);
+    void Rebalance(uint32_t);
+    void Replace(uint32_t, uint32_t, uint32_t);
+    uint32_t MinElem(uint32_t) const;
+    uint32_t MaxElem(uint32_t) const;
+    uint32_t Find(const Key &) const;
+    uint32_t CreateNode(const std::pair<const Key, T> &);
+    void FreeNode(uint32_t);
+    void Erase(uint32_t);
+
+ public:
+    typedef IndexedAvlIterator<Key, T, Storage> iterator;
+    typedef std::reverse_iterator<iterator> r_iterator;
+    typedef const iterator c_iterator;
+    typedef const std::reverse_iterator<iterator> cr_iterator;
+
+    IndexedAvl();
+    IndexedAvl(const Key &, T &&);
+    IndexedAvl(std::initializer_list<std::pair<const Key, T>>);
+    IndexedAvl(const IndexedAvl &) = default;
+    IndexedAvl(IndexedAvl &&) noexcept;
+    ~IndexedAvl() = default;
+
+    std::pair<iterator, bool> insert(const std::pair<const Key, T> &);
+    size_t erase(const Key &k);
+    auto erase(auto pos) -> decltype(pos);
+    bool empty() const;
+    size_t size() const;
+    void clear();
+    void reserve(size_t);
+    bool contains(const Key &k) const;
+    iterator find(const Key &k);
+    T& at(const Key &);
+    T& operator[](const Key &);
+    T& operator[](const Key &&);
+    IndexedAvl& operator=(const IndexedAvl &);
+    IndexedAvl& operator=(IndexedAvl &&) noexcept;
+
+    template <typename K, typename Value, typename Comp, typename Alloc>
+    friend std::ostream& operator<<(std::ostream &out,
+                            const IndexedAvl<K, Value, Comp, Alloc> &avl);
+    void printNode(std::ostream &out, uint32_t node, int offset) const;
+
+    iterator begin();
+    iterator end();
+    r_iterator rbegin();
+    r_iterator rend();
+    c_iterator begin() const;
+    c_iterator end() const;
+    cr_iterator rbegin() const;
+    cr_iterator rend() const;
+};
+
+
+template <typename Key, typename T, typename Compare, typename Allocator>
+IndexedAvl<Key, T, Compare, Allocator>::iterator
+                            IndexedAvl<Key, T, Compare, Allocator>::begin() {
+    return iterator(&nodes, &root, MinElem(root));
+}
+
+
+template <typename Key, typename T, typename Compare, typename Allocator>
+IndexedAvl<Key, T, Compare, Allocator>::iterator
+                            IndexedAvl<Key, T, Compare, Allocator>::end() {
+    return iterator(&nodes, &root, npos);
+}
+
+
+template <typename Key, typename T, typename Compare, typename Allocator>
+IndexedAvl<Key, T, Compare, Allocator>::r_iterator
+                            IndexedAvl<Key, T, Compare, Allocator>::rbegin() {
+    return r_iterator(end());
+}
+
+
+template <typename Key, typename T, typename Compare, typename Allocator>
+IndexedAvl<Key, T, Compare, Allocator>::r_iterator
+                            IndexedAvl<Key, T, Compare, Allocator>::rend() {
+    return r_iterator(begin());
+}
+
+
+template <typename Key, typename T, typename Compare, typename Allocator>
+IndexedAvl<Key, T, Compare, Allocator>::c_iterator
+                        IndexedAvl<Key, T, Compare, Allocator>::begin() const {
+    return iterator(const_cast<Storage *>(&nodes), &root, MinElem(root));
+}
+
+
+template <typename Key, typename T, typename Compare, typename Allocator>
+IndexedAvl<Key, T, Compare, Allocator>::c_iterator
+                        IndexedAvl<Key, T, Compare, Allocator>::end() const {
+    return iterator(const_cast<Storage *>(&nodes), &root, npos);
+}
+
+
+template <typename Key, typename T, typename Compare, typename Allocator>
+IndexedAvl<Key, T, Compare, Allocator>::cr_iterator
+                    IndexedAvl<Key, T, Compare, Allocator>::rbegin() const {
+    return cr_iterator(end());
+}
+
+
+template <typename Key, typename T, typename Compare, typename Allocator>
+IndexedAvl<Key, T, Compare, Allocator>::cr_iterator
+                    IndexedAvl<Key, T, Compare, Allocator>::rend() const {
+    return cr_iterator(begin());
+}
+
+
+template <typename Key, typename T, typename Compare, typename Allocator>
+uint32_t IndexedAvl<Key, T, Compare, Allocator>::LeftRot(uint32_t node) {
+    uint32_t temp = nodes[node].right;
+    nodes[node].right = nodes[temp].left;
+    if (nodes[node].right != npos) {
+        nodes[nodes[node].right].prev = node;
+    }
+
+    nodes[temp].left = node;
+    nodes[temp].prev = nodes[node].prev;
+    nodes[node].prev = temp;
+
+    UpdateHeight(node);
+    UpdateHeight(temp);
+
+    return temp;
+}
+
+
+template <typename Key, typename T, typename Compare, typename Allocator>
+uint32_t IndexedAvl<Key, T, Compare, Allocator>::RightRot(uint32_t node) {
+    uint32_t temp = nodes[node].left;
+    nodes[node].left = nodes[temp].right;
+    if (nodes[node].left != npos) {
+        nodes[nodes[node].left].prev = node;
+    }
+
+    nodes[temp].right = node;
+    nodes[temp].prev = nodes[node].prev;
+    nodes[node].prev = temp;
+
+    UpdateHeight(node);
+    UpdateHeight(temp);
+
+    return temp;
+}
+
+
+template <typename Key, typename T, typename Compare, typename Allocator>
+void IndexedAvl<Key, T, Compare, Allocator>::Replace(uint32_t parent,
+                                                uint32_t old, uint32_t node) {
+    if (parent == npos) {
+        root = node;
+    } else if (nodes[parent].left == old) {
+        nodes[parent].left = node;
+    } else {
+        nodes[parent].right = node;
+    }
+}
+
+
+template <typename Key, typename T, typename Compare, typename Allocator>
+void IndexedAvl<Key, T, Compare, Allocator>::Rebalance(uint32_t node) {
+    while (node != npos) {
+        uint32_t parent = nodes[node].prev;
+        int oldHeight = nodes[node].height;
+
+        UpdateHeight(node);
+        if (HeightDiff(node) == 2) {
+            if (HeightDiff(nodes[node].right) < 0) {
+                nodes[node].right = RightRot(nodes[node].right);
+            }
+            Replace(parent, node, LeftRot(node));
+        } else if (HeightDiff(node) == -2) {
+            if (HeightDiff(nodes[node].left) > 0) {
+                nodes[node].left = LeftRot(nodes[node].left);
+            }
+            Replace(parent, node, RightRot(node));
+        } else if (nodes[node].height == oldHeight) {
+            return;
+        }
+
+        node = parent;
+    }
+}
+
+
+template <typename Key, typename T, typename Compare, typename Allocator>
+uint32_t IndexedAvl<Key, T, Compare, Allocator>::MinElem(uint32_t node)
+                                                                        const {
+    if (node == npos) {
+        return npos;
+    }
+    while (nodes[node].left != npos) {
+        node = nodes[node].left;
+    }
+
+    return node;
+}
+
+
+template <typename Key, typename T, typename Compare, typename Allocator>
+uint32_t IndexedAvl<Key, T, Compare, Allocator>::MaxElem(uint32_t node)
+                                                                        const {
+    if (node == npos) {
+        return npos;
+    }
+    while (nodes[node].right != npos) {
+        node = nodes[node].right;
+    }
+
+    return node;
+}
+
+
+template <typename Key, typename T, typename Compare, typename Allocator>
+uint32_t IndexedAvl<Key, T, Compare, Allocator>::Find(const Key &k) const {
+    uint32_t node = root;
+
+    while (node != npos) {
+        const Key &current = nodes[node].pair()->first;
+        if (cmp(k, current)) {
+            node = nodes[node].left;
+        } else if (cmp(current, k)) {
+            node = nodes[node].right;
+        } else {
+            return node;
+        }
+    }
+
+    return npos;
+}
+
+
+template <typename Key, typename T, typename Compare, typename Allocator>
+uint32_t IndexedAvl<Key, T, Compare, Allocator>::CreateNode(
+                                        const std::pair<const Key, T> &pair) {
+    uint32_t node;
+
+    if (freeList != npos) {
+        node = freeList;
+        freeList = nodes[node].left;
+    } else {
+        if (nodes.size() >= npos) {
+            throw std::length_error("IndexedAvl::insert");
+        }
+        node = static_cast<uint32_t>(nodes.size());
+        nodes.emplace_back();
+    }
+
+    new(nodes[node].storage)std::pair<const Key, T>(pair.first, pair.second);
+    nodes[node].prev = npos;
+    nodes[node].left = npos;
+    nodes[node].right = npos;
+    nodes[node].height = 1;
+    ++count;
+
+    return node;
+}
+
+
+template <typename Key, typename T, typename Compare, typename Allocator>
+void IndexedAvl<Key, T, Compare, Allocator>::FreeNode(uint32_t node) {
+    std::destroy_at(nodes[node].pair());
+    nodes[node].height = 0;
+    nodes[node].prev = npos;
+    nodes[node].right = npos;
+    nodes[node].left = freeList;
+    freeList = node;
+    --count;
+}
+
+
+template <typename Key, typename T, typename Compare, typename Allocator>
+void IndexedAvl<Key, T, Compare, Allocator>::Erase(uint32_t node) {
+    uint32_t lsubtree = nodes[node].left;
+    uint32_t rsubtree = nodes[node].right;
+    uint32_t prev = nodes[node].prev;
+    uint32_t start;
+
+    if (lsubtree == npos || rsubtree == npos) {
+        uint32_t child = (lsubtree != npos ? lsubtree : rsubtree);
+        if (child != npos) {
+            nodes[child].prev = prev;
+        }
+        Replace(prev, node, child);
+        start = prev;
+    } else {
+        uint32_t rmin = MinElem(rsubtree);
+
+        if (rmin == rsubtree) {
+            start = rmin;
+        } else {
+            start = nodes[rmin].prev;
+            nodes[start].left = nodes[rmin].right;
+            if (nodes[rmin].right != npos) {
+                nodes[nodes[rmin].right].prev = start;
+            }
+            nodes[rmin].right = rsubtree;
+            nodes[rsubtree].prev = rmin;
+        }
+
+        nodes[rmin].left = lsubtree;
+        nodes[lsubtree].prev = rmin;
+        nodes[rmin].prev = prev;
+        nodes[rmin].height = nodes[node].height;
+        Replace(prev, node, rmin);
+    }
+
+    FreeNode(node);
+    Rebalance(start);
+}
+
+
+template <typename Key, typename T, typename Compare, typename Allocator>
+IndexedAvl<Key, T, Compare, Allocator>::IndexedAvl() : root(npos),
+                                                freeList(npos), count(0) {}
+
+
+template <typename Key, typename T, typename Compare, typename Allocator>
+IndexedAvl<Key, T, Compare, Allocator>::IndexedAvl(const Key &k, T &&val) :
+                                                                IndexedAvl() {
+    root = CreateNode(std::pair<const Key, T>(k, std::move(val)));
+}
+
+
+template <typename Key, typename T, typename Compare, typename Allocator>
+IndexedAvl<Key, T, Compare, Allocator>::IndexedAvl(
+        std::initializer_list<std::pair<const Key, T>> init) : IndexedAvl() {
+    nodes.reserve(init.size());
+    for (const auto &pair : init) {
+        insert(pair);
+    }
+}
+
+
+template <typename Key, typename T, typename Compare, typename Allocator>
+IndexedAvl<Key, T, Compare, Allocator>::IndexedAvl(IndexedAvl &&other)
+            noexcept : nodes(std::move(other.nodes)), root(other.root),
+                            freeList(other.freeList), count(other.count),
+                            cmp(std::move(other.cmp)) {
+    other.nodes.clear();
+    other.root = npos;
+    other.freeList = npos;
+    other.count = 0;
+}
+
+
+template <typename Key, typename T, typename Compare, typename Allocator>
+IndexedAvl<Key, T, Compare, Allocator>&
+        IndexedAvl<Key, T, Compare, Allocator>::operator=(
+                                                    const IndexedAvl &other) {
+    if (this != &other) {
+        IndexedAvl copy(other);
+        *this = std::move(copy);
+    }
+
+    return *this;
+}
+
+
+template <typename Key, typename T, typename Compare, typename Allocator>
+IndexedAvl<Key, T, Compare, Allocator>&
+        IndexedAvl<Key, T, Compare, Allocator>::operator=(
+                                            IndexedAvl &&other) noexcept {
+    if (this != &other) {
+        nodes.swap(other.nodes);
+        std::swap(root, other.root);
+        std::swap(freeList, other.freeList);
+        std::swap(count, other.count);
+        std::swap(cmp, other.cmp);
+        other.clear();
+    }
+
+    return *this;
+}
+
+
+template <typename Key, typename T, typename Compare, typename Allocator>
+std::pair<typename IndexedAvl<Key, T, Compare, Allocator>::iterator, bool>
+        IndexedAvl<Key, T, Compare, Allocator>::insert(
+                                        const std::pair<const Key, T> &pair) {
+    uint32_t subtree = root;
+    uint32_t parent = npos;
+    bool left = false;
+
+    while (subtree != npos) {
+        const Key &current = nodes[subtree].pair()->first;
+        parent = subtree;
+        if (cmp(pair.first, current)) {
+            subtree = nodes[subtree].left;
+            left = true;
+        } else if (cmp(current, pair.first)) {
+            subtree = nodes[subtree].right;
+            left = false;
+        } else {
+            return std::make_pair(iterator(&nodes, &root, subtree), false);
+        }
+    }
+
+    uint32_t temp = CreateNode(pair);
+    nodes[temp].prev = parent;
+    if (parent == npos) {
+        root = temp;
+    } else {
+        (left ? nodes[parent].left : nodes[parent].right) = temp;
+        Rebalance(parent);
+    }
+
+    return std::make_pair(iterator(&nodes, &root, temp), true);
+}
+
+
+template <typename Key, typename T, typename Compare, typename Allocator>
+size_t IndexedAvl<Key, T, Compare, Allocator>::erase(const Key &k) {
+    uint32_t node = Find(k);
+
+    if (node == npos) {
+        return 0;
+    }
+    Erase(node);
+
+    return 1;
+}
+
+
+template <typename Key, typename T, typename Compare, typename Allocator>
+auto IndexedAvl<Key, T, Compare, Allocator>::erase(auto pos)
+                                                        -> decltype(pos) {
+    if (pos == end()) {
+        return end();
+    }
+
+    auto it = pos + 1;
+    Erase(pos.index);
+
+    return it;
+}
+
+
+template <typename Key, typename T, typename Compare, typename Allocator>
+void IndexedAvl<Key, T, Compare, Allocator>::UpdateHeight(uint32_t node) {
+    int leftHeight = GetHeight(nodes[node].left);
+    int rightHeight = GetHeight(nodes[node].right);
+
+    nodes[node].height =
+                    (leftHeight > rightHeight ? leftHeight : rightHeight) + 1;
+}
+
+
+template <typename Key, typename T, typename Compare, typename Allocator>
+int IndexedAvl<Key, T, Compare, Allocator>::GetHeight(uint32_t node) const {
+    return (node != npos ? nodes[node].height : 0);
+}
+
+
+template <typename Key, typename T, typename Compare, typename Allocator>
+int IndexedAvl<Key, T, Compare, Allocator>::HeightDiff(uint32_t node) const {
+    return GetHeight(nodes[node].right) - GetHeight(nodes[node].left);
+}
+
+
+template <typename Key, typename T, typename Compare, typename Allocator>
+void IndexedAvl<Key, T, Compare, Allocator>::printNode(std::ostream &out,
+                                            uint32_t node, int offset) const {
+    if (node == npos) {
+        return;
+    }
+
+    for (int i = 0; i < offset; ++i) {
+        out << "\t";
+    }
+    out << format("{0} : {1}\n", nodes[node].pair()->first,
+                                                nodes[node].pair()->second);
+    printNode(out, nodes[node].right, offset + 1);
+    printNode(out, nodes[node].left, offset + 1);
+}
+
+
+template <typename Key, typename T, typename Compare, typename Allocator>
+bool IndexedAvl<Key, T, Compare, Allocator>::empty() const {
+    return root == npos;
+}
+
+
+template <typename Key, typename T, typename Compare, typename Allocator>
+size_t IndexedAvl<Key, T, Compare, Allocator>::size() const {
+    return count;
+}
+
+
+template <typename Key, typename T, typename Compare, typename Allocator>
+void IndexedAvl<Key, T, Compare, Allocator>::clear() {
+    nodes.clear();
+    root = npos;
+    freeList = npos;
+    count = 0;
+}
+
+
+template <typename Key, typename T, typename Compare, typename Allocator>
+void IndexedAvl<Key, T, Compare, Allocator>::reserve(size_t n) {
+    nodes.reserve(n);
+}
+
+
+template <typename Key, typename T, typename Compare, typename Allocator>
+bool IndexedAvl<Key, T, Compare, Allocator>::contains(const Key &k) const {
+    return Find(k) != npos;
+}
+
+
+template <typename Key, typename T, typename Compare, typename Allocator>
+IndexedAvl<Key, T, Compare, Allocator>::iterator
+            IndexedAvl<Key, T, Compare, Allocator>::find(const Key &k) {
+    return iterator(&nodes, &root, Find(k));
+}
+
+
+template <typename Key, typename T, typename Compare, typename Allocator>
+T& IndexedAvl<Key, T, Compare, Allocator>::at(const Key &k) {
+    uint32_t node = Find(k);
+
+    if (node == npos) {
+        throw std::out_of_range("IndexedAvl::at");
+    }
+
+    return nodes[node].pair()->second;
+}
+
+
+template <typename Key, typename T, typename Compare, typename Allocator>
+T& IndexedAvl<Key, T, Compare, Allocator>::operator[](const Key &k) {
+    return (*insert(std::make_pair(k, T())).first).second;
+}
+
+
+template <typename Key, typename T, typename Compare, typename Allocator>
+T& IndexedAvl<Key, T, Compare, Allocator>::operator[](const Key &&k) {
+    return (*insert(std::make_pair(k, T())).first).second;
+}
+
+
+template <typename Key, typename T, typename Compare, typename Allocator>
+bool operator==(const IndexedAvl<Key, T, Compare, Allocator> &lhs,
+                const IndexedAvl<Key, T, Compare, Allocator> &rhs) {
+    if (lhs.size() != rhs.size()) {
+        return false;
+    }
+
+    auto it1 = lhs.begin();
+    auto it2 = rhs.begin();
+    while (it1 != lhs.end()) {
+        if (*it1 != *it2) {
+            return false;
+        }
+        it1++;
+        it2++;
+    }
+
+    return true;
+}
+
+
+template <typename Key, typename T, typename Compare, typename Allocator>
+std::ostream& operator<<(std::ostream &out,
+                        const IndexedAvl<Key, T, Compare, Allocator> &avl) {
+    avl.printNode(out, avl.root, 0);
+
+    return out;
+}
+
+#endif  // AVLMAP_AVLMAP_INDEXED_AVL_HPP_
@@ -0,0 +1,207 @@
+// Copyright (c) 2024 PlatinumSamurai. All rights reserved.
+
+#ifndef AVLMAP_AVLMAP_INDEXED_AVL_ITERATOR_HPP_
+#define AVLMAP_AVLMAP_INDEXED_AVL_ITERATOR_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <utility>
+#include "node.hpp"
+
+
+template <typename Key, typename T, typename Compare, typename Allocator>
+class IndexedAvl;
+
+
+template <typename Key, typename T, typename Storage>
+class IndexedAvlIterator {
+ private:
+    template <typename, typename, typename, typename>
+    friend class IndexedAvl;
+
+    static constexpr uint32_t npos = IndexedNode<Key, T>::npos;
+
+    Storage *nodes = nullptr;
+    const uint32_t *root = nullptr;
+    uint32_t index = npos;
+
+    IndexedAvlIterator(Storage *, const uint32_t *, uint32_t);
+
+    uint32_t NextElem(uint32_t) const;
+    uint32_t PrevElem(uint32_t) const;
+
+ public:
+    typedef std::bidirectional_iterator_tag iterator_category;
+    typedef std::pair<const Key, T> value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef std::pair<const Key, T>* pointer;
+    typedef std::pair<const Key, T>& reference;
+
+    IndexedAvlIterator() = default;
+
+    IndexedAvlIterator& operator++();
+    IndexedAvlIterator& operator--();
+    IndexedAvlIterator operator++(int);
+    IndexedAvlIterator operator--(int);
+    IndexedAvlIterator& operator+=(unsigned);
+    std::pair<const Key, T>& operator*() const;
+    std::pair<const Key, T>* operator->() const;
+    bool operator==(const IndexedAvlIterator &other) const;
+    bool operator!=(const IndexedAvlIterator &other) const;
+};
+
+
+template <typename Key, typename T, typename Storage>
+IndexedAvlIterator<Key, T, Storage>::IndexedAvlIterator(Storage *n,
+                const uint32_t *r, uint32_t i) : nodes(n), root(r), index(i) {}
+
+
+template <typename Key, typename T, typename Storage>
+IndexedAvlIterator<Key, T, Storage>&
+                            IndexedAvlIterator<Key, T, Storage>::operator++() {
+    index = NextElem(index);
+
+    return *this;
+}
+
+
+template <typename Key, typename T, typename Storage>
+IndexedAvlIterator<Key, T, Storage>&
+                            IndexedAvlIterator<Key, T, Storage>::operator--() {
+    index = PrevElem(index);
+
+    return *this;
+}
+
+
+template <typename Key, typename T, typename Storage>
+IndexedAvlIterator<Key, T, Storage>
+                        IndexedAvlIterator<Key, T, Storage>::operator++(int) {
+    IndexedAvlIterator<Key, T, Storage> temp = *this;
+    index = NextElem(index);
+
+    return temp;
+}
+
+
+template <typename Key, typename T, typename Storage>
+IndexedAvlIterator<Key, T, Storage>
+                        IndexedAvlIterator<Key, T, Storage>::operator--(int) {
+    IndexedAvlIterator<Key, T, Storage> temp = *this;
+    index = PrevElem(index);
+
+    return temp;
+}
+
+
+template <typename Key, typename T, typename Storage>
+IndexedAvlIterator<Key, T, Storage> operator+(
+            const IndexedAvlIterator<Key, T, Storage> &it, unsigned n) {
+    IndexedAvlIterator<Key, T, Storage> temp = it;
+
+    for (unsigned i = 0; i < n; ++i) {
+        temp++;
+    }
+
+    return temp;
+}
+
+
+template <typename Key, typename T, typename Storage>
+IndexedAvlIterator<Key, T, Storage>&
+                IndexedAvlIterator<Key, T, Storage>::operator+=(unsigned n) {
+    for (unsigned i = 0; i < n; ++i) {
+        (*this)++;
+    }
+
+    return *this;
+}
+
+
+template <typename Key, typename T, typename Storage>
+std::pair<const Key, T>& IndexedAvlIterator<Key, T, Storage>::operator*()
+                                                                        const {
+    return *(*nodes)[index].pair();
+}
+
+
+template <typename Key, typename T, typename Storage>
+std::pair<const Key, T>* IndexedAvlIterator<Key, T, Storage>::operator->()
+                                                                        const {
+    return (*nodes)[index].pair();
+}
+
+
+template <typename Key, typename T, typename Storage>
+bool IndexedAvlIterator<Key, T, Storage>::operator==(
+                            const IndexedAvlIterator &other) const {
+    return index == other.index;
+}
+
+
+template <typename Key, typename T, typename Storage>
+bool IndexedAvlIterator<Key, T, Storage>::operator!=(
+                            const IndexedAvlIterator &other) const {
+    return index != other.index;
+}
+
+
+template <typename Key, typename T, typename Storage>
+uint32_t IndexedAvlIterator<Key, T, Storage>::NextElem(uint32_t node) const {
+    if (node == npos) {
+        return npos;
+    }
+
+    if ((*nodes)[node].right != npos) {
+        node = (*nodes)[node].right;
+        while ((*nodes)[node].left != npos) {
+            node = (*nodes)[node].left;
+        }
+
+        return node;
+    }
+
+    uint32_t parent = (*nodes)[node].prev;
+    while (parent != npos && (*nodes)[parent].right == node) {
+        node = parent;
+        parent = (*nodes)[node].prev;
+    }
+
+    return parent;
+}
+
+
+template <typename Key, typename T, typename Storage>
+uint32_t IndexedAvlIterator<Key, T, Storage>::PrevElem(uint32_t node) const {
+    if (node == npos) {
+        node = *root;
+        if (node == npos) {
+            return npos;
+        }
+        while ((*nodes)[node].right != npos) {
+            node = (*nodes)[node].right;
+        }
+
+        return node;
+    }
+
+    if ((*nodes)[node].left != npos) {
+        node = (*nodes)[node].left;
+        while ((*nodes)[node].right != npos) {
+            node = (*nodes)[node].right;
+        }
+
+        return node;
+    }
+
+    uint32_t parent = (*nodes)[node].prev;
+    while (parent != npos && (*nodes)[parent].left == node) {
+        node = parent;
+        parent = (*nodes)[node].prev;
+    }
+
+    return parent == npos ? node : parent;
+}
+
+#endif  // AVLMAP_AVLMAP_INDEXED_AVL_ITERATOR_HPP_
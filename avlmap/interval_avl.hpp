@@ -0,0 +1,212 @@
+// Copyright (c) 2024 PlatinumSamurai. All rights reserved.
+
+#ifndef AVLMAP_AVLMAP_INTERVAL_AVL_HPP_
+#define AVLMAP_AVLMAP_INTERVAL_AVL_HPP_
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include "avl.hpp"
+
+
+// Subtree aggregate of an interval tree: the largest right endpoint below a
+// node. An empty subtree has none, which orders before every point.
+template <typename Point>
+struct IntervalAugment {
+    typedef std::optional<Point> value_type;
+
+    static std::optional<Point> identity() {
+        return std::nullopt;
+    }
+
+    template <typename T>
+    static std::optional<Point> lift(const std::pair<Point, Point> &interval,
+                                                                    const T &) {
+        return interval.second;
+    }
+
+    static std::optional<Point> combine(const std::optional<Point> &lhs,
+                                        const std::optional<Point> &rhs) {
+        return std::max(lhs, rhs);
+    }
+};
+
+
+// Map from closed intervals [lo, hi] to values. Intervals are ordered by
+// (lo, hi), so equal intervals are one key. Queries step through the tree in
+// key order from one interval reaching the query start to the next, climbing
+// parent links and skipping every subtree whose largest endpoint ends before
+// the query, and stop at the first interval starting after it ends. Only
+// ancestors of matches and one boundary path are visited: O(log n + k) when
+// the matches are adjacent in key order, O(log n + k log(n / k)) at worst.
+// The flat O(log n + k) for any layout needs a centered or priority search
+// tree; a max-endpoint Avl cannot avoid the paths down to scattered matches.
+template <typename Point, typename T>
+class IntervalAvl {
+ public:
+    typedef std::pair<Point, Point> interval_type;
+
+ private:
+    typedef Avl<interval_type, T, std::less<interval_type>,
+                std::allocator<std::pair<const interval_type, T>>,
+                                        IntervalAugment<Point>> Tree;
+
+    Tree tree;
+
+    static Node<interval_type, T>* Reaching(Node<interval_type, T> *,
+                                                                const Point &);
+
+ public:
+    typedef typename Tree::iterator iterator;
+    typedef typename Tree::c_iterator c_iterator;
+
+    IntervalAvl() = default;
+    IntervalAvl(const IntervalAvl &) = delete;
+    IntervalAvl& operator=(const IntervalAvl &) = delete;
+
+    std::pair<iterator, bool> insert(const Point &, const Point &, const T &);
+    size_t erase(const Point &, const Point &);
+    iterator find(const Point &, const Point &);
+    bool empty() const;
+    size_t size() const;
+    void clear();
+
+    std::vector<iterator> overlapping(const Point &, const Point &);
+    std::vector<iterator> stabbing(const Point &);
+
+    iterator begin();
+    iterator end();
+    c_iterator begin() const;
+    c_iterator end() const;
+};
+
+
+template <typename Point, typename T>
+std::pair<typename IntervalAvl<Point, T>::iterator, bool>
+        IntervalAvl<Point, T>::insert(const Point &lo, const Point &hi,
+                                                            const T &value) {
+    if (hi < lo) {
+        throw std::invalid_argument("IntervalAvl::insert");
+    }
+
+    return tree.insert({interval_type(lo, hi), value});
+}
+
+
+template <typename Point, typename T>
+size_t IntervalAvl<Point, T>::erase(const Point &lo, const Point &hi) {
+    return (tree.extract(interval_type(lo, hi)).empty() ? 0 : 1);
+}
+
+
+template <typename Point, typename T>
+IntervalAvl<Point, T>::iterator IntervalAvl<Point, T>::find(const Point &lo,
+                                                            const Point &hi) {
+    return tree.find(interval_type(lo, hi));
+}
+
+
+template <typename Point, typename T>
+bool IntervalAvl<Point, T>::empty() const {
+    return tree.empty();
+}
+
+
+template <typename Point, typename T>
+size_t IntervalAvl<Point, T>::size() const {
+    return tree.size();
+}
+
+
+template <typename Point, typename T>
+void IntervalAvl<Point, T>::clear() {
+    tree.clear();
+}
+
+
+// First interval under node, in key order, whose right endpoint reaches a,
+// or null. Goes down a single path.
+template <typename Point, typename T>
+Node<typename IntervalAvl<Point, T>::interval_type, T>*
+        IntervalAvl<Point, T>::Reaching(Node<interval_type, T> *node,
+                                                            const Point &a) {
+    if (Tree::Aggregate(node) < a) {
+        return nullptr;
+    }
+
+    while (true) {
+        if (!(Tree::Aggregate(node->left) < a)) {
+            node = node->left;
+        } else if (!(node->pair->first.second < a)) {
+            return node;
+        } else {
+            node = node->right;
+        }
+    }
+}
+
+
+// Returns the intervals sharing at least one point with [a, b], in key order.
+// After the first descent, each next candidate is the leftmost reaching
+// interval of the right subtree, or else the nearest ancestor entered from
+// the left, so no path is walked twice.
+template <typename Point, typename T>
+std::vector<typename IntervalAvl<Point, T>::iterator>
+        IntervalAvl<Point, T>::overlapping(const Point &a, const Point &b) {
+    std::vector<iterator> found;
+    Node<interval_type, T> *node = Reaching(tree.root, a);
+
+    while (node && !(b < node->pair->first.first)) {
+        if (!(node->pair->first.second < a)) {
+            found.push_back(iterator(node));
+        }
+
+        Node<interval_type, T> *next = Reaching(node->right, a);
+        if (!next) {
+            while (node->prev && node == node->prev->right) {
+                node = node->prev;
+            }
+            next = node->prev;
+        }
+        node = next;
+    }
+
+    return found;
+}
+
+
+template <typename Point, typename T>
+std::vector<typename IntervalAvl<Point, T>::iterator>
+                        IntervalAvl<Point, T>::stabbing(const Point &p) {
+    return overlapping(p, p);
+}
+
+
+template <typename Point, typename T>
+IntervalAvl<Point, T>::iterator IntervalAvl<Point, T>::begin() {
+    return tree.begin();
+}
+
+
+template <typename Point, typename T>
+IntervalAvl<Point, T>::iterator IntervalAvl<Point, T>::end() {
+    return tree.end();
+}
+
+
+template <typename Point, typename T>
+IntervalAvl<Point, T>::c_iterator IntervalAvl<Point, T>::begin() const {
+    return tree.begin();
+}
+
+
+template <typename Point, typename T>
+IntervalAvl<Point, T>::c_iterator IntervalAvl<Point, T>::end() const {
+    return tree.end();
+}
+
+#endif  // AVLMAP_AVLMAP_INTERVAL_AVL_HPP_
@@ -0,0 +1,37 @@
+// Copyright (c) 2024 PlatinumSamurai. All rights reserved.
+
+#ifndef AVLMAP_AVLMAP_KEY_CACHE_HPP_
+#define AVLMAP_AVLMAP_KEY_CACHE_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+
+// Key cache policies for Avl. make() maps a key to a value stored in its
+// node; whenever two cached values differ, their order has to be the order
+// of the keys under the tree's comparator. Equal values say nothing and the
+// full keys are compared.
+
+
+// The first eight bytes of a string, big-endian and zero-padded, so that
+// unsigned integer order is the byte order std::string compares in. Keys
+// sharing a long common prefix (the same tenant, a fixed scheme) gain
+// nothing and pay for one extra integer comparison per level.
+struct StringPrefix {
+    typedef uint64_t value_type;
+
+    static uint64_t make(std::string_view key) {
+        uint64_t prefix = 0;
+        size_t n = (key.size() < 8 ? key.size() : 8);
+
+        for (size_t i = 0; i < n; ++i) {
+            prefix |= static_cast<uint64_t>(static_cast<unsigned char>(
+                                                    key[i])) << (56 - 8 * i);
+        }
+
+        return prefix;
+    }
+};
+
+#endif  // AVLMAP_AVLMAP_KEY_CACHE_HPP_
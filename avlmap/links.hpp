@@ -0,0 +1,203 @@
+// Copyright (c) 2024 PlatinumSamurai. All rights reserved.
+
+#ifndef AVLMAP_AVLMAP_LINKS_HPP_
+#define AVLMAP_AVLMAP_LINKS_HPP_
+
+#include <cstddef>
+#include <limits>
+
+
+// Link surgery shared by Avl and BlockedAvl, for any node with prev, left,
+// right and height links. Tree exposes root, leftmost and rightmost and
+// provides UpdateHeight() and Rebalance(), which picks up its Balance policy;
+// the trees wrap these as their own LeftRot, Unlink and so on.
+struct TreeLinks {
+    template <typename Tree, typename N>
+    static N* rotate_left(Tree &, N *);
+
+    template <typename Tree, typename N>
+    static N* rotate_right(Tree &, N *);
+
+    template <typename Tree, typename N>
+    static void replace(Tree &, N *, N *, N *);
+
+    template <typename N>
+    static N* min(N *);
+
+    template <typename N>
+    static N* max(N *);
+
+    template <typename Tree, typename N>
+    static N* splice_out(Tree &, N *);
+
+    template <typename Tree, typename N>
+    static void unlink(Tree &, N *);
+
+    template <typename N, typename Destroy>
+    static size_t clear(N *&, Destroy &&,
+                            size_t = std::numeric_limits<size_t>::max());
+};
+
+
+template <typename Tree, typename N>
+N* TreeLinks::rotate_left(Tree &tree, N *node) {
+    N *temp = node->right;
+    node->right = temp->left;
+    if (node->right) {
+        node->right->prev = node;
+    }
+
+    temp->left = node;
+    temp->prev = node->prev;
+    node->prev = temp;
+
+    tree.UpdateHeight(node);
+    tree.UpdateHeight(temp);
+
+    return temp;
+}
+
+
+template <typename Tree, typename N>
+N* TreeLinks::rotate_right(Tree &tree, N *node) {
+    N *temp = node->left;
+    node->left = temp->right;
+    if (node->left) {
+        node->left->prev = node;
+    }
+
+    temp->right = node;
+    temp->prev = node->prev;
+    node->prev = temp;
+
+    tree.UpdateHeight(node);
+    tree.UpdateHeight(temp);
+
+    return temp;
+}
+
+
+// Points whatever held old, parent's child link or the root, at node.
+template <typename Tree, typename N>
+void TreeLinks::replace(Tree &tree, N *parent, N *old, N *node) {
+    if (!parent) {
+        tree.root = node;
+    } else if (parent->left == old) {
+        parent->left = node;
+    } else {
+        parent->right = node;
+    }
+}
+
+
+template <typename N>
+N* TreeLinks::min(N *node) {
+    while (node && node->left) {
+        node = node->left;
+    }
+
+    return node;
+}
+
+
+template <typename N>
+N* TreeLinks::max(N *node) {
+    while (node && node->right) {
+        node = node->right;
+    }
+
+    return node;
+}
+
+
+// Takes out a node without a left child, its right subtree moving up in its
+// place, and returns its old parent.
+template <typename Tree, typename N>
+N* TreeLinks::splice_out(Tree &tree, N *node) {
+    N *parent = node->prev;
+
+    if (node->right) {
+        node->right->prev = parent;
+    }
+    replace(tree, parent, node, node->right);
+
+    return parent;
+}
+
+
+// Takes node out of the tree, its in-order successor taking its place when
+// it has two children, and rebalances from where the shape changed. The
+// node is left detached with height 1.
+template <typename Tree, typename N>
+void TreeLinks::unlink(Tree &tree, N *node) {
+    N *rsubtree = node->right;
+    N *lsubtree = node->left;
+    N *prev = node->prev;
+    N *start;
+
+    if (node == tree.leftmost) {
+        tree.leftmost = (rsubtree ? min(rsubtree) : prev);
+    }
+    if (node == tree.rightmost) {
+        tree.rightmost = (lsubtree ? max(lsubtree) : prev);
+    }
+
+    if (!lsubtree || !rsubtree) {
+        N *child = (lsubtree ? lsubtree : rsubtree);
+        if (child) {
+            child->prev = prev;
+        }
+        replace(tree, prev, node, child);
+        start = prev;
+    } else {
+        N *rmin = min(rsubtree);
+
+        if (rmin == rsubtree) {
+            start = rmin;
+        } else {
+            start = splice_out(tree, rmin);
+            rmin->right = rsubtree;
+            rsubtree->prev = rmin;
+        }
+
+        rmin->left = lsubtree;
+        lsubtree->prev = rmin;
+        rmin->prev = prev;
+        rmin->height = node->height;
+        replace(tree, prev, node, rmin);
+    }
+
+    node->prev = nullptr;
+    node->left = nullptr;
+    node->right = nullptr;
+    node->height = 1;
+
+    tree.Rebalance(start);
+}
+
+
+// Hands up to budget nodes of a detached tree to destroy, rotating left
+// subtrees up instead of recursing, and leaves node at what is left of it.
+// Returns the number destroyed.
+template <typename N, typename Destroy>
+size_t TreeLinks::clear(N *&node, Destroy &&destroy, size_t budget) {
+    size_t freed = 0;
+
+    while (node && freed < budget) {
+        if (node->left) {
+            N *lsubtree = node->left;
+            node->left = lsubtree->right;
+            lsubtree->right = node;
+            node = lsubtree;
+        } else {
+            N *rsubtree = node->right;
+            destroy(node);
+            node = rsubtree;
+            ++freed;
+        }
+    }
+
+    return freed;
+}
+
+#endif  // AVLMAP_AVLMAP_LINKS_HPP_
@@ -0,0 +1,183 @@
+// Copyright (c) 2024 PlatinumSamurai. All rights reserved.
+
+#ifndef AVLMAP_AVLMAP_MEMORY_HPP_
+#define AVLMAP_AVLMAP_MEMORY_HPP_
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+
+// Bytes held by one container, split by where they go.
+struct MemoryUsage {
+    size_t nodes = 0;     // node structs: links, height, cached fields
+    size_t pairs = 0;     // the key/value pairs themselves
+    size_t slack = 0;     // allocator rounding and headers around both
+    size_t deep = 0;      // heap owned by keys and values, per DeepSize
+    size_t filters = 0;   // lookup filters in front of the container
+
+    size_t total() const {
+        return nodes + pairs + slack + deep + filters;
+    }
+};
+
+
+// Marks the default DeepSize, which containers skip entirely.
+struct NoDeepSize {};
+
+
+// Heap memory a value owns beyond sizeof(T). Specialize it for key or value
+// types whose buffers should be counted; a tree over such types keeps each
+// entry's measured size in its node.
+template <typename T>
+struct DeepSize : NoDeepSize {
+    static size_t of(const T &) {
+        return 0;
+    }
+};
+
+
+// Ready-made measure for std::basic_string, to opt in with
+//   template <>
+//   struct DeepSize<std::string> : StringDeepSize<std::string> {};
+// Strings short enough for the inline buffer own no heap memory.
+template <typename String>
+struct StringDeepSize {
+    static size_t of(const String &s) {
+        auto data = reinterpret_cast<const char *>(s.data());
+        auto self = reinterpret_cast<const char *>(&s);
+        std::less<const char *> less;
+
+        if (!less(data, self) && less(data, self + sizeof(s))) {
+            return 0;
+        }
+
+        return (s.capacity() + 1) * sizeof(typename String::value_type);
+    }
+};
+
+
+// Bytes an allocator really takes out of the heap for a request of the
+// given size. The default follows glibc malloc: one word of header, chunks
+// rounded to two words, four words at least.
+template <typename Allocator>
+struct AllocationSize {
+    static constexpr size_t of(size_t bytes) {
+        constexpr size_t word = sizeof(size_t);
+
+        return std::max(4 * word, (bytes + word + 2 * word - 1) /
+                                                    (2 * word) * (2 * word));
+    }
+};
+
+
+// Whether several threads may allocate and deallocate through copies of
+// one allocator at once, which Avl::clone() needs to copy in parallel.
+// Specialize it for a thread-safe allocator of your own.
+template <typename Allocator>
+struct ConcurrentAllocator : std::false_type {};
+
+template <typename T>
+struct ConcurrentAllocator<std::allocator<T>> : std::true_type {};
+
+
+// Process-wide list of containers that asked to be tracked, so the biggest
+// ones can be found and dumped on demand. Sizes are read without locking the
+// containers: take each container's own lock around snapshot() if they are
+// written concurrently. A probe is called with the container's address, so
+// an entry stays valid when the container moves.
+class MemoryRegistry {
+ public:
+    typedef std::function<MemoryUsage(const void *)> Probe;
+
+    static MemoryRegistry& instance();
+
+    void add(const void *, const std::string &, Probe);
+    void remove(const void *);
+    void transfer(const void *, const void *);
+    std::vector<std::pair<std::string, MemoryUsage>> snapshot() const;
+    void dump(std::ostream &) const;
+
+ private:
+    mutable std::mutex lock;
+    std::map<const void *, std::pair<std::string, Probe>> entries;
+
+    MemoryRegistry() = default;
+};
+
+
+inline MemoryRegistry& MemoryRegistry::instance() {
+    static MemoryRegistry registry;
+
+    return registry;
+}
+
+
+inline void MemoryRegistry::add(const void *owner, const std::string &name,
+                                                                Probe probe) {
+    std::lock_guard<std::mutex> guard(lock);
+    entries[owner] = std::make_pair(name, std::move(probe));
+}
+
+
+inline void MemoryRegistry::remove(const void *owner) {
+    std::lock_guard<std::mutex> guard(lock);
+    entries.erase(owner);
+}
+
+
+// Hands the entry of a container that was moved from over to the one moved
+// into, under the same name, replacing any entry the latter had. Relinks
+// the existing map node, so it allocates nothing and suits a noexcept move.
+inline void MemoryRegistry::transfer(const void *from, const void *to) {
+    std::lock_guard<std::mutex> guard(lock);
+    auto entry = entries.extract(from);
+
+    if (!entry.empty()) {
+        entries.erase(to);
+        entry.key() = to;
+        entries.insert(std::move(entry));
+    }
+}
+
+
+// Returns every tracked container with its usage, largest first.
+inline std::vector<std::pair<std::string, MemoryUsage>>
+                                        MemoryRegistry::snapshot() const {
+    std::vector<std::pair<std::string, MemoryUsage>> usages;
+    std::lock_guard<std::mutex> guard(lock);
+
+    for (const auto &[owner, entry] : entries) {
+        usages.emplace_back(entry.first, entry.second(owner));
+    }
+    std::stable_sort(usages.begin(), usages.end(),
+                                        [](const auto &lhs, const auto &rhs) {
+        return lhs.second.total() > rhs.second.total();
+    });
+
+    return usages;
+}
+
+
+inline void MemoryRegistry::dump(std::ostream &out) const {
+    size_t total = 0;
+
+    for (const auto &[name, usage] : snapshot()) {
+        out << name << ": " << usage.total() << " bytes (nodes " <<
+                usage.nodes << ", pairs " << usage.pairs << ", slack " <<
+                usage.slack << ", deep " << usage.deep << ", filters " <<
+                usage.filters << ")\n";
+        total += usage.total();
+    }
+    out << "total: " << total << " bytes\n";
+}
+
+#endif  // AVLMAP_AVLMAP_MEMORY_HPP_
@@ -0,0 +1,601 @@
+// Copyright (c) 2024 PlatinumSamurai. All rights reserved.
+
+#ifndef AVLMAP_AVLMAP_MVCC_AVL_HPP_
+#define AVLMAP_AVLMAP_MVCC_AVL_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include "node.hpp"
+#include "avl.hpp"
+
+
+template <typename Key, typename T, typename Compare>
+class MvccSnapshot;
+
+
+template <typename Key, typename T, typename Compare>
+class MvccTransaction;
+
+
+// Ordered map with snapshot isolation. Each commit publishes a new version
+// of a persistent AVL tree built by path copying; readers pin a version with
+// one atomic load and never wait for writers. Transactions buffer their
+// writes in an Avl and apply them at commit, under a lock held only by
+// committers. A commit fails if another transaction wrote one of the same
+// keys since it began (first committer wins). Versions nobody holds any more
+// are freed as their last reference goes away.
+template <typename Key, typename T, typename Compare = std::less<Key>>
+class MvccAvl {
+ private:
+    template <typename, typename, typename>
+    friend class MvccSnapshot;
+    template <typename, typename, typename>
+    friend class MvccTransaction;
+
+    typedef PersistentNode<Key, T> NodeType;
+    typedef std::shared_ptr<const NodeType> Link;
+    typedef Avl<Key, std::optional<T>, Compare> WriteSet;
+
+    struct Version {
+        Link root;
+        uint64_t number;
+        size_t size;
+    };
+
+    std::atomic<std::shared_ptr<const Version>> current;
+    std::mutex writer;
+    Compare cmp;
+
+    static int Height(const Link &);
+    static Link Balance(Link, const std::pair<const Key, T> &, uint64_t, Link);
+    static Link EraseMin(const Link &);
+    static const NodeType* Find(const NodeType *, const Key &,
+                                                            const Compare &);
+    Link Insert(const Link &, const Key &, const T &, uint64_t, bool *) const;
+    Link Erase(const Link &, const Key &, bool *) const;
+    bool Commit(const std::shared_ptr<const Version> &, const WriteSet &);
+
+ public:
+    typedef MvccSnapshot<Key, T, Compare> snapshot_type;
+    typedef MvccTransaction<Key, T, Compare> transaction_type;
+
+    MvccAvl();
+    MvccAvl(const MvccAvl &) = delete;
+    MvccAvl& operator=(const MvccAvl &) = delete;
+
+    snapshot_type snapshot() const;
+    transaction_type begin_txn();
+    uint64_t version() const;
+    size_t size() const;
+    bool empty() const;
+};
+
+
+// A pinned version of an MvccAvl. It stays readable, and its nodes stay
+// alive, however many commits follow.
+template <typename Key, typename T, typename Compare>
+class MvccSnapshot {
+ private:
+    friend class MvccAvl<Key, T, Compare>;
+    friend class MvccTransaction<Key, T, Compare>;
+
+    typedef typename MvccAvl<Key, T, Compare>::Version Version;
+
+    std::shared_ptr<const Version> state;
+    Compare cmp;
+
+    MvccSnapshot(std::shared_ptr<const Version>, const Compare &);
+
+ public:
+    const T* find(const Key &) const;
+    bool contains(const Key &) const;
+    size_t size() const;
+    bool empty() const;
+    uint64_t version() const;
+
+    template <typename F>
+    void for_each(F) const;
+
+    template <typename K, typename Value, typename Comp>
+    friend std::vector<AvlChange<K, Value>> diff(
+                                        const MvccSnapshot<K, Value, Comp> &,
+                                        const MvccSnapshot<K, Value, Comp> &);
+};
+
+
+// Reads see the snapshot taken by begin_txn() plus the transaction's own
+// writes. Nothing is visible to others before commit().
+template <typename Key, typename T, typename Compare>
+class MvccTransaction {
+ private:
+    friend class MvccAvl<Key, T, Compare>;
+
+    MvccAvl<Key, T, Compare> *owner;
+    MvccSnapshot<Key, T, Compare> base;
+    typename MvccAvl<Key, T, Compare>::WriteSet writes;
+    bool open = true;
+
+    MvccTransaction(MvccAvl<Key, T, Compare> *,
+                                        MvccSnapshot<Key, T, Compare>);
+    void Check(const char *) const;
+
+ public:
+    MvccTransaction(MvccTransaction &&) = default;
+    MvccTransaction& operator=(MvccTransaction &&) = default;
+
+    const T* find(const Key &) const;
+    bool contains(const Key &) const;
+    bool insert(const std::pair<const Key, T> &);
+    void insert_or_assign(const std::pair<const Key, T> &);
+    size_t erase(const Key &);
+    bool commit();
+    void abort();
+    uint64_t version() const;
+};
+
+
+template <typename Key, typename T, typename Compare>
+MvccAvl<Key, T, Compare>::MvccAvl() :
+        current(std::make_shared<const Version>(Version{nullptr, 0, 0})) {}
+
+
+template <typename Key, typename T, typename Compare>
+int MvccAvl<Key, T, Compare>::Height(const Link &node) {
+    return (node ? node->height : 0);
+}
+
+
+// Builds a node over left and right, rotating once or twice if their
+// heights differ by two. Both sides are valid AVL trees already.
+template <typename Key, typename T, typename Compare>
+MvccAvl<Key, T, Compare>::Link MvccAvl<Key, T, Compare>::Balance(Link left,
+            const std::pair<const Key, T> &pair, uint64_t version, Link right) {
+    if (Height(left) > Height(right) + 1) {
+        if (Height(left->left) >= Height(left->right)) {
+            return std::make_shared<const NodeType>(left->left, left->pair,
+                    left->version, std::make_shared<const NodeType>(
+                                        left->right, pair, version, right));
+        }
+
+        const NodeType *middle = left->right.get();
+        return std::make_shared<const NodeType>(
+                std::make_shared<const NodeType>(left->left, left->pair,
+                                            left->version, middle->left),
+                middle->pair, middle->version,
+                std::make_shared<const NodeType>(middle->right, pair, version,
+                                                                    right));
+    }
+
+    if (Height(right) > Height(left) + 1) {
+        if (Height(right->right) >= Height(right->left)) {
+            return std::make_shared<const NodeType>(
+                    std::make_shared<const NodeType>(left, pair, version,
+                                                                right->left),
+                    right->pair, right->version, right->right);
+        }
+
+        const NodeType *middle = right->left.get();
+        return std::make_shared<const NodeType>(
+                std::make_shared<const NodeType>(left, pair, version,
+                                                                middle->left),
+                middle->pair, middle->version,
+                std::make_shared<const NodeType>(middle->right, right->pair,
+                                                right->version, right->right));
+    }
+
+    return std::make_shared<const NodeType>(std::move(left), pair, version,
+                                                            std::move(right));
+}
+
+
+template <typename Key, typename T, typename Compare>
+MvccAvl<Key, T, Compare>::Link MvccAvl<Key, T, Compare>::EraseMin(
+                                                            const Link &node) {
+    if (!node->left) {
+        return node->right;
+    }
+
+    return Balance(EraseMin(node->left), node->pair, node->version,
+                                                                node->right);
+}
+
+
+template <typename Key, typename T, typename Compare>
+const typename MvccAvl<Key, T, Compare>::NodeType*
+        MvccAvl<Key, T, Compare>::Find(const NodeType *node, const Key &k,
+                                                        const Compare &cmp) {
+    while (node) {
+        if (avl_less(cmp, k, node->pair.first)) {
+            node = node->left.get();
+        } else if (avl_less(cmp, node->pair.first, k)) {
+            node = node->right.get();
+        } else {
+            return node;
+        }
+    }
+
+    return nullptr;
+}
+
+
+// Returns a new root with k set to val, sharing every subtree off the path.
+template <typename Key, typename T, typename Compare>
+MvccAvl<Key, T, Compare>::Link MvccAvl<Key, T, Compare>::Insert(
+                const Link &node, const Key &k, const T &val, uint64_t version,
+                                                        bool *added) const {
+    if (!node) {
+        *added = true;
+        return std::make_shared<const NodeType>(nullptr,
+                            std::pair<const Key, T>(k, val), version, nullptr);
+    }
+
+    if (avl_less(cmp, k, node->pair.first)) {
+        return Balance(Insert(node->left, k, val, version, added),
+                                    node->pair, node->version, node->right);
+    }
+    if (avl_less(cmp, node->pair.first, k)) {
+        return Balance(node->left, node->pair, node->version,
+                                Insert(node->right, k, val, version, added));
+    }
+
+    return std::make_shared<const NodeType>(node->left,
+                        std::pair<const Key, T>(k, val), version, node->right);
+}
+
+
+// Returns a new root without k, or node itself if k is not there.
+template <typename Key, typename T, typename Compare>
+MvccAvl<Key, T, Compare>::Link MvccAvl<Key, T, Compare>::Erase(
+                        const Link &node, const Key &k, bool *removed) const {
+    if (!node) {
+        return node;
+    }
+
+    if (avl_less(cmp, k, node->pair.first)) {
+        Link left = Erase(node->left, k, removed);
+        return (left == node->left ? node : Balance(left, node->pair,
+                                                node->version, node->right));
+    }
+    if (avl_less(cmp, node->pair.first, k)) {
+        Link right = Erase(node->right, k, removed);
+        return (right == node->right ? node : Balance(node->left, node->pair,
+                                                        node->version, right));
+    }
+
+    *removed = true;
+    if (!node->left || !node->right) {
+        return (node->left ? node->left : node->right);
+    }
+
+    const NodeType *next = node->right.get();
+    while (next->left) {
+        next = next->left.get();
+    }
+
+    return Balance(node->left, next->pair, next->version,
+                                                    EraseMin(node->right));
+}
+
+
+// Applies writes on top of the newest version and publishes the result.
+// Fails without publishing if any written key changed after base.
+template <typename Key, typename T, typename Compare>
+bool MvccAvl<Key, T, Compare>::Commit(
+        const std::shared_ptr<const Version> &base, const WriteSet &writes) {
+    std::lock_guard<std::mutex> guard(writer);
+    std::shared_ptr<const Version> head = current.load();
+
+    if (head != base) {
+        for (auto it = writes.begin(); it != writes.end(); ++it) {
+            const NodeType *now = Find(head->root.get(), (*it).first, cmp);
+            const NodeType *then = Find(base->root.get(), (*it).first, cmp);
+            if (!now != !then || (now && now->version != then->version)) {
+                return false;
+            }
+        }
+    }
+
+    uint64_t number = head->number + 1;
+    Link root = head->root;
+    size_t size = head->size;
+
+    for (auto it = writes.begin(); it != writes.end(); ++it) {
+        bool changed = false;
+        if ((*it).second) {
+            root = Insert(root, (*it).first, *(*it).second, number, &changed);
+            size += changed;
+        } else {
+            root = Erase(root, (*it).first, &changed);
+            size -= changed;
+        }
+    }
+    current.store(std::make_shared<const Version>(Version{root, number, size}));
+
+    return true;
+}
+
+
+template <typename Key, typename T, typename Compare>
+MvccAvl<Key, T, Compare>::snapshot_type
+                                    MvccAvl<Key, T, Compare>::snapshot() const {
+    return snapshot_type(current.load(), cmp);
+}
+
+
+template <typename Key, typename T, typename Compare>
+MvccAvl<Key, T, Compare>::transaction_type
+                                    MvccAvl<Key, T, Compare>::begin_txn() {
+    return transaction_type(this, snapshot());
+}
+
+
+template <typename Key, typename T, typename Compare>
+uint64_t MvccAvl<Key, T, Compare>::version() const {
+    return current.load()->number;
+}
+
+
+template <typename Key, typename T, typename Compare>
+size_t MvccAvl<Key, T, Compare>::size() const {
+    return current.load()->size;
+}
+
+
+template <typename Key, typename T, typename Compare>
+bool MvccAvl<Key, T, Compare>::empty() const {
+    return size() == 0;
+}
+
+
+template <typename Key, typename T, typename Compare>
+MvccSnapshot<Key, T, Compare>::MvccSnapshot(std::shared_ptr<const Version> s,
+                            const Compare &c) : state(std::move(s)), cmp(c) {}
+
+
+template <typename Key, typename T, typename Compare>
+const T* MvccSnapshot<Key, T, Compare>::find(const Key &k) const {
+    auto node = MvccAvl<Key, T, Compare>::Find(state->root.get(), k, cmp);
+
+    return (node ? &node->pair.second : nullptr);
+}
+
+
+template <typename Key, typename T, typename Compare>
+bool MvccSnapshot<Key, T, Compare>::contains(const Key &k) const {
+    return find(k) != nullptr;
+}
+
+
+template <typename Key, typename T, typename Compare>
+size_t MvccSnapshot<Key, T, Compare>::size() const {
+    return state->size;
+}
+
+
+template <typename Key, typename T, typename Compare>
+bool MvccSnapshot<Key, T, Compare>::empty() const {
+    return state->size == 0;
+}
+
+
+template <typename Key, typename T, typename Compare>
+uint64_t MvccSnapshot<Key, T, Compare>::version() const {
+    return state->number;
+}
+
+
+// Calls f(pair) for every entry of the version, in key order.
+template <typename Key, typename T, typename Compare>
+template <typename F>
+void MvccSnapshot<Key, T, Compare>::for_each(F f) const {
+    std::vector<const PersistentNode<Key, T> *> path;
+    const PersistentNode<Key, T> *node = state->root.get();
+
+    while (node || !path.empty()) {
+        while (node) {
+            path.push_back(node);
+            node = node->left.get();
+        }
+        node = path.back();
+        path.pop_back();
+        f(node->pair);
+        node = node->right.get();
+    }
+}
+
+
+// Lists what turns version before into version after, in key order. Both
+// trees are walked in order side by side, unfolding the taller pending
+// subtree first; a subtree the two versions still share is skipped whole,
+// so versions a few commits apart compare in about O(changes * log n).
+template <typename Key, typename T, typename Compare>
+std::vector<AvlChange<Key, T>> diff(
+                            const MvccSnapshot<Key, T, Compare> &before,
+                            const MvccSnapshot<Key, T, Compare> &after) {
+    typedef PersistentNode<Key, T> NodeType;
+
+    // A subtree still to be unfolded, or a single node whose left subtree
+    // has been dealt with.
+    struct Pending {
+        const NodeType *node;
+        bool whole;
+    };
+
+    const Compare &cmp = before.cmp;
+    std::vector<AvlChange<Key, T>> result;
+    std::vector<Pending> lhs, rhs;
+    auto height = [](const std::vector<Pending> &path) {
+        return (path.back().whole ? path.back().node->height : 0);
+    };
+    auto unfold = [](std::vector<Pending> &path) {
+        const NodeType *node = path.back().node;
+        path.pop_back();
+        if (node->right) {
+            path.push_back({node->right.get(), true});
+        }
+        path.push_back({node, false});
+        if (node->left) {
+            path.push_back({node->left.get(), true});
+        }
+    };
+
+    if (before.state->root) {
+        lhs.push_back({before.state->root.get(), true});
+    }
+    if (after.state->root) {
+        rhs.push_back({after.state->root.get(), true});
+    }
+
+    while (!lhs.empty() && !rhs.empty()) {
+        const Pending &l = lhs.back();
+        const Pending &r = rhs.back();
+
+        if (l.node == r.node && l.whole == r.whole) {
+            lhs.pop_back();
+            rhs.pop_back();
+        } else if (l.whole || r.whole) {
+            unfold(height(lhs) >= height(rhs) ? lhs : rhs);
+        } else if (avl_less(cmp, l.node->pair.first, r.node->pair.first)) {
+            result.push_back({ChangeKind::erased, l.node->pair.first,
+                                        l.node->pair.second, std::nullopt});
+            lhs.pop_back();
+        } else if (avl_less(cmp, r.node->pair.first, l.node->pair.first)) {
+            result.push_back({ChangeKind::inserted, r.node->pair.first,
+                                        std::nullopt, r.node->pair.second});
+            rhs.pop_back();
+        } else {
+            if (!(l.node->pair.second == r.node->pair.second)) {
+                result.push_back({ChangeKind::modified, l.node->pair.first,
+                                l.node->pair.second, r.node->pair.second});
+            }
+            lhs.pop_back();
+            rhs.pop_back();
+        }
+    }
+
+    while (!lhs.empty()) {
+        if (lhs.back().whole) {
+            unfold(lhs);
+            continue;
+        }
+        const NodeType *node = lhs.back().node;
+        result.push_back({ChangeKind::erased, node->pair.first,
+                                            node->pair.second, std::nullopt});
+        lhs.pop_back();
+    }
+    while (!rhs.empty()) {
+        if (rhs.back().whole) {
+            unfold(rhs);
+            continue;
+        }
+        const NodeType *node = rhs.back().node;
+        result.push_back({ChangeKind::inserted, node->pair.first,
+                                            std::nullopt, node->pair.second});
+        rhs.pop_back();
+    }
+
+    return result;
+}
+
+
+template <typename Key, typename T, typename Compare>
+MvccTransaction<Key, T, Compare>::MvccTransaction(
+                        MvccAvl<Key, T, Compare> *o,
+                        MvccSnapshot<Key, T, Compare> s) : owner(o), base(s) {}
+
+
+template <typename Key, typename T, typename Compare>
+void MvccTransaction<Key, T, Compare>::Check(const char *where) const {
+    if (!open) {
+        throw std::logic_error(where);
+    }
+}
+
+
+template <typename Key, typename T, typename Compare>
+const T* MvccTransaction<Key, T, Compare>::find(const Key &k) const {
+    auto it = writes.find(k);
+
+    if (it != writes.end()) {
+        return ((*it).second ? &*(*it).second : nullptr);
+    }
+
+    return base.find(k);
+}
+
+
+template <typename Key, typename T, typename Compare>
+bool MvccTransaction<Key, T, Compare>::contains(const Key &k) const {
+    return find(k) != nullptr;
+}
+
+
+template <typename Key, typename T, typename Compare>
+bool MvccTransaction<Key, T, Compare>::insert(
+                                        const std::pair<const Key, T> &pair) {
+    Check("MvccTransaction::insert");
+    if (contains(pair.first)) {
+        return false;
+    }
+    writes.insert_or_assign({pair.first, pair.second});
+
+    return true;
+}
+
+
+template <typename Key, typename T, typename Compare>
+void MvccTransaction<Key, T, Compare>::insert_or_assign(
+                                        const std::pair<const Key, T> &pair) {
+    Check("MvccTransaction::insert_or_assign");
+    writes.insert_or_assign({pair.first, pair.second});
+}
+
+
+template <typename Key, typename T, typename Compare>
+size_t MvccTransaction<Key, T, Compare>::erase(const Key &k) {
+    Check("MvccTransaction::erase");
+    if (!contains(k)) {
+        return 0;
+    }
+    writes.insert_or_assign({k, std::nullopt});
+
+    return 1;
+}
+
+
+// Publishes every write as one new version. Returns false, publishing
+// nothing, if another transaction committed a write to one of the same keys
+// after this one began; the caller may retry with a fresh transaction.
+template <typename Key, typename T, typename Compare>
+bool MvccTransaction<Key, T, Compare>::commit() {
+    Check("MvccTransaction::commit");
+    open = false;
+
+    bool committed = writes.empty() || owner->Commit(base.state, writes);
+    writes.clear();
+
+    return committed;
+}
+
+
+template <typename Key, typename T, typename Compare>
+void MvccTransaction<Key, T, Compare>::abort() {
+    open = false;
+    writes.clear();
+}
+
+
+template <typename Key, typename T, typename Compare>
+uint64_t MvccTransaction<Key, T, Compare>::version() const {
+    return base.version();
+}
+
+#endif  // AVLMAP_AVLMAP_MVCC_AVL_HPP_
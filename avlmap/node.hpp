@@ -3,6 +3,13 @@
 #ifndef AVLMAP_AVLMAP_NODE_HPP_
 #define AVLMAP_AVLMAP_NODE_HPP_
 
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <new>
+#include <type_traits>
 #include <utility>
 
 
@@ -29,11 +36,310 @@ struct Node {
 };
 
 
+// Default policy: plain nodes, no per-subtree aggregate.
+struct NoAugment {};
+
+
+// Node carrying Augment's aggregate of its whole subtree. Avl allocates these
+// instead of plain nodes and only ever reaches the field through a cast.
+template <typename Key, typename T, typename Augment>
+struct AugmentedNode : Node<Key, T> {
+    typename Augment::value_type aggregate;
+};
+
+
+// Default policy: branch decisions always read the full key.
+struct NoKeyCache {};
+
+
+// Node carrying a KeyCache summary of its own key next to the links, so a
+// descent can often branch without touching the pair or the key's buffer.
+template <typename Base, typename KeyCache>
+struct CachedKeyNode : Base {
+    typename KeyCache::value_type cached;
+};
+
+
+// Node remembering the heap bytes its entry was last measured at, so the
+// tree can take back exactly what it counted.
+template <typename Base>
+struct SizedNode : Base {
+    size_t deep;
+};
+
+
+// Immutable node of MvccAvl. Updates copy the path to a node instead of
+// changing it, so every published root stays a complete tree for as long as
+// a reader holds it. version is the commit that last wrote the entry.
+template <typename Key, typename T>
+struct PersistentNode {
+    std::shared_ptr<const PersistentNode> left;
+    std::shared_ptr<const PersistentNode> right;
+    std::pair<const Key, T> pair;
+    uint64_t version;
+    int height;
+
+    PersistentNode(std::shared_ptr<const PersistentNode> l,
+                    const std::pair<const Key, T> &p, uint64_t v,
+                    std::shared_ptr<const PersistentNode> r) :
+                            left(std::move(l)), right(std::move(r)), pair(p),
+                            version(v) {
+        height = 1 + std::max(left ? left->height : 0,
+                                                right ? right->height : 0);
+    }
+};
+
+
 template <typename Key, typename T>
 bool operator==(const Node<Key, T> &lhs, const Node<Key, T> &rhs) {
     return *(lhs.pair) == *(rhs.pair);
 }
 
 
+template <typename Key, typename T>
+struct IndexedNode {
+    static constexpr uint32_t npos = std::numeric_limits<uint32_t>::max();
+    static constexpr bool trivial = std::is_trivially_copyable_v<Key> &&
+                                        std::is_trivially_copyable_v<T>;
+
+    alignas(std::pair<const Key, T>)
+                    unsigned char storage[sizeof(std::pair<const Key, T>)];
+    uint32_t prev;
+    uint32_t left;
+    uint32_t right;
+    int height;
+
+    IndexedNode() : prev(npos), left(npos), right(npos), height(0) {}
+
+    IndexedNode(const IndexedNode &) requires trivial = default;
+    IndexedNode(const IndexedNode &other) requires (!trivial) :
+                    prev(other.prev), left(other.left), right(other.right),
+                    height(other.height) {
+        if (height) {
+            new(storage)std::pair<const Key, T>(*other.pair());
+        }
+    }
+
+    IndexedNode(IndexedNode &&) requires trivial = default;
+    IndexedNode(IndexedNode &&other) noexcept requires (!trivial) :
+                    prev(other.prev), left(other.left), right(other.right),
+                    height(other.height) {
+        if (height) {
+            new(storage)std::pair<const Key, T>(std::move(*other.pair()));
+        }
+    }
+
+    IndexedNode& operator=(const IndexedNode &) requires trivial = default;
+    IndexedNode& operator=(IndexedNode &&) requires trivial = default;
+
+    ~IndexedNode() requires trivial = default;
+    ~IndexedNode() requires (!trivial) {
+        if (height) {
+            std::destroy_at(pair());
+        }
+    }
+
+    std::pair<const Key, T>* pair() {
+        return std::launder(reinterpret_cast<std::pair<const Key, T> *>(
+                                                                    storage));
+    }
+    const std::pair<const Key, T>* pair() const {
+        return std::launder(reinterpret_cast<const std::pair<const Key, T> *>(
+                                                                    storage));
+    }
+};
+
+
+// Node of BlockedAvl: up to Capacity entries in key order, all greater than
+// the entries of the left subtree and less than those of the right one.
+template <typename Key, typename T, size_t Capacity>
+struct BlockNode {
+    BlockNode *prev = nullptr;
+    BlockNode *left = nullptr;
+    BlockNode *right = nullptr;
+    int height = 1;
+    uint32_t count = 0;
+    alignas(std::pair<const Key, T>) unsigned char
+                        storage[Capacity * sizeof(std::pair<const Key, T>)];
+
+    BlockNode() = default;
+    BlockNode(const BlockNode &) = delete;
+    BlockNode& operator=(const BlockNode &) = delete;
+
+    ~BlockNode() {
+        for (size_t i = 0; i < count; ++i) {
+            std::destroy_at(entry(i));
+        }
+    }
+
+    void* slot(size_t i) {
+        return storage + i * sizeof(std::pair<const Key, T>);
+    }
+
+    std::pair<const Key, T>* entry(size_t i) {
+        return std::launder(reinterpret_cast<std::pair<const Key, T> *>(
+                                                                slot(i)));
+    }
+};
+
+
+// Values sharing one key in AvlMultimap, in insertion order. The first
+// chunk lives inline in the mapped value, so a key with few duplicates costs
+// nothing beyond its node; longer runs continue in heap-allocated chunks.
+template <typename T, size_t N>
+class DuplicateRun {
+ public:
+    struct Chunk {
+        alignas(T) unsigned char storage[N * sizeof(T)];
+        size_t count = 0;
+        Chunk *next = nullptr;
+
+        void* slot(size_t i) {
+            return storage + i * sizeof(T);
+        }
+
+        T& at(size_t i) {
+            return *std::launder(reinterpret_cast<T *>(slot(i)));
+        }
+
+        const T& at(size_t i) const {
+            return *std::launder(reinterpret_cast<const T *>(storage +
+                                                            i * sizeof(T)));
+        }
+    };
+
+ private:
+    Chunk head;
+    Chunk *tail = &head;
+    size_t total = 0;
+
+ public:
+    DuplicateRun() = default;
+    DuplicateRun(const DuplicateRun &);
+    DuplicateRun(DuplicateRun &&)
+                            noexcept(std::is_nothrow_move_constructible_v<T>);
+    DuplicateRun& operator=(const DuplicateRun &) = delete;
+    DuplicateRun& operator=(DuplicateRun &&) = delete;
+    ~DuplicateRun();
+
+    void push_back(const T &);
+    void erase(Chunk *, size_t);
+    size_t size() const;
+    Chunk* front();
+    Chunk* back();
+};
+
+
+template <typename T, size_t N>
+DuplicateRun<T, N>::DuplicateRun(const DuplicateRun &other) {
+    for (const Chunk *chunk = &other.head; chunk; chunk = chunk->next) {
+        for (size_t i = 0; i < chunk->count; ++i) {
+            push_back(chunk->at(i));
+        }
+    }
+}
+
+
+template <typename T, size_t N>
+DuplicateRun<T, N>::DuplicateRun(DuplicateRun &&other)
+                    noexcept(std::is_nothrow_move_constructible_v<T>) {
+    for (size_t i = 0; i < other.head.count; ++i) {
+        new(head.slot(i)) T(std::move(other.head.at(i)));
+        std::destroy_at(&other.head.at(i));
+    }
+    head.count = other.head.count;
+    head.next = other.head.next;
+    tail = (other.tail == &other.head ? &head : other.tail);
+    total = other.total;
+
+    other.head.count = 0;
+    other.head.next = nullptr;
+    other.tail = &other.head;
+    other.total = 0;
+}
+
+
+template <typename T, size_t N>
+DuplicateRun<T, N>::~DuplicateRun() {
+    Chunk *chunk = &head;
+
+    while (chunk) {
+        Chunk *next = chunk->next;
+        for (size_t i = 0; i < chunk->count; ++i) {
+            std::destroy_at(&chunk->at(i));
+        }
+        if (chunk != &head) {
+            delete chunk;
+        }
+        chunk = next;
+    }
+}
+
+
+template <typename T, size_t N>
+void DuplicateRun<T, N>::push_back(const T &value) {
+    if (tail->count == N) {
+        tail->next = new Chunk();
+        tail = tail->next;
+    }
+
+    new(tail->slot(tail->count)) T(value);
+    ++tail->count;
+    ++total;
+}
+
+
+// Shifts everything after (chunk, i) one slot towards the front, so the
+// order of the remaining values is kept and only the tail chunk shrinks.
+template <typename T, size_t N>
+void DuplicateRun<T, N>::erase(Chunk *chunk, size_t i) {
+    while (true) {
+        Chunk *next = chunk;
+        size_t j = i + 1;
+        if (j == chunk->count) {
+            next = chunk->next;
+            j = 0;
+        }
+        if (!next) {
+            break;
+        }
+        chunk->at(i) = std::move(next->at(j));
+        chunk = next;
+        i = j;
+    }
+
+    std::destroy_at(&chunk->at(i));
+    --chunk->count;
+    --total;
+
+    if (chunk->count == 0 && chunk != &head) {
+        Chunk *prev = &head;
+        while (prev->next != chunk) {
+            prev = prev->next;
+        }
+        prev->next = nullptr;
+        tail = prev;
+        delete chunk;
+    }
+}
+
+
+template <typename T, size_t N>
+size_t DuplicateRun<T, N>::size() const {
+    return total;
+}
+
+
+template <typename T, size_t N>
+DuplicateRun<T, N>::Chunk* DuplicateRun<T, N>::front() {
+    return &head;
+}
+
+
+template <typename T, size_t N>
+DuplicateRun<T, N>::Chunk* DuplicateRun<T, N>::back() {
+    return tail;
+}
+
 #endif  // AVLMAP_AVLMAP_NODE_HPP_
 
@@ -0,0 +1,133 @@
+// Copyright (c) 2024 PlatinumSamurai. All rights reserved.
+
+#ifndef AVLMAP_AVLMAP_NODE_HANDLE_HPP_
+#define AVLMAP_AVLMAP_NODE_HANDLE_HPP_
+
+#include <memory>
+#include <utility>
+#include "node.hpp"
+
+
+// Owns a node unlinked from an Avl by extract(). The key may be changed
+// while the node is detached; insert(node_type &&) links the same node
+// back without allocating.
+template <typename Key, typename T, typename Allocator,
+                                        typename NodeType = Node<Key, T>>
+class AvlNodeHandle {
+ private:
+    template <typename, typename, typename, typename, typename, typename,
+                                                                       typename>
+    friend class Avl;
+
+    Node<Key, T> *node = nullptr;
+    Allocator alloc;
+
+    AvlNodeHandle(Node<Key, T> *, const Allocator &);
+    Node<Key, T>* release();
+
+ public:
+    typedef Key key_type;
+    typedef T mapped_type;
+    typedef Allocator allocator_type;
+
+    AvlNodeHandle() = default;
+    AvlNodeHandle(AvlNodeHandle &&) noexcept;
+    AvlNodeHandle(const AvlNodeHandle &) = delete;
+    ~AvlNodeHandle();
+
+    AvlNodeHandle& operator=(AvlNodeHandle &&) noexcept;
+    AvlNodeHandle& operator=(const AvlNodeHandle &) = delete;
+
+    bool empty() const;
+    explicit operator bool() const;
+    Key& key() const;
+    T& mapped() const;
+    allocator_type get_allocator() const;
+    void swap(AvlNodeHandle &) noexcept;
+};
+
+
+template <typename Key, typename T, typename Allocator, typename NodeType>
+AvlNodeHandle<Key, T, Allocator, NodeType>::AvlNodeHandle(Node<Key, T> *n,
+                                const Allocator &a) : node(n), alloc(a) {}
+
+
+template <typename Key, typename T, typename Allocator, typename NodeType>
+AvlNodeHandle<Key, T, Allocator, NodeType>::AvlNodeHandle(AvlNodeHandle &&other)
+                    noexcept : node(other.node), alloc(std::move(other.alloc)) {
+    other.node = nullptr;
+}
+
+
+template <typename Key, typename T, typename Allocator, typename NodeType>
+AvlNodeHandle<Key, T, Allocator, NodeType>::~AvlNodeHandle() {
+    if (node) {
+        std::destroy_n(node->pair, 1);
+        alloc.deallocate(node->pair, 1);
+
+        typename std::allocator_traits<Allocator>::template
+                                    rebind_alloc<NodeType> nodes(alloc);
+        std::destroy_at(static_cast<NodeType *>(node));
+        nodes.deallocate(static_cast<NodeType *>(node), 1);
+    }
+}
+
+
+template <typename Key, typename T, typename Allocator, typename NodeType>
+AvlNodeHandle<Key, T, Allocator, NodeType>&
+                    AvlNodeHandle<Key, T, Allocator, NodeType>::operator=(
+                                            AvlNodeHandle &&other) noexcept {
+    AvlNodeHandle temp(std::move(other));
+    swap(temp);
+
+    return *this;
+}
+
+
+template <typename Key, typename T, typename Allocator, typename NodeType>
+Node<Key, T>* AvlNodeHandle<Key, T, Allocator, NodeType>::release() {
+    Node<Key, T> *temp = node;
+    node = nullptr;
+
+    return temp;
+}
+
+
+template <typename Key, typename T, typename Allocator, typename NodeType>
+bool AvlNodeHandle<Key, T, Allocator, NodeType>::empty() const {
+    return node == nullptr;
+}
+
+
+template <typename Key, typename T, typename Allocator, typename NodeType>
+AvlNodeHandle<Key, T, Allocator, NodeType>::operator bool() const {
+    return node != nullptr;
+}
+
+
+template <typename Key, typename T, typename Allocator, typename NodeType>
+Key& AvlNodeHandle<Key, T, Allocator, NodeType>::key() const {
+    return const_cast<Key &>(node->pair->first);
+}
+
+
+template <typename Key, typename T, typename Allocator, typename NodeType>
+T& AvlNodeHandle<Key, T, Allocator, NodeType>::mapped() const {
+    return node->pair->second;
+}
+
+
+template <typename Key, typename T, typename Allocator, typename NodeType>
+Allocator AvlNodeHandle<Key, T, Allocator, NodeType>::get_allocator() const {
+    return alloc;
+}
+
+
+template <typename Key, typename T, typename Allocator, typename NodeType>
+void AvlNodeHandle<Key, T, Allocator, NodeType>::swap(
+                                        AvlNodeHandle &other) noexcept {
+    std::swap(node, other.node);
+    std::swap(alloc, other.alloc);
+}
+
+#endif  // AVLMAP_AVLMAP_NODE_HANDLE_HPP_
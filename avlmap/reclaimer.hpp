@@ -0,0 +1,111 @@
+// Copyright (c) 2024 PlatinumSamurai. All rights reserved.
+
+#ifndef AVLMAP_AVLMAP_RECLAIMER_HPP_
+#define AVLMAP_AVLMAP_RECLAIMER_HPP_
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+
+// Process-wide background thread for teardown work containers hand off, so
+// the thread that drops a large structure does not wait for it to be freed.
+// Jobs run one at a time in the order they were posted; the ones still
+// queued at exit run before the thread is joined.
+class Reclaimer {
+ public:
+    typedef std::function<void()> Job;
+
+    static Reclaimer& instance();
+
+    void post(Job);
+    void drain();
+    size_t pending() const;
+
+ private:
+    mutable std::mutex lock;
+    std::condition_variable wake;
+    std::condition_variable idle;
+    std::deque<Job> jobs;
+    size_t busy = 0;
+    bool stopping = false;
+    std::thread worker;
+
+    Reclaimer();
+    ~Reclaimer();
+
+    void Run();
+};
+
+
+inline Reclaimer& Reclaimer::instance() {
+    static Reclaimer reclaimer;
+
+    return reclaimer;
+}
+
+
+inline Reclaimer::Reclaimer() : worker([this] { Run(); }) {}
+
+
+inline Reclaimer::~Reclaimer() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_one();
+    worker.join();
+}
+
+
+inline void Reclaimer::Run() {
+    std::unique_lock<std::mutex> guard(lock);
+
+    while (true) {
+        wake.wait(guard, [this] { return stopping || !jobs.empty(); });
+        if (jobs.empty()) {
+            return;
+        }
+
+        Job job = std::move(jobs.front());
+        jobs.pop_front();
+        ++busy;
+        guard.unlock();
+        job();
+        guard.lock();
+        --busy;
+        if (jobs.empty()) {
+            idle.notify_all();
+        }
+    }
+}
+
+
+inline void Reclaimer::post(Job job) {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        jobs.push_back(std::move(job));
+    }
+    wake.notify_one();
+}
+
+
+// Waits until every job posted so far has run.
+inline void Reclaimer::drain() {
+    std::unique_lock<std::mutex> guard(lock);
+    idle.wait(guard, [this] { return jobs.empty() && !busy; });
+}
+
+
+// Jobs queued or running.
+inline size_t Reclaimer::pending() const {
+    std::lock_guard<std::mutex> guard(lock);
+
+    return jobs.size() + busy;
+}
+
+#endif  // AVLMAP_AVLMAP_RECLAIMER_HPP_
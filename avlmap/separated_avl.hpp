@@ -0,0 +1,205 @@
+// Copyright (c) 2024 PlatinumSamurai. All rights reserved.
+
+#ifndef AVLMAP_AVLMAP_SEPARATED_AVL_HPP_
+#define AVLMAP_AVLMAP_SEPARATED_AVL_HPP_
+
+#include <cstddef>
+#include <functional>
+#include <stdexcept>
+#include <utility>
+#include "avl.hpp"
+#include "value_log.hpp"
+
+
+// Avl for large values with the values kept out of the tree. The index maps
+// each key to an 8-byte handle into a ValueLog, so descents, rotations and
+// key scans only touch small pairs and the index of a big map stays in
+// cache; a value is read once, at the end of a lookup. Overwrites and erases
+// leave garbage in the log until collect() moves the live records among the
+// oldest to the tail and drops the rest. Call it a bounded step at a time
+// between requests, like Avl::clear_step(), when garbage() grows: there is
+// no background compaction, it only runs on the caller's thread inside
+// collect(). The log lives in memory, in segments from the heap; it is not
+// a memory-mapped file and does not persist.
+template <typename Key, typename T, typename Compare = std::less<Key>>
+class SeparatedAvl {
+ public:
+    typedef ValueLog<Key, T> Log;
+    typedef Avl<Key, typename Log::Handle, Compare> Index;
+
+    explicit SeparatedAvl(size_t = 1024);
+    SeparatedAvl(const SeparatedAvl &) = delete;
+    SeparatedAvl& operator=(const SeparatedAvl &) = delete;
+
+    bool insert(std::pair<const Key, T>);
+    void insert_or_assign(const Key &, T);
+    size_t erase(const Key &);
+    T* find(const Key &);
+    const T* find(const Key &) const;
+    bool contains(const Key &) const;
+    T& at(const Key &);
+    bool empty() const;
+    size_t size() const;
+    size_t garbage() const;
+    size_t collect(size_t);
+    const Index& index() const;
+    const Log& log() const;
+
+    template <typename F>
+    void for_each(F &&);
+
+ private:
+    Index tree;
+    Log values;
+};
+
+
+// segment is the number of records per segment of the value log.
+template <typename Key, typename T, typename Compare>
+SeparatedAvl<Key, T, Compare>::SeparatedAvl(size_t segment) :
+                                                        values(segment) {}
+
+
+// Inserts the pair unless its key is present, like Avl::insert. The value
+// is moved into the log.
+template <typename Key, typename T, typename Compare>
+bool SeparatedAvl<Key, T, Compare>::insert(std::pair<const Key, T> pair) {
+    auto [it, inserted] = tree.insert({pair.first, 0});
+
+    if (inserted) {
+        (*it).second = values.append(pair.first, std::move(pair.second));
+    }
+
+    return inserted;
+}
+
+
+template <typename Key, typename T, typename Compare>
+void SeparatedAvl<Key, T, Compare>::insert_or_assign(const Key &k, T value) {
+    auto [it, inserted] = tree.insert({k, 0});
+
+    if (!inserted) {
+        values.release((*it).second);
+    }
+    (*it).second = values.append(k, std::move(value));
+}
+
+
+template <typename Key, typename T, typename Compare>
+size_t SeparatedAvl<Key, T, Compare>::erase(const Key &k) {
+    auto it = tree.find(k);
+
+    if (it == tree.end()) {
+        return 0;
+    }
+    values.release((*it).second);
+    tree.erase(it);
+
+    return 1;
+}
+
+
+// The value stays where it is until the key is written again or collect()
+// moves it.
+template <typename Key, typename T, typename Compare>
+T* SeparatedAvl<Key, T, Compare>::find(const Key &k) {
+    auto it = tree.find(k);
+
+    return (it != tree.end() ? &values.value((*it).second) : nullptr);
+}
+
+
+template <typename Key, typename T, typename Compare>
+const T* SeparatedAvl<Key, T, Compare>::find(const Key &k) const {
+    auto it = tree.find(k);
+
+    return (it != tree.end() ? &values.value((*it).second) : nullptr);
+}
+
+
+// Only the index is searched.
+template <typename Key, typename T, typename Compare>
+bool SeparatedAvl<Key, T, Compare>::contains(const Key &k) const {
+    return tree.contains(k);
+}
+
+
+template <typename Key, typename T, typename Compare>
+T& SeparatedAvl<Key, T, Compare>::at(const Key &k) {
+    T *value = find(k);
+
+    if (!value) {
+        throw std::out_of_range("SeparatedAvl::at");
+    }
+
+    return *value;
+}
+
+
+template <typename Key, typename T, typename Compare>
+bool SeparatedAvl<Key, T, Compare>::empty() const {
+    return tree.empty();
+}
+
+
+template <typename Key, typename T, typename Compare>
+size_t SeparatedAvl<Key, T, Compare>::size() const {
+    return tree.size();
+}
+
+
+// Records in the log whose value was overwritten or erased.
+template <typename Key, typename T, typename Compare>
+size_t SeparatedAvl<Key, T, Compare>::garbage() const {
+    return values.garbage();
+}
+
+
+// Looks at up to budget of the oldest records: a live one is moved to the
+// tail and its handle updated with one index lookup, and every one is then
+// dropped. Stops early once no garbage is left, and returns what is. A live
+// record the index does not point at means the comparator is inconsistent;
+// that throws before anything moves.
+template <typename Key, typename T, typename Compare>
+size_t SeparatedAvl<Key, T, Compare>::collect(size_t budget) {
+    for (size_t i = 0; i < budget && values.garbage(); ++i) {
+        auto handle = values.oldest();
+        if (values.live(handle)) {
+            auto it = tree.find(values.key(handle));
+            if (it == tree.end() || (*it).second != handle) {
+                throw std::logic_error("SeparatedAvl::collect");
+            }
+            (*it).second = values.relocate(handle);
+        }
+        values.drop_oldest();
+    }
+
+    return values.garbage();
+}
+
+
+// For memory_usage() and the rest of the read-only Avl interface.
+template <typename Key, typename T, typename Compare>
+const SeparatedAvl<Key, T, Compare>::Index&
+                                SeparatedAvl<Key, T, Compare>::index() const {
+    return tree;
+}
+
+
+template <typename Key, typename T, typename Compare>
+const SeparatedAvl<Key, T, Compare>::Log&
+                                    SeparatedAvl<Key, T, Compare>::log() const {
+    return values;
+}
+
+
+// Calls f with every key and its value in key order.
+template <typename Key, typename T, typename Compare>
+template <typename F>
+void SeparatedAvl<Key, T, Compare>::for_each(F &&f) {
+    for (auto it = tree.begin(); it != tree.end(); ++it) {
+        f((*it).first, values.value((*it).second));
+    }
+}
+
+#endif  // AVLMAP_AVLMAP_SEPARATED_AVL_HPP_
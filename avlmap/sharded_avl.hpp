@@ -0,0 +1,291 @@
+// Copyright (c) 2024 PlatinumSamurai. All rights reserved.
+
+#ifndef AVLMAP_AVLMAP_SHARDED_AVL_HPP_
+#define AVLMAP_AVLMAP_SHARDED_AVL_HPP_
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <utility>
+#include <vector>
+#include "avl.hpp"
+
+
+// Splits the key space into contiguous ranges, one Avl and one mutex per
+// range. Shard i holds the keys in [bounds[i - 1], bounds[i]), so ordered
+// iteration is just the shards visited in order. The topology lock is only
+// taken exclusively by rebalance(), which moves nodes between neighbouring
+// shards with extract()/insert() and shifts the boundary between them.
+template <typename Key, typename T, typename Compare = std::less<Key>>
+class ShardedAvl {
+ private:
+    struct Shard {
+        Avl<Key, T, Compare> tree;
+        size_t ops = 0;
+        mutable std::mutex lock;
+    };
+
+    std::vector<std::unique_ptr<Shard>> shards;
+    std::vector<Key> bounds;
+    Compare cmp;
+    mutable std::shared_mutex topology;
+
+    bool Less(const Key &, const Key &) const;
+    size_t Route(const Key &) const;
+    void MoveRight(size_t, size_t);
+    void MoveLeft(size_t, size_t);
+
+ public:
+    ShardedAvl();
+    explicit ShardedAvl(std::vector<Key>);
+    ShardedAvl(const ShardedAvl &) = delete;
+    ShardedAvl& operator=(const ShardedAvl &) = delete;
+
+    bool insert(const std::pair<const Key, T> &);
+    size_t erase(const Key &);
+    std::optional<T> find(const Key &) const;
+    bool contains(const Key &) const;
+    bool empty() const;
+    size_t size() const;
+    void clear();
+
+    size_t shard_count() const;
+    std::vector<size_t> shard_sizes() const;
+    std::vector<Key> boundaries() const;
+    bool rebalance(double = 2.0);
+
+    template <typename F>
+    void for_each(F &&) const;
+};
+
+
+template <typename Key, typename T, typename Compare>
+ShardedAvl<Key, T, Compare>::ShardedAvl() {
+    shards.push_back(std::make_unique<Shard>());
+}
+
+
+template <typename Key, typename T, typename Compare>
+ShardedAvl<Key, T, Compare>::ShardedAvl(std::vector<Key> splits) :
+                                                    bounds(std::move(splits)) {
+    std::sort(bounds.begin(), bounds.end(),
+            [this](const Key &a, const Key &b) {return Less(a, b);});
+    bounds.erase(std::unique(bounds.begin(), bounds.end(),
+            [this](const Key &a, const Key &b) {return !Less(a, b);}),
+                                                                bounds.end());
+
+    for (size_t i = 0; i <= bounds.size(); ++i) {
+        shards.push_back(std::make_unique<Shard>());
+    }
+}
+
+
+template <typename Key, typename T, typename Compare>
+bool ShardedAvl<Key, T, Compare>::Less(const Key &lhs, const Key &rhs) const {
+    return avl_less(cmp, lhs, rhs);
+}
+
+
+template <typename Key, typename T, typename Compare>
+size_t ShardedAvl<Key, T, Compare>::Route(const Key &k) const {
+    return std::upper_bound(bounds.begin(), bounds.end(), k,
+            [this](const Key &a, const Key &b) {return Less(a, b);}) -
+                                                                bounds.begin();
+}
+
+
+template <typename Key, typename T, typename Compare>
+bool ShardedAvl<Key, T, Compare>::insert(const std::pair<const Key, T> &pair) {
+    std::shared_lock<std::shared_mutex> guard(topology);
+    Shard &shard = *shards[Route(pair.first)];
+    std::lock_guard<std::mutex> lock(shard.lock);
+
+    ++shard.ops;
+
+    return shard.tree.insert(pair).second;
+}
+
+
+template <typename Key, typename T, typename Compare>
+size_t ShardedAvl<Key, T, Compare>::erase(const Key &k) {
+    std::shared_lock<std::shared_mutex> guard(topology);
+    Shard &shard = *shards[Route(k)];
+    std::lock_guard<std::mutex> lock(shard.lock);
+
+    ++shard.ops;
+
+    return (shard.tree.extract(k).empty() ? 0 : 1);
+}
+
+
+template <typename Key, typename T, typename Compare>
+std::optional<T> ShardedAvl<Key, T, Compare>::find(const Key &k) const {
+    std::shared_lock<std::shared_mutex> guard(topology);
+    Shard &shard = *shards[Route(k)];
+    std::lock_guard<std::mutex> lock(shard.lock);
+
+    ++shard.ops;
+    auto it = shard.tree.find(k);
+    if (it == shard.tree.end()) {
+        return std::nullopt;
+    }
+
+    return (*it).second;
+}
+
+
+template <typename Key, typename T, typename Compare>
+bool ShardedAvl<Key, T, Compare>::contains(const Key &k) const {
+    std::shared_lock<std::shared_mutex> guard(topology);
+    Shard &shard = *shards[Route(k)];
+    std::lock_guard<std::mutex> lock(shard.lock);
+
+    ++shard.ops;
+
+    return shard.tree.contains(k);
+}
+
+
+template <typename Key, typename T, typename Compare>
+bool ShardedAvl<Key, T, Compare>::empty() const {
+    return size() == 0;
+}
+
+
+template <typename Key, typename T, typename Compare>
+size_t ShardedAvl<Key, T, Compare>::size() const {
+    size_t total = 0;
+
+    for (size_t count : shard_sizes()) {
+        total += count;
+    }
+
+    return total;
+}
+
+
+template <typename Key, typename T, typename Compare>
+void ShardedAvl<Key, T, Compare>::clear() {
+    std::unique_lock<std::shared_mutex> guard(topology);
+
+    for (auto &shard : shards) {
+        shard->tree.clear();
+        shard->ops = 0;
+    }
+}
+
+
+template <typename Key, typename T, typename Compare>
+size_t ShardedAvl<Key, T, Compare>::shard_count() const {
+    return shards.size();
+}
+
+
+template <typename Key, typename T, typename Compare>
+std::vector<size_t> ShardedAvl<Key, T, Compare>::shard_sizes() const {
+    std::shared_lock<std::shared_mutex> guard(topology);
+    std::vector<size_t> sizes;
+
+    for (const auto &shard : shards) {
+        std::lock_guard<std::mutex> lock(shard->lock);
+        sizes.push_back(shard->tree.size());
+    }
+
+    return sizes;
+}
+
+
+template <typename Key, typename T, typename Compare>
+std::vector<Key> ShardedAvl<Key, T, Compare>::boundaries() const {
+    std::shared_lock<std::shared_mutex> guard(topology);
+
+    return bounds;
+}
+
+
+template <typename Key, typename T, typename Compare>
+void ShardedAvl<Key, T, Compare>::MoveRight(size_t from, size_t n) {
+    Shard &source = *shards[from];
+    Shard &target = *shards[from + 1];
+
+    for (size_t i = 0; i < n; ++i) {
+        target.tree.insert(source.tree.extract(--source.tree.end()));
+    }
+    bounds[from] = target.tree.front().first;
+}
+
+
+template <typename Key, typename T, typename Compare>
+void ShardedAvl<Key, T, Compare>::MoveLeft(size_t from, size_t n) {
+    Shard &source = *shards[from];
+    Shard &target = *shards[from - 1];
+
+    for (size_t i = 0; i < n; ++i) {
+        target.tree.insert(source.tree.extract(source.tree.begin()));
+    }
+    bounds[from - 1] = source.tree.front().first;
+}
+
+
+// Picks the shard with the largest load, where load is its element count
+// plus the operations routed to it since the last call, and hands part of
+// its key range to the lighter neighbour when it exceeds ratio times the
+// average. Operation counters are reset on every call.
+template <typename Key, typename T, typename Compare>
+bool ShardedAvl<Key, T, Compare>::rebalance(double ratio) {
+    std::unique_lock<std::shared_mutex> guard(topology);
+    std::vector<size_t> load;
+    size_t total = 0;
+
+    for (auto &shard : shards) {
+        load.push_back(shard->tree.size() + shard->ops);
+        total += load.back();
+        shard->ops = 0;
+    }
+    if (shards.size() < 2 || total == 0) {
+        return false;
+    }
+
+    size_t hot = std::max_element(load.begin(), load.end()) - load.begin();
+    double average = static_cast<double>(total) / shards.size();
+    if (load[hot] <= ratio * average || shards[hot]->tree.size() < 2) {
+        return false;
+    }
+
+    bool right = (hot == 0 || (hot + 1 < shards.size() &&
+                                            load[hot + 1] < load[hot - 1]));
+    size_t neighbour = (right ? hot + 1 : hot - 1);
+    size_t n = shards[hot]->tree.size() * (load[hot] - load[neighbour]) /
+                                                            (2 * load[hot]);
+    n = std::min(n, shards[hot]->tree.size() - 1);
+    if (n == 0) {
+        return false;
+    }
+
+    if (right) {
+        MoveRight(hot, n);
+    } else {
+        MoveLeft(hot, n);
+    }
+
+    return true;
+}
+
+
+template <typename Key, typename T, typename Compare>
+template <typename F>
+void ShardedAvl<Key, T, Compare>::for_each(F &&f) const {
+    std::shared_lock<std::shared_mutex> guard(topology);
+
+    for (const auto &shard : shards) {
+        std::lock_guard<std::mutex> lock(shard->lock);
+        for (auto it = shard->tree.begin(); it != shard->tree.end(); ++it) {
+            f(*it);
+        }
+    }
+}
+
+#endif  // AVLMAP_AVLMAP_SHARDED_AVL_HPP_
@@ -0,0 +1,183 @@
+// Copyright (c) 2024 PlatinumSamurai. All rights reserved.
+
+#ifndef AVLMAP_AVLMAP_STATIC_AVL_HPP_
+#define AVLMAP_AVLMAP_STATIC_AVL_HPP_
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <stdexcept>
+#include <utility>
+#include "avl.hpp"
+
+
+// Read-only Avl over a table known at build time. The entries sit in key
+// order in one array and the nodes link into it by index, with each node in
+// the middle of its range, so the tree is fully balanced. Everything is
+// constexpr: a constexpr StaticAvl is built by the compiler and lands in
+// read-only data, with no allocation or initialization at startup. Key and
+// T have to be literal and default-constructible, e.g. int or
+// std::string_view. Iteration walks the array.
+template <typename Key, typename T, size_t N, typename Compare = std::less<Key>>
+class StaticAvl {
+ public:
+    typedef const std::pair<Key, T> *iterator;
+    typedef const std::pair<Key, T> *c_iterator;
+
+    constexpr explicit StaticAvl(const std::pair<Key, T> (&)[N]);
+
+    constexpr c_iterator find(const Key &) const;
+    constexpr bool contains(const Key &) const;
+    constexpr const T& at(const Key &) const;
+    constexpr bool empty() const;
+    constexpr size_t size() const;
+    constexpr int height() const;
+
+    constexpr c_iterator begin() const;
+    constexpr c_iterator end() const;
+
+ private:
+    static constexpr size_t kNone = N;
+
+    struct Link {
+        size_t left = kNone;
+        size_t right = kNone;
+    };
+
+    std::array<std::pair<Key, T>, N> pairs{};
+    std::array<Link, N> links{};
+    size_t root = kNone;
+    int levels = 0;
+    Compare cmp;
+
+    constexpr bool Less(const Key &, const Key &) const;
+    constexpr size_t Build(size_t, size_t, int);
+};
+
+
+// Builds a table from a braced list without spelling out its length:
+//   constexpr auto ports = make_static_avl<std::string_view, int>({
+//       {"http", 80}, {"https", 443}, {"ssh", 22}});
+// The list must be sorted, just as for the constructor.
+template <typename Key, typename T, typename Compare = std::less<Key>,
+                                                                    size_t N>
+constexpr StaticAvl<Key, T, N, Compare> make_static_avl(
+                                        const std::pair<Key, T> (&list)[N]) {
+    return StaticAvl<Key, T, N, Compare>(list);
+}
+
+
+// Keys must be strictly increasing. A list that is not fails to compile
+// when the table is constexpr, and throws std::invalid_argument otherwise.
+template <typename Key, typename T, size_t N, typename Compare>
+constexpr StaticAvl<Key, T, N, Compare>::StaticAvl(
+                                        const std::pair<Key, T> (&list)[N]) {
+    for (size_t i = 0; i < N; ++i) {
+        if (i && !Less(list[i - 1].first, list[i].first)) {
+            throw std::invalid_argument("StaticAvl: keys out of order");
+        }
+        pairs[i] = list[i];
+    }
+    root = Build(0, N, 1);
+}
+
+
+template <typename Key, typename T, size_t N, typename Compare>
+constexpr bool StaticAvl<Key, T, N, Compare>::Less(const Key &lhs,
+                                                    const Key &rhs) const {
+    return avl_less(cmp, lhs, rhs);
+}
+
+
+// Links the entries in [lo, hi) under their middle one and returns it.
+template <typename Key, typename T, size_t N, typename Compare>
+constexpr size_t StaticAvl<Key, T, N, Compare>::Build(size_t lo, size_t hi,
+                                                                int depth) {
+    if (lo == hi) {
+        return kNone;
+    }
+
+    size_t mid = lo + (hi - lo) / 2;
+    levels = std::max(levels, depth);
+    links[mid].left = Build(lo, mid, depth + 1);
+    links[mid].right = Build(mid + 1, hi, depth + 1);
+
+    return mid;
+}
+
+
+// One comparison per level, remembering the last entry not greater than k,
+// and one more at the bottom. The choice of child is data, not a branch, so
+// a random lookup does not pay a misprediction on every level.
+template <typename Key, typename T, size_t N, typename Compare>
+constexpr StaticAvl<Key, T, N, Compare>::c_iterator
+            StaticAvl<Key, T, N, Compare>::find(const Key &k) const {
+    size_t node = root;
+    size_t floor = kNone;
+
+    while (node != kNone) {
+        bool right = !Less(k, pairs[node].first);
+        floor = (right ? node : floor);
+        node = (right ? links[node].right : links[node].left);
+    }
+
+    if (floor == kNone || Less(pairs[floor].first, k)) {
+        return end();
+    }
+
+    return pairs.data() + floor;
+}
+
+
+template <typename Key, typename T, size_t N, typename Compare>
+constexpr bool StaticAvl<Key, T, N, Compare>::contains(const Key &k) const {
+    return find(k) != end();
+}
+
+
+template <typename Key, typename T, size_t N, typename Compare>
+constexpr const T& StaticAvl<Key, T, N, Compare>::at(const Key &k) const {
+    c_iterator it = find(k);
+
+    if (it == end()) {
+        throw std::out_of_range("StaticAvl::at");
+    }
+
+    return it->second;
+}
+
+
+template <typename Key, typename T, size_t N, typename Compare>
+constexpr bool StaticAvl<Key, T, N, Compare>::empty() const {
+    return N == 0;
+}
+
+
+template <typename Key, typename T, size_t N, typename Compare>
+constexpr size_t StaticAvl<Key, T, N, Compare>::size() const {
+    return N;
+}
+
+
+// Levels of nodes on the longest path, ceil(log2(N + 1)).
+template <typename Key, typename T, size_t N, typename Compare>
+constexpr int StaticAvl<Key, T, N, Compare>::height() const {
+    return levels;
+}
+
+
+template <typename Key, typename T, size_t N, typename Compare>
+constexpr StaticAvl<Key, T, N, Compare>::c_iterator
+                                StaticAvl<Key, T, N, Compare>::begin() const {
+    return pairs.data();
+}
+
+
+template <typename Key, typename T, size_t N, typename Compare>
+constexpr StaticAvl<Key, T, N, Compare>::c_iterator
+                                StaticAvl<Key, T, N, Compare>::end() const {
+    return pairs.data() + N;
+}
+
+#endif  // AVLMAP_AVLMAP_STATIC_AVL_HPP_
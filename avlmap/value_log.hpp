@@ -0,0 +1,172 @@
+// Copyright (c) 2024 PlatinumSamurai. All rights reserved.
+
+#ifndef AVLMAP_AVLMAP_VALUE_LOG_HPP_
+#define AVLMAP_AVLMAP_VALUE_LOG_HPP_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <utility>
+#include <vector>
+
+
+// Append-only store for values kept out of an index. Each record holds its
+// key and value; a handle is the record's position in the log, and records
+// never move while stored, so a handle stays valid until the record is
+// dropped. Records fill fixed-size segments, and a released record gives up
+// its value at once but its slot only when the oldest records are dropped.
+// Collection moves the live ones among them to the tail first.
+template <typename Key, typename T>
+class ValueLog {
+ public:
+    typedef uint64_t Handle;
+
+    explicit ValueLog(size_t = 1024);
+
+    Handle append(const Key &, T);
+    T& value(Handle);
+    const T& value(Handle) const;
+    const Key& key(Handle) const;
+    bool live(Handle) const;
+    void release(Handle);
+    Handle relocate(Handle);
+    Handle oldest() const;
+    void drop_oldest();
+    size_t records() const;
+    size_t garbage() const;
+    size_t memory_usage() const;
+
+ private:
+    struct Record {
+        Key key;
+        std::optional<T> value;
+    };
+
+    std::deque<std::vector<Record>> segments;
+    size_t limit;
+    Handle first = 0;       // oldest record still stored
+    Handle next = 0;        // handle of the next append
+    size_t dead = 0;
+
+    Record& At(Handle);
+    const Record& At(Handle) const;
+};
+
+
+template <typename Key, typename T>
+ValueLog<Key, T>::ValueLog(size_t segment) :
+                                        limit(std::max<size_t>(segment, 1)) {}
+
+
+template <typename Key, typename T>
+ValueLog<Key, T>::Record& ValueLog<Key, T>::At(Handle handle) {
+    return segments[handle / limit - first / limit][handle % limit];
+}
+
+
+template <typename Key, typename T>
+const ValueLog<Key, T>::Record& ValueLog<Key, T>::At(Handle handle) const {
+    return segments[handle / limit - first / limit][handle % limit];
+}
+
+
+// Segments are reserved in full and never grow past it, so appending does
+// not move the records already there.
+template <typename Key, typename T>
+ValueLog<Key, T>::Handle ValueLog<Key, T>::append(const Key &k, T value) {
+    if (next % limit == 0) {
+        segments.emplace_back();
+        segments.back().reserve(limit);
+    }
+    segments.back().push_back(Record{k, std::move(value)});
+
+    return next++;
+}
+
+
+template <typename Key, typename T>
+T& ValueLog<Key, T>::value(Handle handle) {
+    return *At(handle).value;
+}
+
+
+template <typename Key, typename T>
+const T& ValueLog<Key, T>::value(Handle handle) const {
+    return *At(handle).value;
+}
+
+
+template <typename Key, typename T>
+const Key& ValueLog<Key, T>::key(Handle handle) const {
+    return At(handle).key;
+}
+
+
+template <typename Key, typename T>
+bool ValueLog<Key, T>::live(Handle handle) const {
+    return At(handle).value.has_value();
+}
+
+
+// Frees the value now; the slot waits for drop_oldest().
+template <typename Key, typename T>
+void ValueLog<Key, T>::release(Handle handle) {
+    At(handle).value.reset();
+    ++dead;
+}
+
+
+// Moves a live record to the tail and returns its new handle.
+template <typename Key, typename T>
+ValueLog<Key, T>::Handle ValueLog<Key, T>::relocate(Handle handle) {
+    Handle moved = append(At(handle).key, std::move(*At(handle).value));
+    release(handle);
+
+    return moved;
+}
+
+
+// Only valid while records() is not zero.
+template <typename Key, typename T>
+ValueLog<Key, T>::Handle ValueLog<Key, T>::oldest() const {
+    return first;
+}
+
+
+// Drops the oldest record, which must have been released, and its segment
+// with it once that is used up.
+template <typename Key, typename T>
+void ValueLog<Key, T>::drop_oldest() {
+    --dead;
+    ++first;
+    if (first % limit == 0 || first == next) {
+        segments.pop_front();
+        if (first == next) {
+            first = next = (next + limit - 1) / limit * limit;
+        }
+    }
+}
+
+
+template <typename Key, typename T>
+size_t ValueLog<Key, T>::records() const {
+    return next - first;
+}
+
+
+template <typename Key, typename T>
+size_t ValueLog<Key, T>::garbage() const {
+    return dead;
+}
+
+
+// Slots of every segment held, used or not. Memory values own beyond
+// sizeof(T) is not counted.
+template <typename Key, typename T>
+size_t ValueLog<Key, T>::memory_usage() const {
+    return segments.size() * limit * sizeof(Record);
+}
+
+#endif  // AVLMAP_AVLMAP_VALUE_LOG_HPP_
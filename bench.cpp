@@ -0,0 +1,882 @@
+// Copyright (c) 2024 PlatinumSamurai. All rights reserved.
+
+#include <benchmark/benchmark.h>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+#include "avlmap/arena.hpp"
+#include "avlmap/avl.hpp"
+#include "avlmap/blocked_avl.hpp"
+#include "avlmap/buffered_avl.hpp"
+#include "avlmap/filter.hpp"
+#include "avlmap/interval_avl.hpp"
+#include "avlmap/mvcc_avl.hpp"
+#include "avlmap/reclaimer.hpp"
+#include "avlmap/separated_avl.hpp"
+#include "avlmap/sharded_avl.hpp"
+#include "avlmap/static_avl.hpp"
+
+
+static std::vector<int> ShuffledKeys(int n, unsigned seed = 42) {
+    std::vector<int> keys(n);
+    std::mt19937 gen(seed);
+
+    for (int i = 0; i < n; ++i) {
+        keys[i] = 2 * i;
+    }
+    std::shuffle(keys.begin(), keys.end(), gen);
+
+    return keys;
+}
+
+
+// Lookup keys are drawn from a long random stream rather than cycling one
+// permutation, so the branch predictor cannot memorise the descent paths.
+static std::vector<int> RandomKeys(int n, unsigned seed = 7) {
+    std::vector<int> keys(1 << 20);
+    std::mt19937 gen(seed);
+    std::uniform_int_distribution<int> dist(0, n - 1);
+
+    for (auto &k : keys) {
+        k = 2 * dist(gen);
+    }
+
+    return keys;
+}
+
+
+static Avl<int, int>& Tree(int n) {
+    static std::map<int, Avl<int, int> *> trees;
+
+    if (!trees.count(n)) {
+        trees[n] = new Avl<int, int>();
+        for (int k : ShuffledKeys(n)) {
+            trees[n]->insert({k, k});
+        }
+    }
+
+    return *trees[n];
+}
+
+
+static void BM_FindHit(benchmark::State &state) {
+    auto &tree = Tree(state.range(0));
+    auto keys = RandomKeys(state.range(0));
+    size_t i = 0;
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(tree.find(keys[i]));
+        i = (i + 1 == keys.size() ? 0 : i + 1);
+    }
+}
+BENCHMARK(BM_FindHit)->Arg(1 << 10)->Arg(1 << 14);
+
+
+static void BM_ContainsHit(benchmark::State &state) {
+    auto &tree = Tree(state.range(0));
+    auto keys = RandomKeys(state.range(0));
+    size_t i = 0;
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(tree.contains(keys[i]));
+        i = (i + 1 == keys.size() ? 0 : i + 1);
+    }
+}
+BENCHMARK(BM_ContainsHit)->Arg(1 << 10)->Arg(1 << 14);
+
+
+static void BM_ContainsMiss(benchmark::State &state) {
+    auto &tree = Tree(state.range(0));
+    auto keys = RandomKeys(state.range(0));
+    size_t i = 0;
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(tree.contains(keys[i] + 1));
+        i = (i + 1 == keys.size() ? 0 : i + 1);
+    }
+}
+BENCHMARK(BM_ContainsMiss)->Arg(1 << 10)->Arg(1 << 14);
+
+
+static std::string StringKey(int k) {
+    return "/tenant/" + std::to_string(k % 97) + "/path/" + std::to_string(k);
+}
+
+
+static Avl<std::string, int>& StringTree(int n) {
+    static std::map<int, Avl<std::string, int> *> trees;
+
+    if (!trees.count(n)) {
+        trees[n] = new Avl<std::string, int>();
+        for (int k : ShuffledKeys(n)) {
+            trees[n]->insert({StringKey(k), k});
+        }
+    }
+
+    return *trees[n];
+}
+
+
+static void BM_StringFindHit(benchmark::State &state) {
+    auto &tree = StringTree(state.range(0));
+    std::vector<std::string> keys;
+    size_t i = 0;
+
+    for (int k : RandomKeys(state.range(0))) {
+        keys.push_back(StringKey(k));
+    }
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(tree.find(keys[i]));
+        i = (i + 1 == keys.size() ? 0 : i + 1);
+    }
+}
+BENCHMARK(BM_StringFindHit)->Arg(1 << 10)->Arg(1 << 14);
+
+
+static void BM_StringContainsMiss(benchmark::State &state) {
+    auto &tree = StringTree(state.range(0));
+    std::vector<std::string> keys;
+    size_t i = 0;
+
+    for (int k : RandomKeys(state.range(0))) {
+        keys.push_back(StringKey(k + 1));
+    }
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(tree.contains(keys[i]));
+        i = (i + 1 == keys.size() ? 0 : i + 1);
+    }
+}
+BENCHMARK(BM_StringContainsMiss)->Arg(1 << 10)->Arg(1 << 14);
+
+
+// Tenant-scoped URL paths: the leading tenant id varies, the rest is long
+// enough to live outside the string's inline buffer.
+static std::string TenantKey(int k) {
+    char tenant[9];
+    snprintf(tenant, sizeof(tenant), "%08x", k * 2654435761u);
+
+    return std::string(tenant) + "/api/v1/orders/" + std::to_string(k);
+}
+
+
+template <typename Tree>
+static void BM_TenantFindHit(benchmark::State &state) {
+    static std::map<int, Tree *> trees;
+    int n = state.range(0);
+    if (!trees.count(n)) {
+        trees[n] = new Tree();
+        for (int k : ShuffledKeys(n)) {
+            trees[n]->insert({TenantKey(k), k});
+        }
+    }
+    auto &tree = *trees[n];
+    std::vector<std::string> keys;
+    size_t i = 0;
+
+    for (int k : RandomKeys(n)) {
+        keys.push_back(TenantKey(k));
+    }
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(tree.find(keys[i]));
+        i = (i + 1 == keys.size() ? 0 : i + 1);
+    }
+}
+typedef Avl<std::string, int, std::less<std::string>,
+        std::allocator<std::pair<const std::string, int>>, NoAugment,
+                                                    StringPrefix> PrefixAvl;
+BENCHMARK_TEMPLATE(BM_TenantFindHit, Avl<std::string, int>)
+                                            ->Arg(1 << 14)->Arg(1 << 20);
+BENCHMARK_TEMPLATE(BM_TenantFindHit, PrefixAvl)->Arg(1 << 14)->Arg(1 << 20);
+
+
+template <typename Tree>
+static Tree& IntTree(int n) {
+    static std::map<int, Tree *> trees;
+
+    if (!trees.count(n)) {
+        trees[n] = new Tree();
+        for (int k : ShuffledKeys(n)) {
+            trees[n]->insert({k, k});
+        }
+    }
+
+    return *trees[n];
+}
+
+
+template <typename Tree>
+static void BM_Lookup(benchmark::State &state) {
+    auto &tree = IntTree<Tree>(state.range(0));
+    auto keys = RandomKeys(state.range(0));
+    size_t i = 0;
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(tree.contains(keys[i]));
+        i = (i + 1 == keys.size() ? 0 : i + 1);
+    }
+}
+BENCHMARK_TEMPLATE(BM_Lookup, Avl<int, int>)->Arg(1 << 14)->Arg(1 << 20);
+BENCHMARK_TEMPLATE(BM_Lookup, BlockedAvl<int, int>)
+                                            ->Arg(1 << 14)->Arg(1 << 20);
+
+
+template <typename Tree>
+static void BM_Scan(benchmark::State &state) {
+    auto &tree = IntTree<Tree>(state.range(0));
+
+    for (auto _ : state) {
+        long sum = 0;
+        for (auto it = tree.begin(); it != tree.end(); ++it) {
+            sum += (*it).second;
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK_TEMPLATE(BM_Scan, Avl<int, int>)->Arg(1 << 14)->Arg(1 << 20);
+BENCHMARK_TEMPLATE(BM_Scan, BlockedAvl<int, int>)->Arg(1 << 14)->Arg(1 << 20);
+
+
+static void BM_LockedAvlInsert(benchmark::State &state) {
+    static Avl<int, int> tree;
+    static std::mutex lock;
+    auto keys = RandomKeys(1 << 30, state.thread_index());
+    size_t i = 0;
+
+    for (auto _ : state) {
+        std::lock_guard<std::mutex> guard(lock);
+        tree.insert({keys[i], 0});
+        i = (i + 1 == keys.size() ? 0 : i + 1);
+    }
+}
+BENCHMARK(BM_LockedAvlInsert)->ThreadRange(1, 8)->UseRealTime();
+
+
+static void BM_ShardedAvlInsert(benchmark::State &state) {
+    static ShardedAvl<int, int> map([]() {
+        std::vector<int> bounds;
+        for (int i = 1; i < 16; ++i) {
+            bounds.push_back(i * (1 << 27));
+        }
+        return bounds;
+    }());
+    auto keys = RandomKeys(1 << 30, state.thread_index());
+    size_t i = 0;
+
+    for (auto _ : state) {
+        map.insert({keys[i], 0});
+        i = (i + 1 == keys.size() ? 0 : i + 1);
+    }
+}
+BENCHMARK(BM_ShardedAvlInsert)->ThreadRange(1, 8)->UseRealTime();
+
+
+// Readers looking up keys while thread 0 also moves a unit between two keys
+// every 16 lookups: once under one global lock, once as MVCC transactions
+// against pinned snapshots.
+static void BM_LockedTransferRead(benchmark::State &state) {
+    static Avl<int, int> &tree = Tree(1 << 16);
+    static std::mutex lock;
+    auto keys = RandomKeys(1 << 16, state.thread_index());
+    size_t i = 0;
+
+    for (auto _ : state) {
+        std::lock_guard<std::mutex> guard(lock);
+        if (state.thread_index() == 0 && i % 16 == 0) {
+            --tree[keys[i]];
+            ++tree[keys[i + 1]];
+        }
+        benchmark::DoNotOptimize(tree.contains(keys[i]));
+        i = (i + 2 >= keys.size() ? 0 : i + 1);
+    }
+}
+BENCHMARK(BM_LockedTransferRead)->ThreadRange(1, 8)->UseRealTime();
+
+
+static void BM_MvccTransferRead(benchmark::State &state) {
+    static MvccAvl<int, int> &map = *[]() {
+        auto map = new MvccAvl<int, int>();
+        auto txn = map->begin_txn();
+        for (int k : ShuffledKeys(1 << 16)) {
+            txn.insert({k, k});
+        }
+        txn.commit();
+        return map;
+    }();
+    auto keys = RandomKeys(1 << 16, state.thread_index());
+    size_t i = 0;
+
+    for (auto _ : state) {
+        if (state.thread_index() == 0 && i % 16 == 0) {
+            auto txn = map.begin_txn();
+            txn.insert_or_assign({keys[i], *txn.find(keys[i]) - 1});
+            txn.insert_or_assign({keys[i + 1], *txn.find(keys[i + 1]) + 1});
+            txn.commit();
+        }
+        benchmark::DoNotOptimize(map.snapshot().contains(keys[i]));
+        i = (i + 2 >= keys.size() ? 0 : i + 1);
+    }
+}
+BENCHMARK(BM_MvccTransferRead)->ThreadRange(1, 8)->UseRealTime();
+
+
+static std::vector<std::pair<int, int>> Intervals(int n) {
+    std::vector<std::pair<int, int>> intervals;
+    std::mt19937 gen(11);
+
+    for (int i = 0; i < n; ++i) {
+        int lo = gen() % (1 << 24);
+        intervals.emplace_back(lo, lo + gen() % (1 << 12));
+    }
+
+    return intervals;
+}
+
+
+static void BM_IntervalStabbing(benchmark::State &state) {
+    static std::map<int, IntervalAvl<int, int> *> trees;
+    int n = state.range(0);
+    if (!trees.count(n)) {
+        trees[n] = new IntervalAvl<int, int>();
+        for (auto [lo, hi] : Intervals(n)) {
+            trees[n]->insert(lo, hi, lo);
+        }
+    }
+    auto &tree = *trees[n];
+    auto points = RandomKeys(1 << 23);
+    size_t i = 0;
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(tree.stabbing(points[i]));
+        i = (i + 1 == points.size() ? 0 : i + 1);
+    }
+}
+BENCHMARK(BM_IntervalStabbing)->Arg(1 << 10)->Arg(1 << 14);
+
+
+// Baseline: the same intervals in a plain Avl keyed by (lo, hi), scanned
+// from begin() to end() for every query.
+static void BM_IntervalLinearScan(benchmark::State &state) {
+    static std::map<int, Avl<std::pair<int, int>, int> *> trees;
+    int n = state.range(0);
+    if (!trees.count(n)) {
+        trees[n] = new Avl<std::pair<int, int>, int>();
+        for (auto interval : Intervals(n)) {
+            trees[n]->insert({interval, interval.first});
+        }
+    }
+    auto &tree = *trees[n];
+    auto points = RandomKeys(1 << 23);
+    size_t i = 0;
+
+    for (auto _ : state) {
+        std::vector<int> found;
+        for (auto it = tree.begin(); it != tree.end(); ++it) {
+            if ((*it).first.first <= points[i] &&
+                                        points[i] <= (*it).first.second) {
+                found.push_back((*it).second);
+            }
+        }
+        benchmark::DoNotOptimize(found);
+        i = (i + 1 == points.size() ? 0 : i + 1);
+    }
+}
+BENCHMARK(BM_IntervalLinearScan)->Arg(1 << 10)->Arg(1 << 14);
+
+
+typedef Avl<int, int, std::less<int>,
+                ArenaAllocator<std::pair<const int, int>>> ArenaAvl;
+
+
+// Rebuilding by insertion is what a copy cost before the structural clone.
+static void BM_CopyByInsert(benchmark::State &state) {
+    auto &tree = IntTree<Avl<int, int>>(state.range(0));
+
+    for (auto _ : state) {
+        Avl<int, int> copy;
+        for (auto it = tree.begin(); it != tree.end(); ++it) {
+            copy.insert(*it);
+        }
+        benchmark::DoNotOptimize(copy.size());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_CopyByInsert)->Arg(1 << 14)->Arg(1 << 20);
+
+
+template <typename Tree>
+static void BM_Copy(benchmark::State &state) {
+    auto &tree = IntTree<Tree>(state.range(0));
+
+    for (auto _ : state) {
+        Tree copy(tree);
+        benchmark::DoNotOptimize(copy.size());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK_TEMPLATE(BM_Copy, Avl<int, int>)->Arg(1 << 14)->Arg(1 << 20);
+BENCHMARK_TEMPLATE(BM_Copy, ArenaAvl)->Arg(1 << 14)->Arg(1 << 20);
+
+// Counts this thread's data-TLB misses, if perf events are allowed here.
+class TlbMissCounter {
+ public:
+    TlbMissCounter() {
+        perf_event_attr attr{};
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_DTLB |
+                        (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                        (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+    ~TlbMissCounter() {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+
+    long read() const {
+        long count = 0;
+        if (fd < 0 || ::read(fd, &count, sizeof(count)) != sizeof(count)) {
+            return -1;
+        }
+        return count;
+    }
+
+ private:
+    int fd;
+};
+
+
+// Random lookups on a tree whose nodes come from the heap, a plain arena,
+// or an arena on 2 MiB pages. The request asked for 10^8 entries; that
+// needs about 7 GiB per tree, so the default sizes stop at 2^23.
+template <int Pages>
+static void BM_PlacedLookup(benchmark::State &state) {
+    typedef Avl<int, int, std::less<int>,
+                        ArenaAllocator<std::pair<const int, int>>> Tree;
+    static std::map<int, Tree *> trees;
+    int n = state.range(0);
+
+    if (!trees.count(n)) {
+        ArenaPlacement placement;
+        placement.huge_pages = (Pages == 2);
+        trees[n] = new Tree(ArenaAllocator<std::pair<const int, int>>(
+                                    std::make_shared<Arena>(0, placement)));
+        for (int k : ShuffledKeys(n)) {
+            trees[n]->insert({k, k});
+        }
+    }
+
+    auto &tree = *trees[n];
+    auto keys = RandomKeys(n);
+    size_t i = 0;
+    TlbMissCounter misses;
+    long before = misses.read();
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(tree.contains(keys[i]));
+        i = (i + 1 == keys.size() ? 0 : i + 1);
+    }
+    if (before >= 0) {
+        state.counters["dtlb_misses"] = benchmark::Counter(
+                    misses.read() - before, benchmark::Counter::kAvgIterations);
+    }
+}
+BENCHMARK_TEMPLATE(BM_Lookup, Avl<int, int>)->Arg(1 << 23);
+BENCHMARK_TEMPLATE(BM_PlacedLookup, 0)->Arg(1 << 20)->Arg(1 << 23);
+BENCHMARK_TEMPLATE(BM_PlacedLookup, 2)->Arg(1 << 20)->Arg(1 << 23);
+
+
+// Finding the 16 entries changed between two 1M-entry versions: a merge walk
+// over two Avl copies against the structural diff of two MVCC snapshots,
+// which skips every subtree the versions share.
+static void BM_AvlDiff(benchmark::State &state) {
+    static Avl<int, int> &before = Tree(1 << 20);
+    static Avl<int, int> &after = *[]() {
+        auto after = new Avl<int, int>(before);
+        auto keys = RandomKeys(1 << 20, 5);
+        for (int i = 0; i < 16; ++i) {
+            (*after)[keys[i]] = -1;
+        }
+        return after;
+    }();
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(diff(before, after));
+    }
+}
+BENCHMARK(BM_AvlDiff)->Unit(benchmark::kMillisecond);
+
+
+static void BM_MvccDiff(benchmark::State &state) {
+    static MvccAvl<int, int> map;
+    static auto before = [] {
+        auto load = map.begin_txn();
+        for (int k : ShuffledKeys(1 << 20)) {
+            load.insert({k, k});
+        }
+        load.commit();
+        return map.snapshot();
+    }();
+    static auto after = [] {
+        auto txn = map.begin_txn();
+        auto keys = RandomKeys(1 << 20, 5);
+        for (int i = 0; i < 16; ++i) {
+            txn.insert_or_assign({keys[i], -1});
+        }
+        txn.commit();
+        return map.snapshot();
+    }();
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(diff(before, after));
+    }
+}
+BENCHMARK(BM_MvccDiff)->Unit(benchmark::kMicrosecond);
+
+
+// contains() on 1M keys with and without a 1% filter in front, for a range
+// of hit ratios: the percentage of queried keys that are present.
+template <bool Filtered>
+static void BM_FilteredLookup(benchmark::State &state) {
+    static Avl<int, int> &tree = *[]() {
+        auto tree = new Avl<int, int>(Tree(1 << 20));
+        if (Filtered) {
+            tree->enable_filter({.capacity = 1 << 20, .fp_rate = 0.01});
+        }
+        return tree;
+    }();
+    auto keys = RandomKeys(1 << 20);
+    std::mt19937 gen(13);
+    for (auto &k : keys) {
+        if (int(gen() % 100) >= state.range(0)) {
+            k += 1;
+        }
+    }
+    size_t i = 0;
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(tree.contains(keys[i]));
+        i = (i + 1 == keys.size() ? 0 : i + 1);
+    }
+    state.counters["filter_bytes"] = tree.memory_usage().filters;
+}
+BENCHMARK_TEMPLATE(BM_FilteredLookup, false)->Arg(0)->Arg(50)->Arg(90)
+                                                                ->Arg(100);
+BENCHMARK_TEMPLATE(BM_FilteredLookup, true)->Arg(0)->Arg(50)->Arg(90)
+                                                                ->Arg(100);
+
+
+// Looking up a sorted batch of random keys in a 1M-entry tree, one find()
+// per key against one cursor seeking through the batch. The batch size sets
+// the distance between consecutive keys.
+template <typename Key, bool Finger>
+static void SortedBatchLookup(benchmark::State &state, Avl<Key, int> &tree,
+                                            const std::vector<Key> &keys) {
+    for (auto _ : state) {
+        size_t found = 0;
+        if (Finger) {
+            auto cursor = tree.cursor();
+            for (const auto &k : keys) {
+                found += cursor.seek(k);
+            }
+        } else {
+            for (const auto &k : keys) {
+                found += (tree.find(k) != tree.end());
+            }
+        }
+        benchmark::DoNotOptimize(found);
+    }
+    state.SetItemsProcessed(state.iterations() * keys.size());
+}
+
+
+template <bool Finger>
+static void BM_SortedBatchLookup(benchmark::State &state) {
+    auto keys = RandomKeys(1 << 20);
+    keys.resize(state.range(0));
+    std::sort(keys.begin(), keys.end());
+
+    SortedBatchLookup<int, Finger>(state, Tree(1 << 20), keys);
+}
+BENCHMARK_TEMPLATE(BM_SortedBatchLookup, false)->Arg(1 << 10)->Arg(1 << 14)
+                                                            ->Arg(1 << 18);
+BENCHMARK_TEMPLATE(BM_SortedBatchLookup, true)->Arg(1 << 10)->Arg(1 << 14)
+                                                            ->Arg(1 << 18);
+
+
+template <bool Finger>
+static void BM_SortedStringBatchLookup(benchmark::State &state) {
+    std::vector<std::string> keys;
+    for (int k : RandomKeys(1 << 20)) {
+        keys.push_back(StringKey(k));
+        if (keys.size() == size_t(state.range(0))) {
+            break;
+        }
+    }
+    std::sort(keys.begin(), keys.end());
+
+    SortedBatchLookup<std::string, Finger>(state, StringTree(1 << 20), keys);
+}
+BENCHMARK_TEMPLATE(BM_SortedStringBatchLookup, false)->Arg(1 << 10)
+                                                ->Arg(1 << 14)->Arg(1 << 18);
+BENCHMARK_TEMPLATE(BM_SortedStringBatchLookup, true)->Arg(1 << 10)
+                                                ->Arg(1 << 14)->Arg(1 << 18);
+
+
+template <typename Balance>
+using PolicyAvl = Avl<int, int, std::less<int>,
+        std::allocator<std::pair<const int, int>>, NoAugment, NoKeyCache,
+                                                                    Balance>;
+
+
+// Random churn under each balancing policy: every op erases a key put in
+// n ops earlier and inserts a new one, so the size stays at n.
+template <typename Balance>
+static void BM_PolicyChurn(benchmark::State &state) {
+    int n = state.range(0);
+    auto keys = ShuffledKeys(2 * n);
+    PolicyAvl<Balance> tree;
+    for (int i = 0; i < n; ++i) {
+        tree.insert({keys[i], i});
+    }
+    size_t before = tree.rotations();
+    size_t i = 0;
+
+    for (auto _ : state) {
+        tree.erase(keys[i]);
+        tree.insert({keys[(i + n) % keys.size()], 0});
+        i = (i + 1 == keys.size() ? 0 : i + 1);
+    }
+    state.SetItemsProcessed(state.iterations() * 2);
+    state.counters["rotations_per_op"] = benchmark::Counter(
+            double(tree.rotations() - before) / (2 * state.iterations()));
+}
+BENCHMARK_TEMPLATE(BM_PolicyChurn, AvlBalance)->Arg(1 << 14)->Arg(1 << 20);
+BENCHMARK_TEMPLATE(BM_PolicyChurn, RedBlackBalance)->Arg(1 << 14)
+                                                            ->Arg(1 << 20);
+BENCHMARK_TEMPLATE(BM_PolicyChurn, WeightBalance)->Arg(1 << 14)
+                                                            ->Arg(1 << 20);
+BENCHMARK_TEMPLATE(BM_Lookup, PolicyAvl<RedBlackBalance>)->Arg(1 << 14)
+                                                            ->Arg(1 << 20);
+BENCHMARK_TEMPLATE(BM_Lookup, PolicyAvl<WeightBalance>)->Arg(1 << 14)
+                                                            ->Arg(1 << 20);
+
+
+// Ingest of n distinct random keys into an empty tree: one Avl::insert()
+// per key, or a write buffer of the given capacity merged in sorted batches.
+template <size_t Capacity>
+static void BM_Ingest(benchmark::State &state) {
+    auto keys = ShuffledKeys(state.range(0));
+
+    for (auto _ : state) {
+        if (Capacity) {
+            BufferedAvl<int, int> tree(Capacity);
+            for (int k : keys) {
+                tree.insert({k, k});
+            }
+            benchmark::DoNotOptimize(tree.size());
+        } else {
+            Avl<int, int> tree;
+            for (int k : keys) {
+                tree.insert({k, k});
+            }
+            benchmark::DoNotOptimize(tree.size());
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * keys.size());
+}
+BENCHMARK_TEMPLATE(BM_Ingest, 0)->Arg(1 << 16)->Arg(1 << 20)
+                                            ->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_Ingest, 1024)->Arg(1 << 16)->Arg(1 << 20)
+                                            ->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_Ingest, 4096)->Arg(1 << 16)->Arg(1 << 20)
+                                            ->Unit(benchmark::kMillisecond);
+
+
+// Full scan of a 1M-entry tree split by partition() over 1 to 32 threads.
+// Wall time, since the work is spread over several threads.
+static void BM_ParallelScan(benchmark::State &state) {
+    auto &tree = IntTree<Avl<int, int>>(1 << 20);
+
+    for (auto _ : state) {
+        parallel_for_each(tree, [](std::pair<const int, int> &pair) {
+            benchmark::DoNotOptimize(pair.second);
+        }, unsigned(state.range(0)));
+    }
+    state.SetItemsProcessed(state.iterations() * tree.size());
+}
+BENCHMARK(BM_ParallelScan)->RangeMultiplier(2)->Range(1, 32)->UseRealTime()
+                                            ->Unit(benchmark::kMillisecond);
+
+
+// The 4096 keys of IntTree(4096) as a table built by the compiler, against
+// the same table in an Avl filled at startup.
+struct EvenPairs {
+    std::pair<int, int> pairs[4096];
+};
+
+static constexpr EvenPairs MakeEvenPairs() {
+    EvenPairs list{};
+
+    for (int i = 0; i < 4096; ++i) {
+        list.pairs[i] = {2 * i, 2 * i};
+    }
+
+    return list;
+}
+
+static constexpr StaticAvl<int, int, 4096> kStaticTable(
+                                                    MakeEvenPairs().pairs);
+
+
+static void BM_StaticLookup(benchmark::State &state) {
+    auto keys = RandomKeys(4096);
+    size_t i = 0;
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(kStaticTable.contains(keys[i]));
+        i = (i + 1 == keys.size() ? 0 : i + 1);
+    }
+}
+BENCHMARK(BM_StaticLookup);
+BENCHMARK_TEMPLATE(BM_Lookup, Avl<int, int>)->Arg(4096);
+
+
+// What the static table saves at startup: filling the Avl from the list.
+static void BM_TableStartup(benchmark::State &state) {
+    constexpr EvenPairs list = MakeEvenPairs();
+
+    for (auto _ : state) {
+        Avl<int, int> table;
+        for (const auto &pair : list.pairs) {
+            table.insert(pair);
+        }
+        benchmark::DoNotOptimize(table.size());
+    }
+}
+BENCHMARK(BM_TableStartup)->Unit(benchmark::kMicrosecond);
+
+
+// How long the request thread blocks to drop a 1M-entry map: clear() frees
+// every node inline, clear_async() hands them to the Reclaimer, and
+// clear_step() frees 4096 per call, of which the worst call is timed.
+// Filling the map and the rest of the reclaiming are left out.
+template <int Mode>
+static void BM_MapSwap(benchmark::State &state) {
+    auto keys = ShuffledKeys(1 << 20);
+
+    for (auto _ : state) {
+        state.PauseTiming();
+        Avl<int, int> tree;
+        for (int k : keys) {
+            tree.insert({k, k});
+        }
+        Reclaimer::instance().drain();
+        state.ResumeTiming();
+
+        if (Mode == 0) {
+            tree.clear();
+        } else if (Mode == 1) {
+            tree.clear_async();
+        } else {
+            double worst = 0;
+            state.PauseTiming();
+            while (true) {
+                auto start = std::chrono::steady_clock::now();
+                size_t left = tree.clear_step(4096);
+                std::chrono::duration<double> took =
+                                    std::chrono::steady_clock::now() - start;
+                worst = std::max(worst, took.count());
+                if (!left) {
+                    break;
+                }
+            }
+            state.ResumeTiming();
+            state.SetIterationTime(worst);
+        }
+        benchmark::DoNotOptimize(tree.size());
+    }
+}
+BENCHMARK_TEMPLATE(BM_MapSwap, 0)->Iterations(5)
+                                            ->Unit(benchmark::kMicrosecond);
+BENCHMARK_TEMPLATE(BM_MapSwap, 1)->Iterations(5)
+                                            ->Unit(benchmark::kMicrosecond);
+BENCHMARK_TEMPLATE(BM_MapSwap, 2)->Iterations(5)->UseManualTime()
+                                            ->Unit(benchmark::kMicrosecond);
+
+
+// 64K entries of 4 KiB inline values, in an Avl or in a SeparatedAvl whose
+// index holds only keys and handles. Lookups and key scans never need the
+// values, so they show what the values cost the index by being in it.
+typedef std::array<char, 4096> Blob;
+
+template <bool Separated>
+static auto& BlobMap() {
+    typedef std::conditional_t<Separated, SeparatedAvl<int, Blob>,
+                                                    Avl<int, Blob>> Map;
+    static Map *map = nullptr;
+
+    if (!map) {
+        map = new Map();
+        Blob blob{};
+        for (int k : ShuffledKeys(1 << 16)) {
+            map->insert({k, blob});
+        }
+    }
+
+    return *map;
+}
+
+
+template <bool Separated>
+static void BM_BlobLookup(benchmark::State &state) {
+    auto &map = BlobMap<Separated>();
+    auto keys = RandomKeys(1 << 16);
+    size_t i = 0;
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(map.contains(keys[i]));
+        i = (i + 1 == keys.size() ? 0 : i + 1);
+    }
+}
+BENCHMARK_TEMPLATE(BM_BlobLookup, false);
+BENCHMARK_TEMPLATE(BM_BlobLookup, true);
+
+
+template <bool Separated>
+static void BM_BlobKeyScan(benchmark::State &state) {
+    auto &map = BlobMap<Separated>();
+    auto &index = [&map]() -> auto& {
+        if constexpr (Separated) {
+            return map.index();
+        } else {
+            return map;
+        }
+    }();
+
+    for (auto _ : state) {
+        long sum = 0;
+        for (auto it = index.begin(); it != index.end(); ++it) {
+            sum += (*it).first;
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(state.iterations() * index.size());
+}
+BENCHMARK_TEMPLATE(BM_BlobKeyScan, false)->Unit(benchmark::kMicrosecond);
+BENCHMARK_TEMPLATE(BM_BlobKeyScan, true)->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_MAIN();
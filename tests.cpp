@@ -1,9 +1,32 @@
 // Copyright (c) 2024 PlatinumSamurai. All rights reserved.
 
 #include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <compare>
+#include <cmath>
+#include <map>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
 #include <vector>
 #include <fstream>
+#include <thread>
+#include "avlmap/arena.hpp"
 #include "avlmap/avl.hpp"
+#include "avlmap/avl_multimap.hpp"
+#include "avlmap/blocked_avl.hpp"
+#include "avlmap/buffered_avl.hpp"
+#include "avlmap/filter.hpp"
+#include "avlmap/indexed_avl.hpp"
+#include "avlmap/interval_avl.hpp"
+#include "avlmap/mvcc_avl.hpp"
+#include "avlmap/separated_avl.hpp"
+#include "avlmap/sharded_avl.hpp"
+#include "avlmap/static_avl.hpp"
 
 
 TEST(avl_test, insert_test) {
@@ -228,6 +251,2066 @@ TEST(avl_test, use_of_stl_algorithms_test) {
 }
 
 
+TEST(avl_test, large_tree_test) {
+    Avl<int, int> tree;
+    const int n = 100000;
+
+    for (int i = 0; i < n; ++i) {
+        tree.insert({static_cast<int>((i * 7919L) % n), i});
+    }
+    ASSERT_EQ(tree.size(), n);
+
+    for (int i = 0; i < n; i += 2) {
+        tree.erase(i);
+    }
+    ASSERT_EQ(tree.size(), n / 2);
+    ASSERT_TRUE(tree.contains(n - 1));
+    ASSERT_FALSE(tree.contains(n - 2));
+
+    int expected = 1;
+    for (auto it = tree.begin(); it != tree.end(); ++it) {
+        ASSERT_EQ((*it).first, expected);
+        expected += 2;
+    }
+    ASSERT_EQ(expected, n + 1);
+
+    tree.clear();
+    ASSERT_TRUE(tree.empty());
+}
+
+
+TEST(avl_test, min_max_test) {
+    Avl<int, std::string> tree;
+
+    ASSERT_EQ(tree.begin(), tree.end());
+    ASSERT_THROW(tree.front(), std::out_of_range);
+    ASSERT_THROW(tree.pop_max(), std::out_of_range);
+
+    tree.insert({5, "five"});
+    tree.insert({3, "three"});
+    tree.insert({8, "eight"});
+    tree.insert({1, "one"});
+    tree.insert({9, "nine"});
+
+    ASSERT_EQ(tree.front().first, 1);
+    ASSERT_EQ(tree.back().first, 9);
+    ASSERT_EQ((*tree.begin()).first, 1);
+    ASSERT_EQ((*tree.rbegin()).first, 9);
+
+    tree.erase(1);
+    tree.erase(9);
+    ASSERT_EQ(tree.front().first, 3);
+    ASSERT_EQ(tree.back().first, 8);
+
+    ASSERT_EQ(tree.pop_min(), std::make_pair(3, std::string("three")));
+    ASSERT_EQ(tree.pop_max(), std::make_pair(8, std::string("eight")));
+    ASSERT_EQ(tree.front().first, 5);
+    ASSERT_EQ(tree.back().first, 5);
+
+    tree.pop_min();
+    ASSERT_TRUE(tree.empty());
+    ASSERT_EQ(tree.begin(), tree.end());
+
+    tree.clear();
+}
+
+
+TEST(avl_test, priority_queue_test) {
+    Avl<int, int> tree;
+
+    for (int i = 0; i < 1000; ++i) {
+        tree.insert({(i * 613) % 1000, i});
+    }
+    for (int i = 0; i < 500; ++i) {
+        ASSERT_EQ(tree.pop_min().first, i);
+        ASSERT_EQ(tree.pop_max().first, 999 - i);
+    }
+    ASSERT_TRUE(tree.empty());
+
+    tree.clear();
+}
+
+
+struct CaseInsensitiveLess {
+    bool operator()(const std::string &lhs, const std::string &rhs) const {
+        return std::lexicographical_compare(lhs.begin(), lhs.end(),
+                                            rhs.begin(), rhs.end(),
+                [](char a, char b) {return std::tolower(a) < std::tolower(b);});
+    }
+};
+
+
+struct Version {
+    int major;
+    int minor;
+
+    std::strong_ordering operator<=>(const Version &other) const {
+        return std::tie(major, minor) <=> std::tie(other.major, other.minor);
+    }
+};
+
+
+TEST(avl_test, comparator_equivalence_test) {
+    Avl<std::string, int, CaseInsensitiveLess> tree;
+
+    ASSERT_TRUE(tree.insert({"Path", 1}).second);
+    ASSERT_FALSE(tree.insert({"PATH", 2}).second);
+    ASSERT_TRUE(tree.contains("path"));
+    ASSERT_EQ((*tree.find("pAtH")).second, 1);
+
+    tree.erase(std::string("pATH"));
+    ASSERT_TRUE(tree.empty());
+
+    tree.clear();
+}
+
+
+struct VersionOrder {
+    std::strong_ordering operator()(const Version &lhs,
+                                    const Version &rhs) const {
+        return lhs <=> rhs;
+    }
+};
+
+
+TEST(avl_test, three_way_comparator_test) {
+    Avl<Version, int, VersionOrder> tree;
+
+    for (int i = 0; i < 100; ++i) {
+        tree.insert({{i % 10, i / 10}, i});
+    }
+    ASSERT_EQ(tree.size(), 100);
+    ASSERT_FALSE(tree.insert({{3, 4}, 0}).second);
+    ASSERT_EQ(tree.at({3, 4}), 43);
+    ASSERT_FALSE(tree.contains({10, 0}));
+
+    tree.erase({0, 0});
+    ASSERT_EQ(tree.front().first.minor, 1);
+    ASSERT_EQ(tree.back().first.major, 9);
+
+    tree.clear();
+}
+
+
+TEST(avl_test, node_handle_test) {
+    Avl<int, std::string> tree({{5, "hello"}, {3, "bye"}, {6, "me"},
+                                {4, "ou"}});
+    Avl<int, std::string> other;
+    const auto *address = &(*tree.find(3));
+
+    auto handle = tree.extract(3);
+    ASSERT_FALSE(handle.empty());
+    ASSERT_EQ(handle.mapped(), "bye");
+    ASSERT_EQ(tree.size(), 3);
+    ASSERT_FALSE(tree.contains(3));
+    ASSERT_TRUE(tree.extract(3).empty());
+
+    handle.key() = 30;
+    auto result = tree.insert(std::move(handle));
+    ASSERT_TRUE(result.inserted);
+    ASSERT_TRUE(result.node.empty());
+    ASSERT_EQ(&(*result.position), address);
+    ASSERT_EQ(tree.back().first, 30);
+
+    result = other.insert(tree.extract(tree.begin()));
+    ASSERT_TRUE(result.inserted);
+    ASSERT_EQ(other.front().first, 4);
+    ASSERT_EQ(tree.front().first, 5);
+
+    other.insert({5, "other"});
+    result = other.insert(tree.extract(5));
+    ASSERT_FALSE(result.inserted);
+    ASSERT_EQ(result.node.key(), 5);
+    ASSERT_EQ((*result.position).second, "other");
+    ASSERT_EQ(tree.size(), 2);
+    ASSERT_EQ(other.size(), 2);
+
+    tree.clear();
+    other.clear();
+}
+
+
+template <typename Tree>
+static int PrintedHeight(const Tree &tree) {
+    std::stringstream str;
+    std::string line;
+    int height = 0;
+
+    str << tree;
+    while (std::getline(str, line)) {
+        height = std::max<int>(height, line.find_first_not_of('\t') + 1);
+    }
+
+    return height;
+}
+
+
+TEST(avl_test, range_erase_test) {
+    Avl<int, std::string> tree({{5, "hello"}, {3, "bye"}, {6, "me"},
+                                {4, "ou"}, {12, "ok"}, {9, "ol"}, {7, "oh"},
+                                {10, "og"}, {15, "of"}, {16, "od"},
+                                {17, "os"}});
+    Avl<int, std::string> tree2({{3, "bye"}, {4, "ou"}, {15, "of"},
+                                 {16, "od"}, {17, "os"}});
+
+    ASSERT_EQ(tree.erase_range(5, 15), 6);
+    ASSERT_EQ(tree, tree2);
+    ASSERT_EQ(tree.front().first, 3);
+    ASSERT_EQ(tree.back().first, 17);
+
+    auto it = tree.erase(tree.find(4), tree.find(17));
+    ASSERT_EQ((*it).first, 17);
+    ASSERT_EQ(tree.size(), 2);
+
+    tree.erase(tree.begin(), tree.end());
+    ASSERT_TRUE(tree.empty());
+    ASSERT_EQ(tree.erase_range(0, 100), 0);
+
+    tree.clear();
+    tree2.clear();
+}
+
+
+TEST(avl_test, extract_range_test) {
+    Avl<int, int> tree;
+
+    for (int i = 0; i < 1000; ++i) {
+        tree.insert({i, i});
+    }
+
+    Avl<int, int> range = tree.extract_range(100, 900);
+    ASSERT_EQ(range.size(), 800);
+    ASSERT_EQ(tree.size(), 200);
+    ASSERT_EQ(range.front().first, 100);
+    ASSERT_EQ(range.back().first, 899);
+    ASSERT_EQ(tree.back().first, 999);
+    ASSERT_FALSE(tree.contains(500));
+    ASSERT_TRUE(range.contains(500));
+    ASSERT_LE(PrintedHeight(range), 1.44 * std::log2(800 + 2));
+    ASSERT_LE(PrintedHeight(tree), 1.44 * std::log2(200 + 2));
+
+    range.insert({1000, 0});
+    ASSERT_EQ(range.back().first, 1000);
+
+    tree.clear();
+    range.clear();
+}
+
+
+TEST(avl_test, random_range_erase_test) {
+    Avl<int, int> tree;
+    std::map<int, int> reference;
+    std::mt19937 gen(1);
+
+    for (int i = 0; i < 5000; ++i) {
+        int k = gen() % 20000;
+        tree.insert({k, i});
+        reference.insert({k, i});
+    }
+    for (int round = 0; round < 200; ++round) {
+        int lo = gen() % 20000;
+        int hi = lo + gen() % 300;
+        size_t expected = std::distance(reference.lower_bound(lo),
+                                                    reference.lower_bound(hi));
+        reference.erase(reference.lower_bound(lo), reference.lower_bound(hi));
+        ASSERT_EQ(tree.erase_range(lo, hi), expected);
+        tree.insert({lo, round});
+        reference.insert({lo, round});
+    }
+
+    ASSERT_EQ(tree.size(), reference.size());
+    ASSERT_TRUE(std::equal(tree.begin(), tree.end(), reference.begin()));
+    ASSERT_LE(PrintedHeight(tree), 1.44 * std::log2(reference.size() + 2));
+
+    tree.clear();
+}
+
+
+// Not commutative: any subtree folded out of key order shows up.
+struct KeyListAugment {
+    typedef std::string value_type;
+
+    static std::string identity() {
+        return "";
+    }
+
+    static std::string lift(int key, int) {
+        return std::to_string(key) + ",";
+    }
+
+    static std::string combine(const std::string &lhs,
+                                                    const std::string &rhs) {
+        return lhs + rhs;
+    }
+};
+
+
+TEST(avl_test, augmented_reduce_test) {
+    Avl<int, int, std::less<int>, std::allocator<std::pair<const int, int>>,
+                                                    SumAugment<long>> sums;
+    Avl<int, int, std::less<int>, std::allocator<std::pair<const int, int>>,
+                                                    MaxAugment<int>> maxima;
+    std::map<int, int> reference;
+    std::mt19937 gen(3);
+
+    for (int i = 0; i < 3000; ++i) {
+        int k = gen() % 5000;
+        int v = gen() % 1000 - 500;
+        if (gen() % 4 == 0) {
+            sums.erase(k);
+            maxima.erase(k);
+            reference.erase(k);
+        } else {
+            sums.insert_or_assign({k, v});
+            maxima.insert_or_assign({k, v});
+            reference[k] = v;
+        }
+    }
+    sums.erase_range(1000, 1200);
+    maxima.erase_range(1000, 1200);
+    reference.erase(reference.lower_bound(1000), reference.lower_bound(1200));
+
+    for (int round = 0; round < 300; ++round) {
+        int lo = gen() % 5000;
+        int hi = lo + gen() % 800;
+        long sum = 0;
+        int max = std::numeric_limits<int>::lowest();
+        for (auto it = reference.lower_bound(lo);
+                                    it != reference.lower_bound(hi); ++it) {
+            sum += it->second;
+            max = std::max(max, it->second);
+        }
+        ASSERT_EQ(sums.reduce(lo, hi), sum);
+        ASSERT_EQ(maxima.reduce(lo, hi), max);
+    }
+
+    long total = 0;
+    for (const auto &[k, v] : reference) {
+        total += v;
+    }
+    ASSERT_EQ(sums.reduce(), total);
+    ASSERT_EQ(sums.reduce(7, 7), 0);
+
+    sums.clear();
+    maxima.clear();
+}
+
+
+TEST(avl_test, augmented_order_test) {
+    Avl<int, int, std::less<int>, std::allocator<std::pair<const int, int>>,
+                                                    KeyListAugment> tree;
+
+    for (int k : {5, 1, 9, 3, 7, 2, 8, 4, 6}) {
+        tree.insert({k, 0});
+    }
+    ASSERT_EQ(tree.reduce(), "1,2,3,4,5,6,7,8,9,");
+    ASSERT_EQ(tree.reduce(3, 8), "3,4,5,6,7,");
+
+    auto node = tree.extract(5);
+    node.key() = 10;
+    tree.insert(std::move(node));
+    tree.pop_min();
+    ASSERT_EQ(tree.reduce(), "2,3,4,6,7,8,9,10,");
+    ASSERT_EQ(tree.reduce(0, 5), "2,3,4,");
+
+    auto range = tree.extract_range(4, 8);
+    ASSERT_EQ(range.reduce(), "4,6,7,");
+    ASSERT_EQ(tree.reduce(), "2,3,8,9,10,");
+
+    tree[11] = 1;
+    tree.refresh(tree.find(11));
+    ASSERT_EQ(tree.reduce(9, 12), "9,10,11,");
+
+    range.clear();
+    tree.clear();
+}
+
+
+TEST(interval_avl_test, stabbing_test) {
+    IntervalAvl<int, char> intervals;
+
+    intervals.insert(1, 5, 'a');
+    intervals.insert(3, 3, 'b');
+    intervals.insert(4, 10, 'c');
+    intervals.insert(12, 15, 'd');
+    ASSERT_THROW(intervals.insert(9, 2, 'e'), std::invalid_argument);
+
+    std::string hits;
+    for (auto it : intervals.stabbing(3)) {
+        hits += (*it).second;
+    }
+    ASSERT_EQ(hits, "ab");
+
+    hits.clear();
+    for (auto it : intervals.overlapping(5, 12)) {
+        hits += (*it).second;
+    }
+    ASSERT_EQ(hits, "acd");
+
+    ASSERT_TRUE(intervals.stabbing(11).empty());
+    ASSERT_EQ(intervals.erase(4, 10), 1);
+    ASSERT_EQ(intervals.erase(4, 10), 0);
+    ASSERT_EQ(intervals.overlapping(6, 11).size(), 0);
+}
+
+
+TEST(interval_avl_test, random_overlap_test) {
+    IntervalAvl<int, int> intervals;
+    std::map<std::pair<int, int>, int> reference;
+    std::mt19937 gen(5);
+
+    for (int i = 0; i < 4000; ++i) {
+        int lo = gen() % 100000;
+        int hi = lo + gen() % 2000;
+        intervals.insert(lo, hi, i);
+        reference.insert({{lo, hi}, i});
+        if (i % 3 == 0) {
+            auto victim = reference.begin();
+            std::advance(victim, gen() % reference.size());
+            intervals.erase(victim->first.first, victim->first.second);
+            reference.erase(victim);
+        }
+    }
+    ASSERT_EQ(intervals.size(), reference.size());
+
+    for (int round = 0; round < 300; ++round) {
+        int a = gen() % 100000;
+        int b = a + gen() % 500;
+        std::vector<int> expected;
+        for (const auto &[interval, value] : reference) {
+            if (interval.first <= b && a <= interval.second) {
+                expected.push_back(value);
+            }
+        }
+
+        std::vector<int> actual;
+        for (auto it : intervals.overlapping(a, b)) {
+            actual.push_back((*it).second);
+        }
+        ASSERT_EQ(actual, expected);
+    }
+}
+
+
+TEST(avl_test, string_prefix_cache_test) {
+    Avl<std::string, int, std::less<std::string>,
+            std::allocator<std::pair<const std::string, int>>, NoAugment,
+                                                    StringPrefix> tree;
+    std::map<std::string, int> reference;
+    std::mt19937 gen(13);
+    const std::string alphabet("a/\0\xff", 4);
+
+    for (int i = 0; i < 5000; ++i) {
+        std::string key(gen() % 3 ? "/tenant/" : "");
+        for (int n = gen() % 12; n > 0; --n) {
+            key += alphabet[gen() % alphabet.size()];
+        }
+        if (gen() % 4 == 0) {
+            ASSERT_EQ(tree.extract(key).empty(), reference.erase(key) == 0);
+        } else {
+            ASSERT_EQ(tree.insert({key, i}).second,
+                                        reference.insert({key, i}).second);
+        }
+    }
+    for (const auto &[key, value] : reference) {
+        ASSERT_EQ(tree.at(key), value);
+        ASSERT_EQ(tree.contains(key + '\0'),
+                                        reference.count(key + '\0') == 1);
+    }
+    ASSERT_TRUE(std::equal(tree.begin(), tree.end(), reference.begin()));
+
+    auto node = tree.extract(tree.begin());
+    node.key() = std::string(16, '\xff');
+    tree.insert(std::move(node));
+    ASSERT_EQ(tree.back().first, std::string(16, '\xff'));
+    ASSERT_TRUE(tree.contains(std::string(16, '\xff')));
+
+    tree.clear();
+}
+
+
+TEST(avl_test, copy_test) {
+    Avl<int, int, std::less<int>, std::allocator<std::pair<const int, int>>,
+                                                    SumAugment<int>> tree;
+    for (int i = 0; i < 1000; ++i) {
+        tree.insert({(i * 37) % 1000, i});
+    }
+
+    auto copy = tree;
+    ASSERT_TRUE(copy == tree);
+    ASSERT_EQ(copy.reduce(), tree.reduce());
+    ASSERT_EQ(copy.reduce(100, 200), tree.reduce(100, 200));
+
+    for (int i = 0; i < 1000; i += 2) {
+        copy.erase(i);
+    }
+    copy[5] = -1;
+    copy.refresh(copy.find(5));
+    ASSERT_EQ(tree.size(), 1000);
+    ASSERT_EQ(copy.size(), 500);
+    ASSERT_EQ(tree.at(5), 865);
+
+    int sum = 0;
+    for (const auto &[key, value] : copy) {
+        sum += value;
+    }
+    ASSERT_EQ(copy.reduce(), sum);
+
+    std::vector<int> keys;
+    for (auto it = copy.end(); it != copy.begin();) {
+        keys.push_back((*--it).first);
+    }
+    ASSERT_EQ(keys.size(), 500);
+    ASSERT_TRUE(std::is_sorted(keys.rbegin(), keys.rend()));
+
+    tree = copy;
+    ASSERT_TRUE(tree == copy);
+    tree = tree;
+    ASSERT_EQ(tree.size(), 500);
+}
+
+
+TEST(avl_test, parallel_clone_test) {
+    Avl<int, int> tree;
+    std::mt19937 gen(5);
+
+    for (int i = 0; i < 100000; ++i) {
+        tree.insert({static_cast<int>(gen() % 1000000), i});
+    }
+
+    for (unsigned threads : {1u, 2u, 4u, 7u}) {
+        auto copy = tree.clone(threads);
+        ASSERT_TRUE(copy == tree);
+        ASSERT_EQ((*--copy.end()).first, (*--tree.end()).first);
+
+        auto it = copy.begin();
+        while (it != copy.end()) {
+            it = copy.erase(it);
+            if (it != copy.end()) {
+                ++it;
+            }
+        }
+        ASSERT_EQ(copy.size(), (tree.size() + 1) / 2);
+    }
+}
+
+
+// Copies of this value throw once limit copies have been made, from any
+// thread.
+struct Fragile {
+    static inline std::atomic<long> copies = 0;
+    static inline long limit = -1;
+    std::string payload = std::string(40, 'f');
+
+    Fragile() = default;
+    Fragile(const Fragile &other) : payload(other.payload) {
+        if (limit >= 0 && ++copies > limit) {
+            throw std::runtime_error("copy failed");
+        }
+    }
+};
+
+
+TEST(avl_test, clone_throw_test) {
+    Avl<int, Fragile> tree;
+
+    for (int i = 0; i < 50000; ++i) {
+        tree.insert({i, Fragile()});
+    }
+
+    for (unsigned threads : {1u, 4u}) {
+        Fragile::copies = 0;
+        Fragile::limit = 30000;
+        ASSERT_THROW(tree.clone(threads), std::runtime_error);
+        Fragile::limit = -1;
+    }
+    Avl<int, Fragile> copy(tree);
+    ASSERT_EQ(copy.size(), tree.size());
+}
+
+
+TEST(avl_test, arena_copy_test) {
+    typedef std::pair<const std::string, int> Pair;
+    Avl<std::string, int, std::less<std::string>, ArenaAllocator<Pair>> tree;
+
+    for (int i = 0; i < 5000; ++i) {
+        tree.insert({std::to_string(i), i});
+    }
+
+    auto copy = tree;
+    auto arena = copy.clone(1);
+    ASSERT_TRUE(copy == tree);
+    ASSERT_TRUE(arena == tree);
+    ASSERT_EQ(arena.at("4321"), 4321);
+
+    copy.erase(std::string("17"));
+    copy["new"] = 1;
+    ASSERT_TRUE(tree.contains("17"));
+    ASSERT_FALSE(tree.contains("new"));
+
+    auto node = tree.extract("42");
+    tree.clear();
+    ASSERT_EQ(node.mapped(), 42);
+    ASSERT_EQ(copy.size(), 5000);
+
+    ArenaAllocator<Pair> source;
+    source.allocate(1000);
+    auto target = std::allocator_traits<ArenaAllocator<Pair>>::
+                            select_on_container_copy_construction(source);
+    ASSERT_FALSE(target == source);
+    ASSERT_EQ(target.arena()->used(), 0);
+    ASSERT_GE(target.arena()->capacity(), source.arena()->used());
+}
+
+
+TEST(avl_test, placed_arena_test) {
+    typedef std::pair<const int, int> Pair;
+    ArenaPlacement huge;
+    huge.huge_pages = true;
+    huge.numa_node = 0;
+    ArenaPlacement spread;
+    spread.interleave = true;
+
+    for (const ArenaPlacement &placement : {huge, spread}) {
+        auto arena = std::make_shared<Arena>(1000, placement);
+        ASSERT_EQ(arena->capacity() % Arena::kHugePage, 0);
+
+        Avl<int, int, std::less<int>, ArenaAllocator<Pair>>
+                                        tree{ArenaAllocator<Pair>(arena)};
+        for (int i = 0; i < 100000; ++i) {
+            tree.insert({i * 7 % 100000, i});
+        }
+        ASSERT_EQ(tree.size(), 100000);
+        ASSERT_EQ(tree.at(7), 1);
+        ASSERT_GE(arena->used(), 100000 * 2 * sizeof(Pair));
+
+        auto copy = tree;
+        ASSERT_TRUE(copy == tree);
+    }
+}
+
+
+struct Blob {
+    std::vector<char> data;
+
+    bool operator==(const Blob &) const = default;
+};
+
+
+template <>
+struct DeepSize<Blob> {
+    static size_t of(const Blob &blob) {
+        return blob.data.capacity();
+    }
+};
+
+
+TEST(avl_test, memory_usage_test) {
+    typedef std::pair<const int, Blob> Pair;
+    Avl<int, Blob> tree;
+    ASSERT_EQ(tree.memory_usage().total(), 0);
+
+    for (int i = 0; i < 100; ++i) {
+        tree.insert({i, Blob{std::vector<char>(i)}});
+    }
+    MemoryUsage usage = tree.memory_usage();
+    ASSERT_EQ(tree.size(), 100);
+    ASSERT_EQ(usage.pairs, 100 * sizeof(Pair));
+    ASSERT_EQ(usage.nodes % 100, 0);
+    ASSERT_GT(usage.nodes, 100 * sizeof(Node<int, Blob>));
+    ASSERT_EQ(usage.deep, 99 * 100 / 2);
+
+    tree[10].data.resize(1000);
+    tree.refresh(tree.find(10));
+    ASSERT_EQ(tree.memory_usage().deep, 99 * 100 / 2 - 10 + 1000);
+    tree[10].data = std::vector<char>(10);
+    tree.refresh(tree.find(10));
+
+    auto range = tree.extract_range(20, 40);
+    auto node = tree.extract(90);
+    ASSERT_EQ(range.size(), 20);
+    ASSERT_EQ(tree.size(), 79);
+    ASSERT_EQ(tree.memory_usage().deep + range.memory_usage().deep + 90,
+                                                                usage.deep);
+
+    tree.insert(std::move(node));
+    tree.insert_or_assign({0, Blob{std::vector<char>(7)}});
+    tree.erase(1);
+    ASSERT_EQ(tree.size(), 79);
+    ASSERT_EQ(tree.memory_usage().deep + range.memory_usage().deep,
+                                                        usage.deep + 7 - 1);
+
+    auto copy = tree;
+    ASSERT_EQ(copy.memory_usage().total(), tree.memory_usage().total());
+    tree.clear();
+    ASSERT_EQ(tree.memory_usage().total(), 0);
+}
+
+
+TEST(avl_test, memory_registry_test) {
+    std::ostringstream out;
+    {
+        Avl<int, int> small;
+        Avl<int, int> large;
+        small.track("small");
+        large.track("large");
+        for (int i = 0; i < 100; ++i) {
+            large.insert({i, i});
+        }
+        small.insert({1, 1});
+
+        auto usages = MemoryRegistry::instance().snapshot();
+        ASSERT_EQ(usages.size(), 2);
+        ASSERT_EQ(usages[0].first, "large");
+        ASSERT_EQ(usages[0].second.total(), large.memory_usage().total());
+        MemoryRegistry::instance().dump(out);
+    }
+    ASSERT_NE(out.str().find("small: "), std::string::npos);
+    ASSERT_TRUE(MemoryRegistry::instance().snapshot().empty());
+}
+
+
+TEST(avl_test, memory_registry_move_test) {
+    {
+        Avl<int, int> source;
+        source.track("cache");
+        for (int i = 0; i < 100; ++i) {
+            source.insert({i, i});
+        }
+
+        Avl<int, int> moved(std::move(source));
+        auto usages = MemoryRegistry::instance().snapshot();
+        ASSERT_EQ(usages.size(), 1);
+        ASSERT_EQ(usages[0].first, "cache");
+        ASSERT_EQ(usages[0].second.total(), moved.memory_usage().total());
+        ASSERT_GT(usages[0].second.total(), 0);
+
+        Avl<int, int> target;
+        target.insert({1, 1});
+        target = std::move(moved);
+        usages = MemoryRegistry::instance().snapshot();
+        ASSERT_EQ(usages.size(), 1);
+        ASSERT_EQ(usages[0].second.total(), target.memory_usage().total());
+        ASSERT_EQ(target.size(), 100);
+    }
+    ASSERT_TRUE(MemoryRegistry::instance().snapshot().empty());
+}
+
+TEST(avl_test, diff_test) {
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<int> dist(0, 199);
+    Avl<int, int> before;
+    Avl<int, int> after;
+    std::map<int, int> lhs;
+    std::map<int, int> rhs;
+
+    for (int i = 0; i < 300; ++i) {
+        int k = dist(gen);
+        int v = dist(gen) % 3;
+        before.insert_or_assign({k, v});
+        lhs[k] = v;
+        k = dist(gen);
+        v = dist(gen) % 3;
+        after.insert_or_assign({k, v});
+        rhs[k] = v;
+    }
+
+    auto changes = diff(before, after);
+    ASSERT_TRUE(std::is_sorted(changes.begin(), changes.end(),
+                                    [](const auto &a, const auto &b) {
+        return a.key < b.key;
+    }));
+    for (const auto &change : changes) {
+        lhs.erase(change.key);
+        if (change.kind != ChangeKind::erased) {
+            lhs[change.key] = *change.after;
+        }
+        ASSERT_EQ(change.kind == ChangeKind::inserted, !change.before);
+    }
+    ASSERT_EQ(lhs, rhs);
+    ASSERT_TRUE(diff(after, after).empty());
+}
+
+
+TEST(avl_test, change_log_test) {
+    std::mt19937 gen(7);
+    std::uniform_int_distribution<int> dist(0, 99);
+    Avl<int, int> tree;
+
+    for (int i = 0; i < 60; ++i) {
+        tree.insert({dist(gen), i});
+    }
+    ASSERT_TRUE(tree.changes().empty());
+    tree.enable_change_log();
+    for (int round = 0; round < 3; ++round) {
+        Avl<int, int> copy(tree);
+        for (int i = 0; i < 100; ++i) {
+            int k = dist(gen);
+            switch (dist(gen) % 6) {
+            case 0:
+                tree.erase(k);
+                break;
+            case 1:
+                tree[k] += 1;
+                break;
+            case 2:
+                tree.insert_or_assign({k, i});
+                break;
+            case 3:
+                tree.erase_range(k, k + 3);
+                break;
+            case 4:
+                if (!tree.empty()) {
+                    tree.pop_max();
+                }
+                break;
+            default:
+                tree.insert({k, -i});
+            }
+        }
+
+        auto expected = diff(copy, tree);
+        auto logged = tree.changes();
+        ASSERT_EQ(logged.size(), expected.size());
+        for (size_t i = 0; i < logged.size(); ++i) {
+            ASSERT_EQ(logged[i].kind, expected[i].kind);
+            ASSERT_EQ(logged[i].key, expected[i].key);
+            ASSERT_EQ(logged[i].before, expected[i].before);
+            ASSERT_EQ(logged[i].after, expected[i].after);
+        }
+        tree.checkpoint();
+    }
+
+    tree.clear();
+    ASSERT_FALSE(tree.changes().empty());
+    tree.disable_change_log();
+    ASSERT_TRUE(tree.changes().empty());
+}
+
+TEST(avl_test, filter_test) {
+    std::mt19937 gen(3);
+    std::uniform_int_distribution<int> dist(0, 4999);
+    Avl<int, int> tree;
+    std::map<int, int> reference;
+
+    for (int i = 0; i < 500; ++i) {
+        int k = dist(gen);
+        tree.insert({k, i});
+        reference.insert({k, i});
+    }
+    tree.enable_filter({.capacity = 64, .fp_rate = 0.01});
+    ASSERT_GT(tree.memory_usage().filters, 0);
+
+    for (int i = 0; i < 20000; ++i) {
+        int k = dist(gen);
+        switch (i % 4) {
+        case 0:
+            tree.erase(k);
+            reference.erase(k);
+            break;
+        case 1:
+            tree.erase_range(k, k + 10);
+            reference.erase(reference.lower_bound(k),
+                                                reference.lower_bound(k + 10));
+            break;
+        default:
+            tree.insert({k, i});
+            reference.insert({k, i});
+        }
+    }
+    for (int k = 0; k < 5000; ++k) {
+        ASSERT_EQ(tree.contains(k), reference.count(k) == 1);
+        ASSERT_EQ(tree.find(k) != tree.end(), reference.count(k) == 1);
+    }
+
+    Avl<int, int> copy(tree);
+    ASSERT_EQ(copy.memory_usage().filters, tree.memory_usage().filters);
+    tree.clear();
+    ASSERT_FALSE(tree.contains(reference.begin()->first));
+    ASSERT_TRUE(copy.contains(reference.begin()->first));
+    tree.insert({1, 1});
+    ASSERT_TRUE(tree.contains(1));
+    tree.disable_filter();
+    ASSERT_EQ(tree.memory_usage().filters, 0);
+}
+
+
+template <typename Tree>
+constexpr bool kFilterable = requires(Tree &tree) { tree.enable_filter(); };
+
+
+// A filter hashing exact strings cannot serve a comparator that treats
+// "abc" and "ABC" as one key, so such trees do not offer one.
+TEST(avl_test, filter_comparator_test) {
+    typedef Avl<std::string, int, CaseInsensitiveLess> Folded;
+    typedef Avl<std::string, int, std::compare_three_way> Ordered;
+
+    static_assert(!kFilterable<Folded>);
+    static_assert(kFilterable<Ordered>);
+
+    Folded folded;
+    folded.insert({"abc", 1});
+    ASSERT_TRUE(folded.contains("ABC"));
+    ASSERT_FALSE(folded.insert({"ABC", 2}).second);
+
+    Ordered ordered;
+    ordered.insert({"abc", 1});
+    ordered.enable_filter();
+    ASSERT_TRUE(ordered.contains("abc"));
+    ASSERT_FALSE(ordered.contains("ABC"));
+}
+
+
+TEST(avl_test, filter_rate_test) {
+    CountingBloomFilter<int> filter({.capacity = 10000, .fp_rate = 0.01});
+    int positives = 0;
+
+    for (int k = 0; k < 10000; ++k) {
+        filter.add(k);
+    }
+    for (int k = 0; k < 10000; ++k) {
+        ASSERT_TRUE(filter.may_contain(k));
+    }
+    for (int k = 10000; k < 110000; ++k) {
+        positives += filter.may_contain(k);
+    }
+    ASSERT_LT(positives, 2000);
+
+    for (int k = 0; k < 10000; ++k) {
+        filter.remove(k);
+    }
+    positives = 0;
+    for (int k = 0; k < 110000; ++k) {
+        positives += filter.may_contain(k);
+    }
+    ASSERT_LT(positives, 100);
+
+    CountingBloomFilter<int> small({.capacity = 10000, .max_bytes = 4096});
+    ASSERT_EQ(small.memory_usage(), 4096);
+}
+
+TEST(avl_test, cursor_test) {
+    std::mt19937 gen(17);
+    std::uniform_int_distribution<int> dist(0, 9999);
+    Avl<int, int> tree;
+    std::map<int, int> reference;
+    auto cursor = tree.cursor();
+
+    ASSERT_FALSE(cursor.seek(5));
+    ASSERT_EQ(cursor.position(), tree.end());
+    for (int i = 0; i < 3000; ++i) {
+        int k = (i % 2 ? dist(gen) : (i * 7) % 10000);
+        auto result = cursor.insert({k, i});
+        ASSERT_EQ(result.second, reference.insert({k, i}).second);
+        ASSERT_EQ((*cursor.position()).first, k);
+    }
+    ASSERT_EQ(tree.size(), reference.size());
+    ASSERT_LE(PrintedHeight(tree), 1.44 * std::log2(tree.size() + 2));
+
+    for (int i = 0; i < 20000; ++i) {
+        int k = (i < 10000 ? i : dist(gen));
+        auto expected = reference.lower_bound(k);
+        ASSERT_EQ(cursor.seek(k), expected != reference.end() &&
+                                                    expected->first == k);
+        if (expected == reference.end()) {
+            ASSERT_EQ(cursor.position(), tree.end());
+        } else {
+            ASSERT_EQ((*cursor.position()).first, expected->first);
+        }
+    }
+}
+
+
+TEST(avl_test, cursor_merge_join_test) {
+    Avl<std::string, int, std::less<std::string>,
+            std::allocator<std::pair<const std::string, int>>, NoAugment,
+                                                    StringPrefix> lhs, rhs;
+    for (int i = 0; i < 2000; ++i) {
+        lhs.insert({"key" + std::to_string(i * 3), i});
+        rhs.insert({"key" + std::to_string(i * 5), i});
+    }
+
+    auto cursor = rhs.cursor();
+    std::vector<std::string> joined;
+    for (auto it = lhs.begin(); it != lhs.end(); ++it) {
+        if (cursor.seek((*it).first)) {
+            joined.push_back((*it).first);
+        }
+    }
+
+    std::vector<std::string> expected;
+    for (auto it = lhs.begin(); it != lhs.end(); ++it) {
+        if (rhs.contains((*it).first)) {
+            expected.push_back((*it).first);
+        }
+    }
+    ASSERT_EQ(joined, expected);
+    ASSERT_EQ(joined.size(), 400);
+}
+
+
+// Random inserts, erases and range cuts under one balancing policy, checked
+// against std::map, the subtree sums and the policy's height bound.
+template <typename Balance>
+static void CheckBalance(double bound) {
+    Avl<int, int, std::less<int>, std::allocator<std::pair<const int, int>>,
+                            SumAugment<int>, NoKeyCache, Balance> tree;
+    std::map<int, int> reference;
+    std::mt19937 gen(7);
+
+    for (int i = 0; i < 20000; ++i) {
+        int k = gen() % 8000;
+        if (gen() % 3) {
+            tree.insert({k, i % 100});
+            reference.insert({k, i % 100});
+        } else if (reference.erase(k)) {
+            tree.erase(k);
+        }
+        if (i % 500 == 0) {
+            int hi = k + gen() % 200;
+            reference.erase(reference.lower_bound(k),
+                                                reference.lower_bound(hi));
+            tree.erase_range(k, hi);
+        }
+    }
+
+    int sum = 0;
+    for (const auto &[k, v] : reference) {
+        sum += v;
+    }
+    ASSERT_EQ(tree.size(), reference.size());
+    ASSERT_TRUE(std::equal(tree.begin(), tree.end(), reference.begin()));
+    ASSERT_EQ(tree.reduce(), sum);
+    ASSERT_LE(PrintedHeight(tree), bound * std::log2(reference.size() + 2));
+    ASSERT_GT(tree.rotations(), 0);
+
+    auto range = tree.extract_range(2000, 6000);
+    ASSERT_EQ(range.size() + tree.size(), reference.size());
+    ASSERT_LE(PrintedHeight(range), bound * std::log2(range.size() + 2));
+    ASSERT_LE(PrintedHeight(tree), bound * std::log2(tree.size() + 2));
+
+    int left = range.reduce();
+    while (!range.empty()) {
+        left -= range.pop_min().second;
+        ASSERT_EQ(range.reduce(), left);
+    }
+}
+
+
+TEST(avl_test, red_black_policy_test) {
+    CheckBalance<RedBlackBalance>(2);
+}
+
+
+TEST(avl_test, weight_balance_policy_test) {
+    CheckBalance<WeightBalance>(2);
+}
+
+
+// The ranges of partition(k) must tile the tree in key order, and none may
+// hold more than bound times its share.
+template <typename Tree>
+static void CheckPartition(double bound) {
+    Tree tree;
+    std::mt19937 gen(11);
+
+    ASSERT_TRUE(tree.partition(4).empty());
+    for (int i = 0; i < 50000; ++i) {
+        tree.insert({int(gen() % 1000000), i});
+    }
+
+    for (size_t k : {1, 3, 8, 32}) {
+        auto ranges = tree.partition(k);
+        ASSERT_FALSE(ranges.empty());
+        ASSERT_LE(ranges.size(), k);
+        ASSERT_TRUE(ranges.front().first == tree.begin());
+        ASSERT_TRUE(ranges.back().second == tree.end());
+
+        size_t total = 0;
+        for (size_t i = 0; i < ranges.size(); ++i) {
+            if (i) {
+                ASSERT_TRUE(ranges[i].first == ranges[i - 1].second);
+            }
+            size_t n = 0;
+            for (auto it = ranges[i].first; it != ranges[i].second; ++it) {
+                ++n;
+            }
+            ASSERT_GT(n, 0);
+            ASSERT_LE(n, bound * tree.size() / k + 1);
+            total += n;
+        }
+        ASSERT_EQ(total, tree.size());
+    }
+}
+
+
+TEST(avl_test, partition_test) {
+    typedef std::allocator<std::pair<const int, int>> Allocator;
+
+    CheckPartition<Avl<int, int>>(2);
+    CheckPartition<Avl<int, int, std::less<int>, Allocator, NoAugment,
+                                        NoKeyCache, RedBlackBalance>>(2);
+    CheckPartition<Avl<int, int, std::less<int>, Allocator, NoAugment,
+                                        NoKeyCache, WeightBalance>>(1.3);
+    CheckPartition<Avl<int, int, std::less<int>, Allocator,
+                                                    CountAugment>>(1.3);
+}
+
+
+TEST(avl_test, parallel_for_each_test) {
+    Avl<int, int> tree;
+    long long expected = 0;
+
+    for (int i = 0; i < 20000; ++i) {
+        tree.insert({i * 7 % 20011, i});
+        expected += i;
+    }
+
+    for (unsigned threads : {1u, 4u, 16u}) {
+        std::atomic<long long> sum = 0;
+        std::atomic<int> visits = 0;
+        parallel_for_each(tree, [&](std::pair<const int, int> &pair) {
+            sum += pair.second;
+            ++visits;
+            pair.second += 1;
+        }, threads);
+        ASSERT_EQ(visits, 20000);
+        ASSERT_EQ(sum, expected);
+        expected += 20000;
+    }
+}
+
+
+TEST(avl_test, clear_async_test) {
+    Avl<int, std::string> tree;
+
+    for (int round = 0; round < 3; ++round) {
+        for (int i = 0; i < 5000; ++i) {
+            tree.insert({i, std::string(40, 'a' + round)});
+        }
+        tree.clear_async();
+        ASSERT_TRUE(tree.empty());
+        ASSERT_EQ(tree.size(), 0);
+        ASSERT_TRUE(tree.begin() == tree.end());
+        ASSERT_FALSE(tree.contains(10));
+    }
+
+    tree.insert({1, "kept"});
+    Reclaimer::instance().drain();
+    ASSERT_EQ(Reclaimer::instance().pending(), 0);
+    ASSERT_EQ(tree.at(1), "kept");
+}
+
+
+TEST(avl_test, deferred_range_erase_test) {
+    Avl<int, std::string> eager;
+    Avl<int, std::string> deferred;
+
+    for (int i = 0; i < 10000; ++i) {
+        eager.insert({i, std::string(40, 'e')});
+        deferred.insert({i, std::string(40, 'e')});
+    }
+    deferred.enable_filter();
+
+    ASSERT_EQ(eager.erase_range(1000, 9000), 8000);
+    ASSERT_EQ(deferred.erase_range(1000, 9000, Teardown::deferred), 8000);
+    auto it = deferred.erase(deferred.find(0), deferred.find(500),
+                                                        Teardown::deferred);
+    ASSERT_EQ((*it).first, 500);
+    eager.erase(eager.find(0), eager.find(500));
+
+    ASSERT_EQ(deferred.size(), 1500);
+    ASSERT_EQ(deferred.memory_usage().deep, eager.memory_usage().deep);
+    ASSERT_FALSE(deferred.contains(5000));
+    ASSERT_FALSE(deferred.contains(0));
+    ASSERT_TRUE(deferred.contains(9000));
+    ASSERT_TRUE(std::equal(deferred.begin(), deferred.end(), eager.begin()));
+
+    ASSERT_EQ(deferred.erase(5000), 0);
+    ASSERT_EQ(deferred.erase(9000), 1);
+    ASSERT_EQ(deferred.size(), 1499);
+
+    Reclaimer::instance().drain();
+    ASSERT_EQ(Reclaimer::instance().pending(), 0);
+}
+
+
+TEST(avl_test, clear_step_test) {
+    Avl<int, std::string> tree;
+
+    for (int i = 0; i < 10000; ++i) {
+        tree.insert({i, std::string(40, 'x')});
+    }
+    ASSERT_EQ(tree.clear_step(0), 10000);
+    ASSERT_TRUE(tree.empty());
+
+    int calls = 0;
+    for (size_t left = 10000; left; ++calls) {
+        tree.insert({calls, "new"});
+        size_t now = tree.clear_step(128);
+        ASSERT_EQ(now, left - std::min<size_t>(left, 128));
+        left = now;
+    }
+    ASSERT_EQ(calls, 79);
+    ASSERT_EQ(tree.size(), 79);
+    ASSERT_EQ(tree.at(42), "new");
+
+    ASSERT_EQ(tree.clear_step(50), 29);
+    ASSERT_TRUE(tree.empty());
+    tree.insert({1, "left for the destructor"});
+}
+
+
+// Pending clear_step() nodes must go with the allocator that made them.
+TEST(avl_test, move_after_clear_step_test) {
+    typedef std::pair<const int, std::string> Pair;
+    typedef Avl<int, std::string, std::less<int>, ArenaAllocator<Pair>> Tree;
+    Tree a;
+
+    for (int i = 0; i < 1000; ++i) {
+        a.insert({i, std::string(40, 'a')});
+    }
+    ASSERT_EQ(a.clear_step(10), 990);
+    {
+        Tree b;
+        b.insert({1, "b"});
+        a = std::move(b);
+    }
+    ASSERT_EQ(a.at(1), "b");
+    ASSERT_EQ(a.clear_step(10), 0);
+    ASSERT_TRUE(a.empty());
+
+    for (int i = 0; i < 1000; ++i) {
+        a.insert({i, std::string(40, 'c')});
+    }
+    ASSERT_EQ(a.clear_step(10), 990);
+    Tree c(std::move(a));
+    ASSERT_EQ(a.clear_step(10), 0);
+    ASSERT_EQ(c.clear_step(1000), 0);
+}
+
+
+TEST(avl_test, move_assign_reset_test) {
+    static_assert(std::is_nothrow_move_assignable_v<Avl<int, int>>);
+    Avl<int, int> target;
+    Avl<int, int> source;
+
+    target.enable_change_log();
+    for (int i = 0; i < 100; ++i) {
+        target.insert({i, i});
+        source.insert({-i, i});
+    }
+    target.enable_filter();
+    ASSERT_EQ(target.changes().size(), 100);
+
+    target = std::move(source);
+    ASSERT_EQ(target.size(), 100);
+    ASSERT_TRUE(target.contains(-99));
+    ASSERT_TRUE(target.changes().empty());
+    ASSERT_EQ(target.memory_usage().filters, 0);
+
+    ASSERT_TRUE(source.empty());
+    ASSERT_TRUE(source.changes().empty());
+    ASSERT_EQ(source.memory_usage().filters, 0);
+    source.insert({1, 1});
+    ASSERT_TRUE(source.contains(1));
+    ASSERT_TRUE(source.changes().empty());
+}
+
+
+TEST(avl_multimap_test, duplicate_order_test) {
+    AvlMultimap<int, int, std::less<int>, 3> events;
+
+    for (int i = 0; i < 10; ++i) {
+        events.insert({7, i});
+    }
+    events.insert({3, 100});
+    events.insert({9, 200});
+    ASSERT_EQ(events.size(), 12);
+    ASSERT_EQ(events.count(7), 10);
+    ASSERT_EQ(events.count(8), 0);
+
+    std::vector<int> values;
+    for (auto [it, last] = events.equal_range(7); it != last; ++it) {
+        values.push_back((*it).second);
+    }
+    ASSERT_EQ(values, std::vector<int>({0, 1, 2, 3, 4, 5, 6, 7, 8, 9}));
+
+    auto it = events.find(7);
+    while (it != events.end() && (*it).first == 7) {
+        it = ((*it).second % 3 == 0 ? events.erase(it) : ++it);
+    }
+    values.clear();
+    for (auto pair : events) {
+        values.push_back(pair.second);
+    }
+    ASSERT_EQ(values, std::vector<int>({100, 1, 2, 4, 5, 7, 8, 200}));
+
+    ASSERT_EQ(events.erase(7), 6);
+    ASSERT_EQ(events.size(), 2);
+    ASSERT_FALSE(events.contains(7));
+}
+
+
+TEST(avl_multimap_test, random_multimap_test) {
+    AvlMultimap<int, int> map;
+    std::multimap<int, int> reference;
+    std::mt19937 gen(9);
+
+    for (int i = 0; i < 20000; ++i) {
+        int k = gen() % 300;
+        if (gen() % 5 == 0) {
+            auto it = map.find(k);
+            auto expected = reference.find(k);
+            if (expected != reference.end()) {
+                for (int skip = gen() % reference.count(k); skip > 0; --skip) {
+                    ++it;
+                    ++expected;
+                }
+                map.erase(it);
+                reference.erase(expected);
+            }
+        } else {
+            map.insert({k, i});
+            reference.insert({k, i});
+        }
+    }
+
+    ASSERT_EQ(map.size(), reference.size());
+    ASSERT_TRUE(std::equal(map.begin(), map.end(), reference.begin(),
+            [](auto lhs, const auto &rhs) {
+                return lhs.first == rhs.first && lhs.second == rhs.second;
+            }));
+    for (int k = 0; k < 300; ++k) {
+        ASSERT_EQ(map.count(k), reference.count(k));
+    }
+}
+
+
+TEST(avl_multimap_test, multiset_test) {
+    AvlMultiset<std::string> words = {"b", "a", "b", "c", "b"};
+
+    ASSERT_EQ(words.size(), 5);
+    ASSERT_EQ(words.count("b"), 3);
+
+    std::string joined;
+    for (const auto &word : words) {
+        joined += word;
+    }
+    ASSERT_EQ(joined, "abbbc");
+
+    words.erase(words.find("b"));
+    ASSERT_EQ(words.count("b"), 2);
+    ASSERT_EQ(words.erase("b"), 2);
+    ASSERT_EQ(words.size(), 2);
+    ASSERT_EQ(words.erase("b"), 0);
+
+    auto range = words.equal_range("a");
+    ASSERT_EQ(*words.erase(range.first), "c");
+    ASSERT_FALSE(words.contains("a"));
+    for (int i = 0; i < 3; ++i) {
+        words.insert("c");
+    }
+
+    auto last = words.begin();
+    std::advance(last, 3);
+    ASSERT_TRUE(words.erase(last) == words.end());
+    ASSERT_EQ(std::distance(words.begin(), words.end()), 3);
+    ASSERT_EQ(words.size(), 3);
+}
+
+
+TEST(blocked_avl_test, map_api_test) {
+    BlockedAvl<std::string, int> tree = {{"b", 2}, {"a", 1}, {"c", 3}};
+
+    ASSERT_FALSE(tree.insert({"a", 7}).second);
+    ASSERT_EQ(tree.at("a"), 1);
+    ASSERT_THROW(tree.at("d"), std::out_of_range);
+    tree["d"] = 4;
+    ASSERT_EQ(tree.size(), 4);
+    ASSERT_EQ(tree.front().first, "a");
+    ASSERT_EQ(tree.back().first, "d");
+
+    std::string keys;
+    for (auto it = tree.rbegin(); it != tree.rend(); ++it) {
+        keys += (*it).first;
+    }
+    ASSERT_EQ(keys, "dcba");
+
+    ASSERT_EQ(tree.pop_min().second, 1);
+    ASSERT_EQ(tree.pop_max().second, 4);
+    ASSERT_EQ(tree.erase("b"), 1);
+    ASSERT_EQ(tree.erase("b"), 0);
+    ASSERT_EQ(tree.size(), 1);
+    ASSERT_TRUE(tree.contains("c"));
+}
+
+
+TEST(blocked_avl_test, random_split_merge_test) {
+    BlockedAvl<int, int, std::less<int>, 8> tree;
+    std::map<int, int> reference;
+    std::mt19937 gen(17);
+
+    for (int round = 0; round < 40000; ++round) {
+        int k = gen() % 4000;
+        if (round % 20000 < 12000) {
+            ASSERT_EQ(tree.insert({k, round}).second,
+                                    reference.insert({k, round}).second);
+        } else {
+            tree.erase(k);
+            reference.erase(k);
+        }
+    }
+    ASSERT_EQ(tree.size(), reference.size());
+    ASSERT_TRUE(std::equal(tree.begin(), tree.end(), reference.begin()));
+    ASSERT_LE(tree.block_count(), reference.size() / 2 + 1);
+
+    auto it = tree.begin();
+    auto expected = reference.begin();
+    while (it != tree.end()) {
+        if (it->first % 3 == 0) {
+            it = tree.erase(it);
+            expected = reference.erase(expected);
+        } else {
+            ++it;
+            ++expected;
+        }
+        ASSERT_EQ(it == tree.end(), expected == reference.end());
+        if (it != tree.end()) {
+            ASSERT_EQ(it->first, expected->first);
+        }
+    }
+    ASSERT_TRUE(std::equal(tree.begin(), tree.end(), reference.begin()));
+    ASSERT_TRUE(std::equal(tree.rbegin(), tree.rend(), reference.rbegin()));
+
+    while (!tree.empty()) {
+        tree.erase(tree.begin());
+    }
+    ASSERT_EQ(tree.begin(), tree.end());
+    ASSERT_EQ(tree.block_count(), 0);
+}
+
+
+TEST(blocked_avl_test, balance_policy_test) {
+    BlockedAvl<int, int, std::less<int>, 8, RedBlackBalance> redBlack;
+    BlockedAvl<int, int, std::less<int>, 8, WeightBalance> weight;
+    std::map<int, int> reference;
+    std::mt19937 gen(23);
+
+    for (int round = 0; round < 30000; ++round) {
+        int k = gen() % 3000;
+        if (round % 10000 < 7000) {
+            reference.insert({k, round});
+            redBlack.insert({k, round});
+            weight.insert({k, round});
+        } else {
+            reference.erase(k);
+            redBlack.erase(k);
+            weight.erase(k);
+        }
+    }
+    ASSERT_EQ(redBlack.size(), reference.size());
+    ASSERT_EQ(weight.size(), reference.size());
+    ASSERT_TRUE(std::equal(redBlack.begin(), redBlack.end(),
+                                                        reference.begin()));
+    ASSERT_TRUE(std::equal(weight.rbegin(), weight.rend(),
+                                                        reference.rbegin()));
+}
+
+
+// Copies throw while fail is set; moves never do.
+struct Brittle {
+    static inline bool fail = false;
+    std::string payload;
+
+    explicit Brittle(std::string p) : payload(std::move(p)) {}
+    Brittle(const Brittle &other) : payload(other.payload) {
+        if (fail) {
+            throw std::runtime_error("copy failed");
+        }
+    }
+    Brittle(Brittle &&) noexcept = default;
+};
+
+
+TEST(blocked_avl_test, insert_throw_test) {
+    BlockedAvl<int, Brittle, std::less<int>, 8> tree;
+
+    for (int i = 1; i < 7; ++i) {
+        tree.insert({i, Brittle(std::string(40, 'a' + i))});
+    }
+
+    Brittle::fail = true;
+    ASSERT_THROW(tree.insert({0, Brittle(std::string(40, 'z'))}),
+                                                        std::runtime_error);
+    Brittle::fail = false;
+
+    ASSERT_EQ(tree.size(), 6);
+    ASSERT_FALSE(tree.contains(0));
+    for (int i = 1; i < 7; ++i) {
+        ASSERT_EQ(tree.at(i).payload, std::string(40, 'a' + i));
+    }
+    ASSERT_TRUE(tree.insert({0, Brittle("z")}).second);
+    ASSERT_EQ(tree.front().second.payload, "z");
+}
+
+
+TEST(indexed_avl_test, insert_test) {
+    IndexedAvl<int, std::string> tree(5, "hello");
+    tree.insert(std::make_pair(3, "bye"));
+    tree.insert(std::make_pair(6, "me"));
+    tree.insert(std::make_pair(4, "ou"));
+    tree.insert(std::make_pair(12, "ok"));
+    tree.insert(std::make_pair(9, "ol"));
+    tree.insert(std::make_pair(7, "oh"));
+    tree.insert(std::make_pair(10, "og"));
+    tree.insert(std::make_pair(15, "of"));
+    tree.insert(std::make_pair(16, "od"));
+    tree.insert(std::make_pair(17, "os"));
+
+    std::stringstream str1;
+    std::stringstream str2;
+    std::ifstream fin("resources/insert_test.txt");
+
+    str2 << fin.rdbuf();
+    str1 << tree;
+
+    fin.close();
+
+    ASSERT_EQ(str1.str(), str2.str());
+    ASSERT_EQ(tree.size(), 11);
+    ASSERT_FALSE(tree.insert({9, "again"}).second);
+}
+
+
+TEST(indexed_avl_test, erase_test) {
+    IndexedAvl<int, std::string> tree({{5, "hello"}, {3, "bye"}, {6, "me"},
+                                       {4, "ou"}, {12, "ok"}, {9, "ol"},
+                                       {7, "oh"}, {10, "og"}, {15, "of"},
+                                       {16, "od"}, {17, "os"}});
+    IndexedAvl<int, std::string> tree2({{10, "og"}, {15, "of"}, {5, "hello"},
+                                        {6, "me"}, {4, "ou"}, {12, "ok"},
+                                        {7, "oh"}, {16, "od"}});
+
+    ASSERT_EQ(tree.erase(17), 1);
+    ASSERT_EQ(tree.erase(3), 1);
+    tree.erase(tree.find(9));
+    ASSERT_EQ(tree.erase(9), 0);
+
+    ASSERT_EQ(tree, tree2);
+
+    tree.insert({1, "reused"});
+    ASSERT_EQ(tree.size(), 9);
+    ASSERT_EQ((*tree.begin()).second, "reused");
+}
+
+
+TEST(indexed_avl_test, iteration_and_copy_test) {
+    IndexedAvl<int, int> tree;
+
+    for (int i = 0; i < 1000; ++i) {
+        tree[(i * 37) % 1000] = i;
+    }
+    for (int i = 0; i < 1000; i += 2) {
+        tree.erase(i);
+    }
+
+    IndexedAvl<int, int> copy(tree);
+    ASSERT_EQ(copy, tree);
+    ASSERT_EQ(copy.size(), 500);
+
+    int expected = 1;
+    for (auto it = copy.begin(); it != copy.end(); ++it) {
+        ASSERT_EQ((*it).first, expected);
+        expected += 2;
+    }
+    ASSERT_EQ((*copy.rbegin()).first, 999);
+    ASSERT_EQ((*--copy.end()).first, 999);
+
+    copy.clear();
+    ASSERT_TRUE(copy.empty());
+    ASSERT_EQ(tree.size(), 500);
+    ASSERT_THROW(tree.at(2), std::out_of_range);
+    ASSERT_EQ(tree.at(999), 27);
+}
+
+
+TEST(sharded_avl_test, routing_test) {
+    ShardedAvl<int, std::string> map({100, 200});
+
+    ASSERT_EQ(map.shard_count(), 3);
+    ASSERT_TRUE(map.insert({150, "b"}));
+    ASSERT_TRUE(map.insert({5, "a"}));
+    ASSERT_TRUE(map.insert({200, "c"}));
+    ASSERT_FALSE(map.insert({150, "again"}));
+
+    ASSERT_EQ(map.shard_sizes(), std::vector<size_t>({1, 1, 1}));
+    ASSERT_EQ(map.find(150), "b");
+    ASSERT_FALSE(map.find(151).has_value());
+    ASSERT_TRUE(map.contains(200));
+
+    ASSERT_EQ(map.erase(5), 1);
+    ASSERT_EQ(map.erase(5), 0);
+    ASSERT_EQ(map.size(), 2);
+}
+
+
+TEST(sharded_avl_test, ordered_iteration_and_rebalance_test) {
+    ShardedAvl<int, int> map({1000, 2000, 3000});
+
+    for (int i = 0; i < 900; ++i) {
+        map.insert({i, i});
+    }
+    for (int i = 3000; i < 3100; ++i) {
+        map.insert({i, i});
+    }
+
+    ASSERT_TRUE(map.rebalance());
+    ASSERT_LT(map.shard_sizes()[0], 900);
+    ASSERT_FALSE(map.rebalance(100.0));
+
+    for (int i = 0; i < 10; ++i) {
+        map.rebalance(1.5);
+    }
+
+    std::vector<int> keys;
+    map.for_each([&keys](const auto &pair) {keys.push_back(pair.first);});
+    ASSERT_EQ(keys.size(), 1000);
+    ASSERT_TRUE(std::is_sorted(keys.begin(), keys.end()));
+
+    auto bounds = map.boundaries();
+    ASSERT_TRUE(std::is_sorted(bounds.begin(), bounds.end()));
+    for (int i = 0; i < 900; ++i) {
+        ASSERT_EQ(map.find(i), i);
+    }
+    ASSERT_EQ(map.size(), 1000);
+}
+
+
+TEST(sharded_avl_test, three_way_comparator_test) {
+    ShardedAvl<Version, int, VersionOrder> map({{5, 0}, {2, 0}, {5, 0}});
+
+    ASSERT_EQ(map.shard_count(), 3);
+    for (int i = 0; i < 100; ++i) {
+        ASSERT_TRUE(map.insert({{i % 10, i / 10}, i}));
+    }
+    ASSERT_FALSE(map.insert({{3, 4}, 0}));
+    ASSERT_EQ(map.shard_sizes(), std::vector<size_t>({20, 30, 50}));
+    ASSERT_EQ(map.find({3, 4}), 43);
+    ASSERT_EQ(map.erase({0, 0}), 1);
+    ASSERT_FALSE(map.contains({0, 0}));
+
+    ASSERT_TRUE(map.rebalance(1.2));
+    ASSERT_EQ(map.size(), 99);
+    ASSERT_EQ(map.find({9, 9}), 99);
+}
+
+
+TEST(sharded_avl_test, concurrent_insert_test) {
+    ShardedAvl<int, int> map({2500, 5000, 7500});
+    std::vector<std::thread> threads;
+
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&map, t]() {
+            for (int i = t; i < 10000; i += 4) {
+                map.insert({i, t});
+                if (i % 1000 == 0) {
+                    map.rebalance();
+                }
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    ASSERT_EQ(map.size(), 10000);
+    for (int i = 0; i < 10000; ++i) {
+        ASSERT_EQ(map.find(i), i % 4);
+    }
+}
+
+
+TEST(mvcc_avl_test, transfer_test) {
+    MvccAvl<std::string, int> accounts;
+    auto setup = accounts.begin_txn();
+    setup.insert({"a", 100});
+    setup.insert({"b", 0});
+    ASSERT_EQ(*setup.find("a"), 100);
+    ASSERT_TRUE(setup.commit());
+
+    auto before = accounts.snapshot();
+    auto txn = accounts.begin_txn();
+    txn.insert_or_assign({"a", *txn.find("a") - 30});
+    txn.insert_or_assign({"b", *txn.find("b") + 30});
+    ASSERT_EQ(*txn.find("a"), 70);
+    ASSERT_EQ(*accounts.snapshot().find("a"), 100);
+    ASSERT_TRUE(txn.commit());
+    ASSERT_THROW(txn.erase("a"), std::logic_error);
+
+    auto after = accounts.snapshot();
+    ASSERT_EQ(*after.find("a"), 70);
+    ASSERT_EQ(*after.find("b"), 30);
+    ASSERT_EQ(*before.find("a"), 100);
+    ASSERT_EQ(after.version(), before.version() + 1);
+
+    auto first = accounts.begin_txn();
+    auto second = accounts.begin_txn();
+    auto third = accounts.begin_txn();
+    first.erase("a");
+    second.insert_or_assign({"a", 1});
+    third.insert({"c", 5});
+    ASSERT_TRUE(first.commit());
+    ASSERT_FALSE(second.commit());
+    ASSERT_TRUE(third.commit());
+    ASSERT_FALSE(accounts.snapshot().contains("a"));
+    ASSERT_EQ(accounts.size(), 2);
+}
+
+
+TEST(mvcc_avl_test, random_version_test) {
+    MvccAvl<int, int> map;
+    std::map<int, int> reference;
+    std::vector<std::pair<MvccSnapshot<int, int, std::less<int>>,
+                                            std::map<int, int>>> history;
+    std::mt19937 gen(17);
+
+    for (int round = 0; round < 200; ++round) {
+        auto txn = map.begin_txn();
+        for (int i = 0; i < 20; ++i) {
+            int k = gen() % 500;
+            if (gen() % 3 == 0) {
+                ASSERT_EQ(txn.erase(k), reference.erase(k));
+            } else {
+                txn.insert_or_assign({k, round});
+                reference[k] = round;
+            }
+        }
+        ASSERT_TRUE(txn.commit());
+        if (round % 20 == 0) {
+            history.emplace_back(map.snapshot(), reference);
+        }
+    }
+
+    for (const auto &[snapshot, expected] : history) {
+        std::vector<std::pair<int, int>> entries;
+        snapshot.for_each([&entries](const std::pair<const int, int> &pair) {
+            entries.push_back(pair);
+        });
+        ASSERT_EQ(snapshot.size(), expected.size());
+        std::vector<std::pair<int, int>> values(expected.begin(),
+                                                            expected.end());
+        ASSERT_EQ(entries, values);
+    }
+}
+
+TEST(mvcc_avl_test, diff_test) {
+    MvccAvl<int, int> map;
+    auto load = map.begin_txn();
+    for (int i = 0; i < 1000; ++i) {
+        load.insert({i, i});
+    }
+    ASSERT_TRUE(load.commit());
+
+    auto before = map.snapshot();
+    auto txn = map.begin_txn();
+    txn.erase(10);
+    txn.insert_or_assign({500, -1});
+    txn.insert({1000, 0});
+    ASSERT_TRUE(txn.commit());
+    auto after = map.snapshot();
+
+    auto changes = diff(before, after);
+    ASSERT_EQ(changes.size(), 3);
+    ASSERT_EQ(changes[0].kind, ChangeKind::erased);
+    ASSERT_EQ(changes[0].key, 10);
+    ASSERT_EQ(changes[1].kind, ChangeKind::modified);
+    ASSERT_EQ(*changes[1].before, 500);
+    ASSERT_EQ(*changes[1].after, -1);
+    ASSERT_EQ(changes[2].kind, ChangeKind::inserted);
+    ASSERT_EQ(changes[2].key, 1000);
+    ASSERT_TRUE(diff(after, after).empty());
+    ASSERT_EQ(diff(after, before).size(), 3);
+}
+
+
+TEST(mvcc_avl_test, three_way_comparator_test) {
+    MvccAvl<Version, int, VersionOrder> map;
+    auto load = map.begin_txn();
+    for (int i = 0; i < 100; ++i) {
+        load.insert({{i % 10, i / 10}, i});
+    }
+    ASSERT_TRUE(load.commit());
+
+    auto before = map.snapshot();
+    ASSERT_EQ(*before.find({3, 4}), 43);
+    ASSERT_FALSE(before.contains({10, 0}));
+
+    auto txn = map.begin_txn();
+    txn.erase({0, 0});
+    txn.insert_or_assign({{3, 4}, -1});
+    ASSERT_TRUE(txn.commit());
+    auto after = map.snapshot();
+    ASSERT_FALSE(after.contains({0, 0}));
+    ASSERT_EQ(*after.find({3, 4}), -1);
+
+    auto changes = diff(before, after);
+    ASSERT_EQ(changes.size(), 2);
+    ASSERT_EQ(changes[0].kind, ChangeKind::erased);
+    ASSERT_EQ(changes[1].kind, ChangeKind::modified);
+}
+
+
+TEST(mvcc_avl_test, concurrent_transfer_test) {
+    MvccAvl<int, int> accounts;
+    auto setup = accounts.begin_txn();
+    for (int i = 0; i < 10; ++i) {
+        setup.insert({i, 1000});
+    }
+    setup.commit();
+
+    std::atomic<bool> stop(false);
+    std::atomic<int> torn(0);
+    std::thread reader([&]() {
+        while (!stop) {
+            auto view = accounts.snapshot();
+            int sum = 0;
+            view.for_each([&sum](const std::pair<const int, int> &pair) {
+                sum += pair.second;
+            });
+            torn += (sum != 10000);
+        }
+    });
+
+    std::vector<std::thread> writers;
+    for (int t = 0; t < 4; ++t) {
+        writers.emplace_back([&accounts, t]() {
+            std::mt19937 gen(t);
+            for (int done = 0; done < 500;) {
+                int from = gen() % 10;
+                int to = (from + 1 + gen() % 9) % 10;
+                auto txn = accounts.begin_txn();
+                txn.insert_or_assign({from, *txn.find(from) - 1});
+                txn.insert_or_assign({to, *txn.find(to) + 1});
+                done += txn.commit();
+            }
+        });
+    }
+    for (auto &writer : writers) {
+        writer.join();
+    }
+    stop = true;
+    reader.join();
+
+    int sum = 0;
+    accounts.snapshot().for_each([&sum](const auto &pair) {
+        sum += pair.second;
+    });
+    ASSERT_EQ(torn, 0);
+    ASSERT_EQ(sum, 10000);
+    ASSERT_GE(accounts.version(), 2001);
+}
+
+
+TEST(buffered_avl_test, flush_test) {
+    BufferedAvl<int, int> tree(4);
+
+    tree.insert({1, 10});
+    tree.insert({2, 20});
+    tree.insert({1, 11});
+    ASSERT_EQ(tree.pending(), 3);
+    ASSERT_EQ(*tree.find(1), 10);
+    ASSERT_EQ(*tree.find(2), 20);
+
+    tree.erase(2);
+    ASSERT_EQ(tree.pending(), 0);
+    ASSERT_EQ(tree.merged().size(), 1);
+    ASSERT_EQ((*tree.merged().find(1)).second, 10);
+
+    tree.insert_or_assign({1, 12});
+    tree.insert({3, 30});
+    ASSERT_EQ(tree.size(), 2);
+    ASSERT_EQ(tree.pending(), 0);
+    ASSERT_EQ(*tree.find(1), 12);
+}
+
+
+TEST(buffered_avl_test, read_your_writes_test) {
+    BufferedAvl<int, int> tree(32);
+    std::map<int, int> reference;
+    std::mt19937 gen(5);
+
+    for (int i = 0; i < 20000; ++i) {
+        int k = gen() % 2000;
+        switch (gen() % 4) {
+        case 0:
+            tree.erase(k);
+            reference.erase(k);
+            break;
+        case 1:
+            tree.insert_or_assign({k, i});
+            reference.insert_or_assign(k, i);
+            break;
+        default:
+            tree.insert({k, i});
+            reference.insert({k, i});
+        }
+
+        int probe = gen() % 2000;
+        auto expected = reference.find(probe);
+        if (expected == reference.end()) {
+            ASSERT_FALSE(tree.contains(probe));
+        } else {
+            ASSERT_EQ(tree.find(probe), expected->second);
+        }
+        ASSERT_EQ(tree.find(k).has_value(), reference.count(k) > 0);
+    }
+
+    std::map<int, int> merged;
+    tree.for_each([&merged](const std::pair<const int, int> &pair) {
+        merged.insert(pair);
+    });
+    ASSERT_EQ(merged, reference);
+}
+
+
+TEST(buffered_avl_test, three_way_comparator_test) {
+    BufferedAvl<Version, int, VersionOrder> tree(8);
+    std::map<Version, int> reference;
+
+    for (int i = 0; i < 100; ++i) {
+        Version v{i % 7, i % 3};
+        if (i % 5 == 0) {
+            tree.erase(v);
+            reference.erase(v);
+        } else {
+            tree.insert_or_assign({v, i});
+            reference.insert_or_assign(v, i);
+        }
+        ASSERT_EQ(tree.contains(v), reference.count(v) > 0);
+    }
+
+    ASSERT_EQ(tree.size(), reference.size());
+    for (const auto &[v, value] : reference) {
+        ASSERT_EQ(tree.find(v), value);
+    }
+}
+
+constexpr auto kPorts = make_static_avl<std::string_view, int>({
+    {"dns", 53}, {"http", 80}, {"https", 443}, {"imap", 143},
+    {"smtp", 25}, {"ssh", 22}, {"telnet", 23}});
+
+static_assert(kPorts.contains("ssh"));
+static_assert(!kPorts.contains("gopher"));
+static_assert(kPorts.at("https") == 443);
+static_assert(kPorts.height() == 3);
+
+
+TEST(static_avl_test, lookup_test) {
+    std::map<std::string_view, int> reference(kPorts.begin(), kPorts.end());
+    std::vector<std::pair<std::string_view, int>> entries(kPorts.begin(),
+                                                                kPorts.end());
+
+    ASSERT_EQ(entries, decltype(entries)(reference.begin(), reference.end()));
+    for (const auto &[name, port] : reference) {
+        ASSERT_EQ(kPorts.find(name)->second, port);
+    }
+    ASSERT_TRUE(kPorts.find("ftp") == kPorts.end());
+    ASSERT_THROW(kPorts.at("ftp"), std::out_of_range);
+}
+
+
+TEST(static_avl_test, shape_test) {
+    std::pair<int, int> list[1000];
+    for (int i = 0; i < 1000; ++i) {
+        list[i] = {i * 3, i};
+    }
+
+    StaticAvl<int, int, 1000> table(list);
+    ASSERT_EQ(table.height(), 10);
+    for (int k = -1; k < 3001; ++k) {
+        ASSERT_EQ(table.contains(k), k % 3 == 0 && k < 3000);
+    }
+
+    std::swap(list[10], list[11]);
+    ASSERT_THROW((StaticAvl<int, int, 1000>(list)), std::invalid_argument);
+}
+
+TEST(separated_avl_test, random_ops_test) {
+    SeparatedAvl<int, std::string> map(64);
+    std::map<int, std::string> reference;
+    std::mt19937 gen(5);
+
+    for (int i = 0; i < 20000; ++i) {
+        int k = gen() % 1000;
+        std::string value(gen() % 100, 'a' + i % 26);
+        switch (gen() % 4) {
+        case 0:
+            ASSERT_EQ(map.erase(k), reference.erase(k));
+            break;
+        case 1:
+            map.insert_or_assign(k, value);
+            reference.insert_or_assign(k, value);
+            break;
+        default:
+            ASSERT_EQ(map.insert({k, value}),
+                                        reference.insert({k, value}).second);
+        }
+        if (i % 100 == 0) {
+            map.collect(50);
+        }
+
+        int probe = gen() % 1000;
+        auto expected = reference.find(probe);
+        if (expected == reference.end()) {
+            ASSERT_EQ(map.find(probe), nullptr);
+        } else {
+            ASSERT_EQ(map.at(probe), expected->second);
+        }
+    }
+
+    ASSERT_EQ(map.size(), reference.size());
+    ASSERT_EQ(map.log().records(), map.size() + map.garbage());
+    std::map<int, std::string> merged;
+    map.for_each([&merged](const int &k, std::string &value) {
+        merged.emplace(k, value);
+    });
+    ASSERT_EQ(merged, reference);
+}
+
+
+TEST(separated_avl_test, collect_test) {
+    SeparatedAvl<int, std::vector<int>> map(16);
+
+    for (int round = 0; round < 5; ++round) {
+        for (int k = 0; k < 100; ++k) {
+            map.insert_or_assign(k, std::vector<int>(10, round));
+        }
+    }
+    ASSERT_EQ(map.garbage(), 400);
+    ASSERT_EQ(map.log().records(), 500);
+
+    size_t bytes = map.log().memory_usage();
+    while (map.collect(32)) {}
+    ASSERT_EQ(map.log().records(), 100);
+    ASSERT_LT(map.log().memory_usage(), bytes / 4);
+    for (int k = 0; k < 100; ++k) {
+        ASSERT_EQ(map.at(k), std::vector<int>(10, 4));
+    }
+
+    for (int k = 0; k < 100; ++k) {
+        ASSERT_EQ(map.erase(k), 1);
+    }
+    ASSERT_EQ(map.collect(1000), 0);
+    ASSERT_EQ(map.log().records(), 0);
+    ASSERT_TRUE(map.empty());
+    ASSERT_THROW(map.at(1), std::out_of_range);
+
+    map.insert({7, {1, 2, 3}});
+    ASSERT_EQ(map.at(7), std::vector<int>({1, 2, 3}));
+    ASSERT_EQ(map.log().records(), 1);
+}
+
 int main(int argc, char **argv) {
     ::testing::InitGoogleTest(&argc, argv);
 